@@ -0,0 +1,143 @@
+/*-----------------------------------------------------------------------
+ * Minimal benchmark harness shared by the bench_* programs.
+ *
+ * A benchmark is a function run by one or more threads at once; the threads
+ * are released together through a barrier and the wall time from the
+ * release until the last thread finishes is reported, divided by the total
+ * number of operations. Every result is printed as one line:
+ *
+ *   <name>  <threads>  <ops>  <ns/op>  <Mops/s>
+ *
+ * A benchmark program takes an optional substring filter as its first
+ * argument and only runs the benchmarks whose name contains it, and
+ * '--quick' as any argument scales the work down for smoke runs.
+ *-----------------------------------------------------------------------*/
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/* Thread body: 'id' is 0..threads-1, returns the number of ops it did. */
+typedef uint64_t (*benchFunc)(void* arg, unsigned id);
+
+typedef struct {
+    const char* filter;         /* Only run names containing this. */
+    int quick;                  /* Scale the work down. */
+} sBenchConfig;
+
+static sBenchConfig bench_config;
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/* Reads the command line into bench_config and prints the header. */
+static inline void bench_init(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            bench_config.quick = 1;
+        } else {
+            bench_config.filter = argv[i];
+        }
+    }
+    printf("%-48s %7s %12s %10s %10s\n", "benchmark", "threads", "ops",
+            "ns/op", "Mops/s");
+}
+
+/* Returns 'n', or a tenth of it (at least 1) in quick mode. */
+static inline uint64_t bench_scale(uint64_t n)
+{
+    return bench_config.quick && n >= 10 ? n / 10 : n;
+}
+
+/* Returns 1 if the benchmark 'name' should run. */
+static inline int bench_enabled(const char* name)
+{
+    return !bench_config.filter || strstr(name, bench_config.filter) != NULL;
+}
+
+static inline void bench_report(const char* name, unsigned threads,
+        uint64_t ops, uint64_t ns)
+{
+    double nsPerOp = ops ? (double) ns / (double) ops : 0.0;
+    double mops = ns ? (double) ops * 1000.0 / (double) ns : 0.0;
+    printf("%-48s %7u %12llu %10.1f %10.2f\n", name, threads,
+            (unsigned long long) ops, nsPerOp, mops);
+    fflush(stdout);
+}
+
+typedef struct {
+    benchFunc fn;
+    void* arg;
+    unsigned id;
+    pthread_barrier_t* start;
+    uint64_t ops;
+} sBenchThread;
+
+static void* bench_thread(void* arg)
+{
+    sBenchThread* t = (sBenchThread*) arg;
+    pthread_barrier_wait(t->start);
+    t->ops = t->fn(t->arg, t->id);
+    return NULL;
+}
+
+/*
+ * Runs fn(arg, id) on 'threads' threads at once and reports the result as
+ * 'name'. Returns the elapsed time in ns.
+ */
+static inline uint64_t bench_run(const char* name, unsigned threads,
+        benchFunc fn, void* arg)
+{
+    sBenchThread* t = (sBenchThread*) calloc(threads, sizeof(sBenchThread));
+    pthread_t* tids = (pthread_t*) calloc(threads, sizeof(pthread_t));
+    pthread_barrier_t start;
+    uint64_t ops = 0;
+
+    if (!t || !tids) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        exit(1);
+    }
+    pthread_barrier_init(&start, NULL, threads + 1);
+    for (unsigned i = 0; i < threads; i++) {
+        t[i].fn = fn;
+        t[i].arg = arg;
+        t[i].id = i;
+        t[i].start = &start;
+        if (pthread_create(&tids[i], NULL, bench_thread, &t[i]) != 0) {
+            fprintf(stderr, "%s: can't start thread %u\n", name, i);
+            exit(1);
+        }
+    }
+    uint64_t begin = bench_now();
+    pthread_barrier_wait(&start);
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        ops += t[i].ops;
+    }
+    uint64_t ns = bench_now() - begin;
+    pthread_barrier_destroy(&start);
+    free(tids);
+    free(t);
+
+    bench_report(name, threads, ops, ns);
+    return ns;
+}
+
+/* Keeps the compiler from optimizing away a value. */
+static inline void bench_use(const void* p)
+{
+    __asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+#endif /* BENCH_H_ */
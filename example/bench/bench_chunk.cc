@@ -0,0 +1,140 @@
+/*-----------------------------------------------------------------------
+ * Slice completion time against the negotiated chunk size.
+ *
+ *   bench_chunk [filter] [--quick]
+ *
+ * A 4 MB slice is downloaded from BENCH_PEERS peers with one connection
+ * each and one FILE_FEED_REQUEST at a time per connection. Requests and
+ * responses go through the real encoder, parser and sFileFeedPeer; only
+ * the network is simulated. A round trip takes the RTT plus the time to
+ * send the response payload at BENCH_PEER_RATE bytes/s, the upstream of
+ * a home connection. The clock is simulated, so the results don't depend
+ * on the machine:
+ *
+ *   rtt<ms>/chunk<size> - requests of up to 'size' bytes, as allowed by
+ *                         the peer's FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE
+ *                         offer in its first response
+ *
+ * ns/op is the simulated time until the whole slice has arrived.
+ *-----------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "u_protocol.h"
+
+#define BENCH_PEERS         4
+#define BENCH_PEER_RATE     (1 << 20)           /* Bytes/s per peer. */
+#define BENCH_SLICE_SIZE    (4 << 20)
+
+typedef struct {
+    sFileFeedPeer peer;
+    uint64_t freeAt;            /* Simulated ns the connection is idle. */
+} sBenchConn;
+
+typedef struct {
+    const uint8_t* source;      /* The slice on the peers. */
+    uint8_t* slice;             /* Where it is downloaded to. */
+    sFileFeedEncoder* enc;
+    uint8_t response[MAX_PAYLOAD_SIZE];
+} sBenchDownload;
+
+/* A peer answering 'req', returns the size of the response. */
+static int32_t bench_serve(sBenchDownload* d, const uint8_t* req)
+{
+    uint32_t offset;
+    uint32_t size;
+
+    memcpy(&offset, req + FILE_FEED_CRID_SIZE + 2, 4);
+    memcpy(&size, req + FILE_FEED_CRID_SIZE + 6, 4);
+    offset = ntohl(offset);
+    size = ntohl(size);
+    int32_t n = FILE_FEED_HEADER_SIZE + size;
+    memcpy(d->response, req, FILE_FEED_REQUEST_SIZE);
+    memcpy(d->response + FILE_FEED_HEADER_SIZE, d->source + offset, size);
+    n += protocol_putMaxChunkOffer(d->response + n, MAX_PAYLOAD_SIZE - n,
+            MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+    return n;
+}
+
+/* Returns the simulated ns until the slice is complete. */
+static uint64_t bench_download(sBenchDownload* d, uint32_t chunkSize,
+        uint64_t rttNs)
+{
+    sBenchConn conns[BENCH_PEERS];
+    sFileFeedResponse r;
+    sExtInfo info;
+    uint32_t next = 0;
+    uint64_t done = 0;
+
+    for (unsigned c = 0; c < BENCH_PEERS; c++) {
+        protocol_peerInit(&conns[c].peer, chunkSize);
+        conns[c].freeAt = 0;
+    }
+    while (next < BENCH_SLICE_SIZE) {
+        sBenchConn* conn = &conns[0];
+        for (unsigned c = 1; c < BENCH_PEERS; c++) {
+            if (conns[c].freeAt < conn->freeAt) {
+                conn = &conns[c];
+            }
+        }
+        uint32_t size = BENCH_SLICE_SIZE - next;
+        if (size > conn->peer.maxChunkSize) {
+            size = conn->peer.maxChunkSize;
+        }
+        uint8_t* req = protocol_encodeFileFeedRequest(d->enc, 1, next, size);
+        int32_t n = bench_serve(d, req);
+        protocol_encoderRelease(d->enc, req);
+
+        if (protocol_parseFileFeedResponse(d->response, n, &r) != 0) {
+            fprintf(stderr, "bad response\n");
+            exit(1);
+        }
+        while (protocol_extInfoNext(&r.extInfo, &info) > 0) {
+            protocol_peerLearn(&conn->peer, &info);
+        }
+        memcpy(d->slice + r.offset, r.chunkData, r.chunkSize);
+        next += r.chunkSize;
+        conn->freeAt += rttNs + (uint64_t) n * 1000000000ULL / BENCH_PEER_RATE;
+        if (conn->freeAt > done) {
+            done = conn->freeAt;
+        }
+    }
+    return done;
+}
+
+
+int main(int argc, char** argv)
+{
+    static const uint32_t rttsMs[] = { 1, 20, 80 };
+    static const uint32_t chunkSizes[] = { 16384, 32768,
+        MAX_FILE_FEED_CHUNK_SIZE, MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE };
+    static sBenchDownload d;
+    uint8_t crid[FILE_FEED_CRID_SIZE];
+    sTransport transport;
+    char name[64];
+
+    bench_init(argc, argv);
+    memset(crid, 'a', sizeof(crid));
+    transport.crid_p = crid;
+    d.enc = protocol_encoderCreate(&transport, 1, RING_SPSC);
+    d.source = (uint8_t*) calloc(1, BENCH_SLICE_SIZE);
+    d.slice = (uint8_t*) malloc(BENCH_SLICE_SIZE);
+    if (!d.enc || !d.source || !d.slice) {
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(rttsMs) / sizeof(rttsMs[0]); i++) {
+        for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++) {
+            snprintf(name, sizeof(name), "rtt%u/chunk%u", rttsMs[i],
+                    chunkSizes[c]);
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            uint64_t ns = bench_download(&d, chunkSizes[c],
+                    rttsMs[i] * 1000000ULL);
+            bench_report(name, BENCH_PEERS, 1, ns);
+        }
+    }
+    protocol_encoderDestroy(d.enc);
+    free((void*) d.source);
+    free(d.slice);
+    return 0;
+}
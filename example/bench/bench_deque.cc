@@ -0,0 +1,173 @@
+/*-----------------------------------------------------------------------
+ * Load balancing of download workers under skewed per-chunk latency.
+ *
+ *   bench_deque [filter] [--quick]
+ *
+ * Every worker starts with the same number of chunks in its own deque, but
+ * the chunks of worker 0 take ten times longer, as if they came from a slow
+ * node. A chunk's latency is spent sleeping, like waiting for the network.
+ * Three schedulers are compared on the time until the last chunk is done:
+ *
+ *   static  - every worker only takes chunks from its own deque
+ *   steal   - a worker with an empty deque steals from the others
+ *   shared  - all chunks in one LIST_THREADSAFE queue
+ *
+ * The ns/op column is the elapsed time per chunk; with stealing it should
+ * approach the total latency divided by the number of workers.
+ *-----------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "u_deque.h"
+#include "u_list.h"
+
+#define BENCH_WORKERS       4
+#define BENCH_FAST_NS       100000      /* 100 us per chunk. */
+#define BENCH_SLOW_NS       1000000     /* 1 ms on the slow node. */
+
+typedef struct {
+    uint32_t latencyNs;
+} sBenchChunk;
+
+typedef enum {
+    BENCH_STATIC,
+    BENCH_STEAL,
+    BENCH_SHARED,
+} eBenchScheduler;
+
+typedef struct {
+    eBenchScheduler scheduler;
+    sDeque* deques[BENCH_WORKERS];
+    sList* shared;
+} sBenchPool;
+
+static void bench_download(sBenchChunk* chunk)
+{
+    struct timespec ts = { 0, (long) chunk->latencyNs };
+    nanosleep(&ts, NULL);
+}
+
+static sBenchChunk* bench_next(sBenchPool* p, unsigned id)
+{
+    if (p->scheduler == BENCH_SHARED) {
+        return (sBenchChunk*) list_popFront(p->shared);
+    }
+    sBenchChunk* chunk = (sBenchChunk*) deque_pop(p->deques[id]);
+    for (unsigned i = 1; !chunk && p->scheduler == BENCH_STEAL &&
+            i < BENCH_WORKERS; i++) {
+        chunk = (sBenchChunk*) deque_steal(p->deques[(id + i) % BENCH_WORKERS]);
+    }
+    return chunk;
+}
+
+/* No chunk is added once the run starts, so empty means done. */
+static uint64_t bench_worker(void* arg, unsigned id)
+{
+    sBenchPool* p = (sBenchPool*) arg;
+    sBenchChunk* chunk;
+    uint64_t done = 0;
+
+    while ((chunk = bench_next(p, id)) != NULL) {
+        bench_download(chunk);
+        done++;
+    }
+    return done;
+}
+
+static void bench_schedule(const char* name, eBenchScheduler scheduler,
+        sBenchChunk* chunks, size_t perWorker)
+{
+    sBenchPool p;
+
+    if (!bench_enabled(name)) {
+        return;
+    }
+    p.scheduler = scheduler;
+    p.shared = list_create(NULL);
+    for (unsigned w = 0; w < BENCH_WORKERS; w++) {
+        p.deques[w] = deque_create(perWorker, NULL);
+        if (!p.deques[w] || !p.shared) {
+            fprintf(stderr, "%s: out of memory\n", name);
+            exit(1);
+        }
+    }
+    /* Interleave the workers' chunks in the shared queue, as they arrive. */
+    for (size_t i = 0; i < perWorker; i++) {
+        for (unsigned w = 0; w < BENCH_WORKERS; w++) {
+            sBenchChunk* chunk = &chunks[w * perWorker + i];
+            if (scheduler == BENCH_SHARED) {
+                list_pushBack(p.shared, chunk);
+            } else {
+                deque_push(p.deques[w], chunk);
+            }
+        }
+    }
+    bench_run(name, BENCH_WORKERS, bench_worker, &p);
+    for (unsigned w = 0; w < BENCH_WORKERS; w++) {
+        deque_destroy(p.deques[w]);
+    }
+    list_destroy(p.shared);
+}
+
+/* Owner push/pop and steal cost without any latency. */
+static uint64_t bench_ownerPushPop(void* arg, unsigned id)
+{
+    sDeque* d = (sDeque*) arg;
+    uint64_t n = bench_scale(1 << 24);
+    static long one = 1;
+    (void) id;
+
+    for (uint64_t i = 0; i < n; i++) {
+        deque_push(d, &one);
+        bench_use(deque_pop(d));
+    }
+    return n * 2;
+}
+
+static uint64_t bench_pushSteal(void* arg, unsigned id)
+{
+    sDeque* d = (sDeque*) arg;
+    uint64_t n = bench_scale(1 << 24);
+    static long one = 1;
+    (void) id;
+
+    for (uint64_t i = 0; i < n; i++) {
+        deque_push(d, &one);
+        bench_use(deque_steal(d));
+    }
+    return n * 2;
+}
+
+
+int main(int argc, char** argv)
+{
+    bench_init(argc, argv);
+
+    if (bench_enabled("deque/pushpop")) {
+        sDeque* d = deque_create(64, NULL);
+        bench_run("deque/pushpop", 1, bench_ownerPushPop, d);
+        deque_destroy(d);
+    }
+    if (bench_enabled("deque/pushsteal")) {
+        sDeque* d = deque_create(64, NULL);
+        bench_run("deque/pushsteal", 1, bench_pushSteal, d);
+        deque_destroy(d);
+    }
+
+    size_t perWorker = bench_scale(200);
+    sBenchChunk* chunks = (sBenchChunk*) calloc(BENCH_WORKERS * perWorker,
+            sizeof(sBenchChunk));
+    if (!chunks) {
+        return 1;
+    }
+    for (unsigned w = 0; w < BENCH_WORKERS; w++) {
+        for (size_t i = 0; i < perWorker; i++) {
+            chunks[w * perWorker + i].latencyNs = w == 0 ? BENCH_SLOW_NS :
+                    BENCH_FAST_NS;
+        }
+    }
+    bench_schedule("skewed/static", BENCH_STATIC, chunks, perWorker);
+    bench_schedule("skewed/steal", BENCH_STEAL, chunks, perWorker);
+    bench_schedule("skewed/shared", BENCH_SHARED, chunks, perWorker);
+    free(chunks);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*-----------------------------------------------------------------------
+ * Earliest-deadline scheduling with sHeap against the sList approaches.
+ *
+ *   bench_heap [filter] [--quick]
+ *
+ * 'n' chunks are pending, each with a deadline. Every round takes the chunk
+ * with the earliest deadline and puts it back with a later one, and moves
+ * the deadline of one random pending chunk earlier, as when a slice becomes
+ * urgent. Three ways of keeping the chunks:
+ *
+ *   heap    - sHeap; pop, push and heap_update() through the chunk's handle
+ *   sorted  - sList kept sorted with list_insertSorted(), with a hash index
+ *             so the urgent chunk is found with list_remove() in O(1)
+ *   scan    - unsorted sList, searched with list_foreach() for the earliest
+ *             deadline on every round
+ *
+ * ns/op is the time per round, including filling the container once.
+ *-----------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "u_heap.h"
+#include "u_list.h"
+
+typedef struct {
+    uint64_t deadline;
+    sHeapNode* handle;
+} sBenchChunk;
+
+typedef struct {
+    sBenchChunk* chunks;
+    size_t n;
+    uint64_t rounds;
+    uint64_t rng;
+} sBenchDeadlines;
+
+static int bench_byDeadline(void* a, void* b)
+{
+    uint64_t x = ((sBenchChunk*) a)->deadline;
+    uint64_t y = ((sBenchChunk*) b)->deadline;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t bench_rand(sBenchDeadlines* b)
+{
+    b->rng ^= b->rng << 13;
+    b->rng ^= b->rng >> 7;
+    b->rng ^= b->rng << 17;
+    return b->rng;
+}
+
+static void bench_reset(sBenchDeadlines* b)
+{
+    b->rng = 88172645463325252ULL;
+    for (size_t i = 0; i < b->n; i++) {
+        b->chunks[i].deadline = bench_rand(b) % (b->n * 16);
+    }
+}
+
+static uint64_t bench_heap(void* arg, unsigned id)
+{
+    sBenchDeadlines* b = (sBenchDeadlines*) arg;
+    sHeap* h = heap_create(bench_byDeadline, NULL, LIST_THREADSAFE);
+    (void) id;
+
+    for (size_t i = 0; i < b->n; i++) {
+        b->chunks[i].handle = heap_push(h, &b->chunks[i]);
+    }
+    for (uint64_t r = 0; r < b->rounds; r++) {
+        sBenchChunk* next = (sBenchChunk*) heap_pop(h);
+        next->deadline += b->n * 16;
+        next->handle = heap_push(h, next);
+
+        sBenchChunk* urgent = &b->chunks[bench_rand(b) % b->n];
+        heap_lock(h);
+        urgent->deadline /= 2;
+        heap_updateLocked(h, urgent->handle);
+        heap_unlock(h);
+    }
+    heap_destroy(h);
+    return b->rounds;
+}
+
+static uint64_t bench_sorted(void* arg, unsigned id)
+{
+    sBenchDeadlines* b = (sBenchDeadlines*) arg;
+    sListAttr attr;
+    (void) id;
+
+    list_attrInit(&attr);
+    attr.hashIndex = 1;
+    sList* l = list_createAttr(NULL, &attr);
+    for (size_t i = 0; i < b->n; i++) {
+        list_pushBack(l, &b->chunks[i]);
+    }
+    list_sort(l, bench_byDeadline);
+    for (uint64_t r = 0; r < b->rounds; r++) {
+        sBenchChunk* next = (sBenchChunk*) list_popFront(l);
+        next->deadline += b->n * 16;
+        list_insertSorted(l, next, bench_byDeadline);
+
+        sBenchChunk* urgent = &b->chunks[bench_rand(b) % b->n];
+        list_remove(l, urgent);
+        urgent->deadline /= 2;
+        list_insertSorted(l, urgent, bench_byDeadline);
+    }
+    list_destroy(l);
+    return b->rounds;
+}
+
+static int32_t bench_earliest(void* element, void* param)
+{
+    sBenchChunk** best = (sBenchChunk**) param;
+    if (!*best || bench_byDeadline(element, *best) < 0) {
+        *best = (sBenchChunk*) element;
+    }
+    return 1;
+}
+
+static uint64_t bench_scan(void* arg, unsigned id)
+{
+    sBenchDeadlines* b = (sBenchDeadlines*) arg;
+    sListAttr attr;
+    (void) id;
+
+    list_attrInit(&attr);
+    attr.hashIndex = 1;
+    sList* l = list_createAttr(NULL, &attr);
+    for (size_t i = 0; i < b->n; i++) {
+        list_pushBack(l, &b->chunks[i]);
+    }
+    for (uint64_t r = 0; r < b->rounds; r++) {
+        sBenchChunk* next = NULL;
+        list_foreach(l, bench_earliest, &next);
+        list_remove(l, next);
+        next->deadline += b->n * 16;
+        list_pushBack(l, next);
+
+        /* Unsorted: changing a key needs no list call. */
+        b->chunks[bench_rand(b) % b->n].deadline /= 2;
+    }
+    list_destroy(l);
+    return b->rounds;
+}
+
+
+int main(int argc, char** argv)
+{
+    static const size_t sizes[] = { 64, 1024, 16384 };
+    static const struct {
+        const char* name;
+        benchFunc fn;
+    } kinds[] = {
+        { "heap", bench_heap },
+        { "sorted", bench_sorted },
+        { "scan", bench_scan },
+    };
+    char name[64];
+
+    bench_init(argc, argv);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        sBenchDeadlines b;
+        b.n = sizes[s];
+        b.chunks = (sBenchChunk*) calloc(b.n, sizeof(sBenchChunk));
+        if (!b.chunks) {
+            return 1;
+        }
+        for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+            snprintf(name, sizeof(name), "deadline/%s/%zu", kinds[k].name,
+                    sizes[s]);
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            /* The list versions are O(n) per round, keep them bounded. */
+            uint64_t work = k == 0 ? (1 << 22) : (1 << 26) / b.n;
+            b.rounds = bench_scale(work);
+            bench_reset(&b);
+            bench_run(name, 1, kinds[k].fn, &b);
+        }
+        free(b.chunks);
+    }
+    return 0;
+}
@@ -0,0 +1,882 @@
+/*-----------------------------------------------------------------------
+ * Microbenchmarks of sList.
+ *
+ *   bench_list [filter] [--quick]
+ *
+ * Single thread: push/pop, find, remove, foreach and cat for every locking
+ * mode and several list sizes; exists/remove with and without the hash
+ * index from 10 to 1M elements; traversals of linked and unrolled lists
+ * from 1K to 10M elements with list_foreach() and the cursor; and the batch
+ * calls against their per-element equivalents. Several threads: a shared
+ * queue in every mode, MPSC with one consumer thread, and a sharded list
+ * from 1 to 64 threads; sRing against sList between producer and consumer
+ * threads; readers against one writer with mutex, reader-writer lock and
+ * epoch readers; and list_foreachParallel() on a growing executor. Last,
+ * vn::List against the C API.
+ *-----------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "u_list.h"
+#include "u_list.hpp"
+#include "u_ring.h"
+#include <sched.h>
+
+/* Elements are pointers into this array, so they compare and hash cheaply. */
+#define BENCH_MAX_ELEMENTS  (1 << 20)
+static long bench_values[BENCH_MAX_ELEMENTS];
+
+static inline void* bench_element(size_t i)
+{
+    return &bench_values[i % BENCH_MAX_ELEMENTS];
+}
+
+static int bench_cmp(void* a, void* b)
+{
+    long x = *(long*) a;
+    long y = *(long*) b;
+    return x < y ? -1 : x > y;
+}
+
+typedef struct {
+    const char* name;
+    eListThreadAlt threadAlt;
+    eListStorage storage;
+    int hashIndex;
+    int epochReclaim;
+    unsigned shards;
+} sBenchMode;
+
+static const sBenchMode bench_lockedModes[] = {
+    { "threadsafe",     LIST_THREADSAFE,     LIST_STORAGE_LINKED,   0, 0, 0 },
+    { "not_threadsafe", LIST_NOT_THREADSAFE, LIST_STORAGE_LINKED,   0, 0, 0 },
+    { "rw",             LIST_THREADSAFE_RW,  LIST_STORAGE_LINKED,   0, 0, 0 },
+    { "unrolled",       LIST_THREADSAFE,     LIST_STORAGE_UNROLLED, 0, 0, 0 },
+    { "hash",           LIST_THREADSAFE,     LIST_STORAGE_LINKED,   1, 0, 0 },
+};
+#define BENCH_LOCKED_MODES  (sizeof(bench_lockedModes) / sizeof(bench_lockedModes[0]))
+
+static const size_t bench_sizes[] = { 16, 1024, 65536 };
+#define BENCH_SIZES         (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+static sList* bench_create(const sBenchMode* mode)
+{
+    sListAttr attr;
+    list_attrInit(&attr);
+    attr.threadAlt = mode->threadAlt;
+    attr.storage = mode->storage;
+    attr.hashIndex = mode->hashIndex;
+    attr.epochReclaim = mode->epochReclaim;
+    attr.shards = mode->shards;
+    sList* l = list_createAttr(NULL, &attr);
+    if (!l) {
+        fprintf(stderr, "can't create a %s list\n", mode->name);
+        exit(1);
+    }
+    return l;
+}
+
+/* Creates a list of the elements first..first+n-1. */
+static sList* bench_createFilled(const sBenchMode* mode, size_t first, size_t n)
+{
+    sList* l = bench_create(mode);
+    for (size_t i = first; i < first + n; i++) {
+        list_pushBack(l, bench_element(i));
+    }
+    return l;
+}
+
+/* Ops per single threaded benchmark, so that each takes a similar time. */
+static uint64_t bench_iterations(size_t size, uint64_t work)
+{
+    uint64_t n = bench_scale(work) / size;
+    return n ? n : 1;
+}
+
+
+/*---------------------------- Single thread ----------------------------*/
+
+typedef struct {
+    sList* list;
+    size_t size;
+    uint64_t iterations;
+} sBenchSingle;
+
+static uint64_t bench_pushPop(void* arg, unsigned id)
+{
+    sBenchSingle* b = (sBenchSingle*) arg;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        list_pushBack(b->list, list_popFront(b->list));
+    }
+    return b->iterations * 2;
+}
+
+static uint64_t bench_find(void* arg, unsigned id)
+{
+    sBenchSingle* b = (sBenchSingle*) arg;
+    uint64_t seed = 88172645463325252ULL;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        bench_use(list_find(b->list, bench_element(seed % b->size), bench_cmp));
+    }
+    return b->iterations;
+}
+
+static uint64_t bench_exists(void* arg, unsigned id)
+{
+    sBenchSingle* b = (sBenchSingle*) arg;
+    uint64_t seed = 88172645463325252ULL;
+    int found = 0;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        found += list_exists(b->list, bench_element(seed % b->size));
+    }
+    bench_use(&found);
+    return b->iterations;
+}
+
+/* Removes an element from the middle and pushes it back at the end. */
+static uint64_t bench_remove(void* arg, unsigned id)
+{
+    sBenchSingle* b = (sBenchSingle*) arg;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        void* el = bench_element((i * 7919) % b->size);
+        list_remove(b->list, el);
+        list_pushBack(b->list, el);
+    }
+    return b->iterations * 2;
+}
+
+static int32_t bench_sumElement(void* element, void* param)
+{
+    *(long*) param += *(long*) element;
+    return 1;
+}
+
+static uint64_t bench_foreach(void* arg, unsigned id)
+{
+    sBenchSingle* b = (sBenchSingle*) arg;
+    long sum = 0;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        list_foreach(b->list, bench_sumElement, &sum);
+    }
+    bench_use(&sum);
+    return b->iterations * b->size;
+}
+
+/* Walks the list element by element with a cursor. */
+static uint64_t bench_cursor(void* arg, unsigned id)
+{
+    sBenchSingle* b = (sBenchSingle*) arg;
+    sListCursor cur;
+    void* data;
+    long sum = 0;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        list_readBegin(b->list);
+        list_cursorInit(&cur, b->list);
+        while (list_cursorNext(&cur, &data)) {
+            sum += *(long*) data;
+        }
+        list_readEnd(b->list);
+    }
+    bench_use(&sum);
+    return b->iterations * b->size;
+}
+
+/* Walks the list a run of elements at a time with a cursor. */
+static uint64_t bench_cursorBlock(void* arg, unsigned id)
+{
+    sBenchSingle* b = (sBenchSingle*) arg;
+    sListCursor cur;
+    void* const* items;
+    size_t n;
+    long sum = 0;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        list_readBegin(b->list);
+        list_cursorInit(&cur, b->list);
+        while ((n = list_cursorNextBlock(&cur, &items)) > 0) {
+            for (size_t j = 0; j < n; j++) {
+                sum += *(long*) items[j];
+            }
+        }
+        list_readEnd(b->list);
+    }
+    bench_use(&sum);
+    return b->iterations * b->size;
+}
+
+/* How the cost of one iteration grows with the list size. */
+typedef enum {
+    BENCH_CONSTANT,
+    BENCH_LINEAR,
+    BENCH_LINEAR_UNLESS_HASH,   /* Constant with a hash index. */
+} eBenchCost;
+
+/* Runs 'fn' on a list of each of the 'sizes' in each of the 'modes'. */
+static void bench_runSizes(const char* op, benchFunc fn, eBenchCost cost,
+        const sBenchMode* modes, size_t nmodes,
+        const size_t* sizes, size_t nsizes)
+{
+    char name[64];
+
+    for (size_t m = 0; m < nmodes; m++) {
+        const sBenchMode* mode = &modes[m];
+        for (size_t s = 0; s < nsizes; s++) {
+            snprintf(name, sizeof(name), "%s/%s/%zu", op, mode->name,
+                    sizes[s]);
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            int linear = cost == BENCH_LINEAR ||
+                    (cost == BENCH_LINEAR_UNLESS_HASH && !mode->hashIndex);
+            sBenchSingle b;
+            b.size = sizes[s];
+            b.list = bench_createFilled(mode, 0, b.size);
+            b.iterations = bench_iterations(linear ? b.size : 1, 1 << 24);
+            bench_run(name, 1, fn, &b);
+            list_destroy(b.list);
+        }
+    }
+}
+
+static void bench_runSingle(const char* op, benchFunc fn, eBenchCost cost)
+{
+    bench_runSizes(op, fn, cost, bench_lockedModes, BENCH_LOCKED_MODES,
+            bench_sizes, BENCH_SIZES);
+}
+
+/*
+ * list_exists() and list_remove() with and without the hash index, from 10
+ * to 1M elements, to show where the index starts to pay off.
+ */
+static void bench_index(void)
+{
+    static const sBenchMode modes[] = {
+        { "threadsafe", LIST_THREADSAFE, LIST_STORAGE_LINKED, 0, 0, 0 },
+        { "hash",       LIST_THREADSAFE, LIST_STORAGE_LINKED, 1, 0, 0 },
+    };
+    static const size_t sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+    /* Quick runs stop at 100K. */
+    size_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    if (bench_config.quick) {
+        nsizes--;
+    }
+
+    bench_runSizes("index_exists", bench_exists, BENCH_LINEAR_UNLESS_HASH,
+            modes, 2, sizes, nsizes);
+    bench_runSizes("index_remove", bench_remove, BENCH_LINEAR_UNLESS_HASH,
+            modes, 2, sizes, nsizes);
+}
+
+/*
+ * Whole-list traversal of linked and unrolled lists from 1K to 10M elements:
+ * list_foreach() against the cursor, one element or one block at a time.
+ */
+static void bench_traverse(void)
+{
+    static const sBenchMode modes[] = {
+        { "linked",   LIST_THREADSAFE, LIST_STORAGE_LINKED,   0, 0, 0 },
+        { "unrolled", LIST_THREADSAFE, LIST_STORAGE_UNROLLED, 0, 0, 0 },
+    };
+    static const size_t sizes[] = { 1000, 10000, 100000, 1000000, 10000000 };
+    /* Quick runs stop at 1M. */
+    size_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    if (bench_config.quick) {
+        nsizes--;
+    }
+
+    bench_runSizes("traverse_foreach", bench_foreach, BENCH_LINEAR,
+            modes, 2, sizes, nsizes);
+    bench_runSizes("traverse_cursor", bench_cursor, BENCH_LINEAR,
+            modes, 2, sizes, nsizes);
+    bench_runSizes("traverse_block", bench_cursorBlock, BENCH_LINEAR,
+            modes, 2, sizes, nsizes);
+}
+
+typedef struct {
+    sList* a;
+    sList* b;                   /* Drain target, empty between iterations. */
+    size_t batch;
+    uint64_t iterations;
+} sBenchBatch;
+
+#define BENCH_MAX_BATCH     512
+
+static uint64_t bench_batchPushPop(void* arg, unsigned id)
+{
+    sBenchBatch* b = (sBenchBatch*) arg;
+    void* items[BENCH_MAX_BATCH];
+    void* out[BENCH_MAX_BATCH];
+    (void) id;
+    for (size_t j = 0; j < b->batch; j++) {
+        items[j] = bench_element(j);
+    }
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        list_pushBackN(b->a, items, b->batch);
+        bench_use(out + list_popFrontN(b->a, out, b->batch));
+    }
+    return b->iterations * b->batch * 2;
+}
+
+static uint64_t bench_singlePushPop(void* arg, unsigned id)
+{
+    sBenchBatch* b = (sBenchBatch*) arg;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        for (size_t j = 0; j < b->batch; j++) {
+            list_pushBack(b->a, bench_element(j));
+        }
+        for (size_t j = 0; j < b->batch; j++) {
+            bench_use(list_popFront(b->a));
+        }
+    }
+    return b->iterations * b->batch * 2;
+}
+
+/* Moves the 'batch' elements of 'a' to 'b' and back. */
+static uint64_t bench_batchDrain(void* arg, unsigned id)
+{
+    sBenchBatch* b = (sBenchBatch*) arg;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        list_drain(b->a, b->b);
+        list_drain(b->b, b->a);
+    }
+    return b->iterations * b->batch * 2;
+}
+
+static uint64_t bench_singleDrain(void* arg, unsigned id)
+{
+    sBenchBatch* b = (sBenchBatch*) arg;
+    (void) id;
+    for (uint64_t i = 0; i < b->iterations; i++) {
+        for (size_t j = 0; j < b->batch; j++) {
+            list_pushBack(b->b, list_popFront(b->a));
+        }
+        for (size_t j = 0; j < b->batch; j++) {
+            list_pushBack(b->a, list_popFront(b->b));
+        }
+    }
+    return b->iterations * b->batch * 2;
+}
+
+/*
+ * list_pushBackN(), list_popFrontN() and list_drain() against the same work
+ * done one element at a time, for a few batch sizes. The linked lists share
+ * a pool, so list_drain() relinks their nodes.
+ */
+static void bench_batches(void)
+{
+    static const size_t batches[] = { 1, 8, 64, BENCH_MAX_BATCH };
+    static const struct {
+        const char* op;
+        benchFunc fn;
+    } ops[] = {
+        { "batch_pushpop",  bench_batchPushPop },
+        { "single_pushpop", bench_singlePushPop },
+        { "batch_drain",    bench_batchDrain },
+        { "single_drain",   bench_singleDrain },
+    };
+    char name[64];
+
+    for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+        for (int unrolled = 0; unrolled < 2; unrolled++) {
+            for (size_t s = 0; s < sizeof(batches) / sizeof(batches[0]); s++) {
+                snprintf(name, sizeof(name), "%s/%s/%zu", ops[o].op,
+                        unrolled ? "unrolled" : "linked", batches[s]);
+                if (!bench_enabled(name)) {
+                    continue;
+                }
+                sListAttr attr;
+                list_attrInit(&attr);
+                attr.storage = unrolled ? LIST_STORAGE_UNROLLED :
+                        LIST_STORAGE_LINKED;
+                attr.pool = unrolled ? NULL : list_poolCreate(0);
+                sBenchBatch b;
+                b.a = list_createAttr(NULL, &attr);
+                b.b = list_createAttr(NULL, &attr);
+                if (!b.a || !b.b) {
+                    fprintf(stderr, "%s: can't create the lists\n", name);
+                    exit(1);
+                }
+                b.batch = batches[s];
+                b.iterations = bench_iterations(b.batch * 2, 1 << 24);
+                if (ops[o].fn == bench_batchDrain ||
+                        ops[o].fn == bench_singleDrain) {
+                    for (size_t j = 0; j < b.batch; j++) {
+                        list_pushBack(b.a, bench_element(j));
+                    }
+                }
+                bench_run(name, 1, ops[o].fn, &b);
+                list_destroy(b.a);
+                list_destroy(b.b);
+                if (attr.pool) {
+                    list_poolDestroy(attr.pool);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * list_cat() of a list of 'size' elements with a private pool onto another
+ * list, which relinks the nodes and adopts the pool: the cost should not
+ * depend on the size, except with a hash index. Only the cat itself is
+ * timed.
+ */
+static void bench_cat(void)
+{
+    char name[64];
+
+    for (size_t m = 0; m < BENCH_LOCKED_MODES; m++) {
+        const sBenchMode* mode = &bench_lockedModes[m];
+        for (size_t s = 0; s < BENCH_SIZES; s++) {
+            snprintf(name, sizeof(name), "cat/%s/%zu", mode->name,
+                    bench_sizes[s]);
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            uint64_t rounds = bench_iterations(bench_sizes[s], 1 << 22);
+            uint64_t ns = 0;
+            size_t first = 0;
+            sList* dest = bench_create(mode);
+            for (uint64_t r = 0; r < rounds; r++) {
+                if (first + bench_sizes[s] > BENCH_MAX_ELEMENTS) {
+                    list_clear(dest);
+                    first = 0;
+                }
+                sList* src = bench_createFilled(mode, first, bench_sizes[s]);
+                first += bench_sizes[s];
+                uint64_t start = bench_now();
+                list_cat(dest, src);
+                ns += bench_now() - start;
+            }
+            bench_report(name, 1, rounds, ns);
+            list_destroy(dest);
+        }
+    }
+}
+
+
+/*--------------------------- Several threads ---------------------------*/
+
+#define BENCH_MAX_THREADS   64
+
+typedef struct {
+    sList* list;
+    uint64_t perThread;
+    unsigned producers;         /* bench_queueMpsc() only. */
+} sBenchShared;
+
+/* Each thread pushes its own element and pops whatever comes first. */
+static uint64_t bench_queue(void* arg, unsigned id)
+{
+    sBenchShared* b = (sBenchShared*) arg;
+    uint64_t ops = 0;
+
+    for (uint64_t i = 0; i < b->perThread; i++) {
+        list_pushBack(b->list, bench_element(id * b->perThread + i));
+        ops++;
+        if (list_popFront(b->list)) {
+            ops++;
+        }
+    }
+    return ops;
+}
+
+/*
+ * Thread 0 is the single consumer and pops until it has seen every element
+ * the other threads push. Only the pushes are counted.
+ */
+static uint64_t bench_queueMpsc(void* arg, unsigned id)
+{
+    sBenchShared* b = (sBenchShared*) arg;
+
+    if (id == 0) {
+        uint64_t total = b->perThread * b->producers;
+        for (uint64_t popped = 0; popped < total; ) {
+            if (list_popFront(b->list)) {
+                popped++;
+            }
+        }
+        return 0;
+    }
+    for (uint64_t i = 0; i < b->perThread; i++) {
+        list_pushBack(b->list, bench_element(id * b->perThread + i));
+    }
+    return b->perThread;
+}
+
+static void bench_threads(void)
+{
+    static const sBenchMode modes[] = {
+        { "threadsafe",   LIST_THREADSAFE,    LIST_STORAGE_LINKED,   0, 0, 0 },
+        { "rw",           LIST_THREADSAFE_RW, LIST_STORAGE_LINKED,   0, 0, 0 },
+        { "unrolled",     LIST_THREADSAFE,    LIST_STORAGE_UNROLLED, 0, 0, 0 },
+        { "lockfree_mpmc", LIST_LOCKFREE_MPMC, LIST_STORAGE_LINKED,  0, 0, 0 },
+        { "sharded16",    LIST_THREADSAFE,    LIST_STORAGE_LINKED,   0, 0, 16 },
+    };
+    char name[64];
+    unsigned maxThreads = bench_config.quick ? 8 : BENCH_MAX_THREADS;
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (unsigned t = 1; t <= maxThreads; t *= 2) {
+            snprintf(name, sizeof(name), "queue/%s", modes[m].name);
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            sBenchShared b;
+            b.list = bench_create(&modes[m]);
+            b.perThread = bench_scale(1 << 21) / t;
+            bench_run(name, t, bench_queue, &b);
+            list_destroy(b.list);
+        }
+    }
+
+    /* MPSC: one consumer thread and 1 to maxThreads-1 producers. */
+    static const sBenchMode mpsc =
+        { "lockfree_mpsc", LIST_LOCKFREE_MPSC, LIST_STORAGE_LINKED, 0, 0, 0 };
+    for (unsigned t = 2; t <= maxThreads; t *= 2) {
+        snprintf(name, sizeof(name), "queue/%s", mpsc.name);
+        if (!bench_enabled(name)) {
+            continue;
+        }
+        sBenchShared b;
+        b.list = bench_create(&mpsc);
+        b.producers = t - 1;
+        b.perThread = bench_scale(1 << 21) / b.producers;
+        bench_run(name, t, bench_queueMpsc, &b);
+        list_destroy(b.list);
+    }
+}
+
+
+/* A queue between producer and consumer threads, either an sRing or a list. */
+typedef struct {
+    sRing* ring;
+    sList* list;
+    unsigned producers;         /* Threads 0..producers-1, the rest pop. */
+    uint64_t perProducer;
+    uint64_t popped;            /* Elements popped by all consumers. */
+} sBenchPipe;
+
+#define BENCH_RING_CAPACITY 1024
+
+/*
+ * Producers push their elements, retrying while the ring is full, and the
+ * consumers pop until all of them have come through. Waiting threads yield,
+ * so that oversubscribed runs still make progress. Only the pushes are
+ * counted.
+ */
+static uint64_t bench_pipe(void* arg, unsigned id)
+{
+    sBenchPipe* b = (sBenchPipe*) arg;
+
+    if (id < b->producers) {
+        for (uint64_t i = 0; i < b->perProducer; i++) {
+            void* el = bench_element(id * b->perProducer + i);
+            if (b->ring) {
+                while (ring_push(b->ring, el) == RING_FULL) {
+                    sched_yield();
+                }
+            } else {
+                list_pushBack(b->list, el);
+            }
+        }
+        return b->perProducer;
+    }
+    uint64_t total = b->perProducer * b->producers;
+    while (__atomic_load_n(&b->popped, __ATOMIC_RELAXED) < total) {
+        void* el = b->ring ? ring_pop(b->ring) : list_popFront(b->list);
+        if (el) {
+            __atomic_add_fetch(&b->popped, 1, __ATOMIC_RELAXED);
+        } else {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+/*
+ * sRing against sList as a queue: one producer and one consumer, then
+ * as many producers as consumers. The ring is bounded, so its producers
+ * wait for the consumers, where list producers may run ahead.
+ */
+static void bench_ring(void)
+{
+    static const struct {
+        const char* name;
+        int ring;
+        eListThreadAlt threadAlt;
+    } queues[] = {
+        { "ring",          1, LIST_THREADSAFE },
+        { "list",          0, LIST_THREADSAFE },
+        { "list_lockfree", 0, LIST_LOCKFREE_MPMC },
+    };
+    char name[64];
+    unsigned maxThreads = bench_config.quick ? 8 : BENCH_MAX_THREADS;
+
+    for (size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); q++) {
+        for (unsigned t = 2; t <= maxThreads; t *= 2) {
+            int spsc = t == 2;
+            snprintf(name, sizeof(name), "%s/%s", queues[q].name,
+                    spsc ? "spsc" : "mpmc");
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            sBenchPipe b;
+            b.ring = NULL;
+            b.list = NULL;
+            if (queues[q].ring) {
+                b.ring = ring_create(BENCH_RING_CAPACITY, NULL,
+                        spsc ? RING_SPSC : RING_MPMC);
+            } else {
+                sListAttr attr;
+                list_attrInit(&attr);
+                attr.threadAlt = spsc && queues[q].threadAlt ==
+                        LIST_LOCKFREE_MPMC ? LIST_LOCKFREE_MPSC :
+                        queues[q].threadAlt;
+                b.list = list_createAttr(NULL, &attr);
+            }
+            if (!b.ring && !b.list) {
+                fprintf(stderr, "%s: can't create the queue\n", name);
+                exit(1);
+            }
+            b.producers = t / 2;
+            b.perProducer = bench_scale(1 << 22) / b.producers;
+            b.popped = 0;
+            bench_run(name, t, bench_pipe, &b);
+            ring_destroy(b.ring);
+            list_destroy(b.list);
+        }
+    }
+}
+
+typedef struct {
+    sList* list;
+    uint64_t perThread;
+    unsigned readers;
+    unsigned done;              /* Readers finished. */
+} sBenchReaders;
+
+/* Looks up 'el' walking the list without its lock. */
+static void* bench_epochFind(sList* l, void* el)
+{
+    sListEpochGuard guard;
+    void* found = NULL;
+
+    if (list_epochEnter(l, &guard) == 0) {
+        for (sListNode* cur = list_epochFirst(&guard); cur;
+                cur = list_epochNext(&guard, cur)) {
+            if (bench_cmp(cur->data, el) == 0) {
+                found = cur->data;
+                break;
+            }
+        }
+        list_epochExit(&guard);
+    }
+    return found;
+}
+
+/*
+ * Thread 0 keeps moving elements from the front to the back while the other
+ * threads look elements up, with list_find() or, on epoch lists, without
+ * the lock. Only lookups are counted.
+ */
+static uint64_t bench_readers(void* arg, unsigned id)
+{
+    sBenchReaders* b = (sBenchReaders*) arg;
+    uint64_t ops = 0;
+
+    if (id == 0) {
+        while (__atomic_load_n(&b->done, __ATOMIC_ACQUIRE) < b->readers) {
+            list_pushBack(b->list, list_popFront(b->list));
+        }
+        return 0;
+    }
+    for (uint64_t i = 0; i < b->perThread; i++) {
+        void* el = bench_element((i * 7919 + id) % 1024);
+        if (b->list->epoch) {
+            bench_use(bench_epochFind(b->list, el));
+        } else {
+            bench_use(list_find(b->list, el, bench_cmp));
+        }
+        ops++;
+    }
+    __atomic_add_fetch(&b->done, 1, __ATOMIC_RELEASE);
+    return ops;
+}
+
+static void bench_readWrite(void)
+{
+    static const sBenchMode modes[] = {
+        { "threadsafe", LIST_THREADSAFE,    LIST_STORAGE_LINKED, 0, 0, 0 },
+        { "rw",         LIST_THREADSAFE_RW, LIST_STORAGE_LINKED, 0, 0, 0 },
+        { "epoch",      LIST_THREADSAFE,    LIST_STORAGE_LINKED, 0, 1, 0 },
+    };
+    char name[64];
+    unsigned maxReaders = bench_config.quick ? 4 : 16;
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (unsigned r = 1; r <= maxReaders; r *= 2) {
+            snprintf(name, sizeof(name), "readers/%s/1024", modes[m].name);
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            sBenchReaders b;
+            b.list = bench_createFilled(&modes[m], 0, 1024);
+            b.perThread = bench_scale(1 << 15) / r;
+            b.readers = r;
+            b.done = 0;
+            bench_run(name, r + 1, bench_readers, &b);
+            list_destroy(b.list);
+        }
+    }
+}
+
+static int32_t bench_work(void* element, void* param)
+{
+    uint64_t x = (uint64_t) *(long*) element + 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < 16; i++) {
+        x ^= x >> 31;
+        x *= 0xBF58476D1CE4E5B9ULL;
+    }
+    if (x == 0) {
+        __atomic_add_fetch((long*) param, 1, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+/*
+ * list_foreachParallel() over 1M elements with a callback of a few dozen
+ * cycles, on 1, 2, 4, ... threads up to the number of CPUs.
+ */
+static void bench_foreachParallel(void)
+{
+    static const sBenchMode mode =
+        { "threadsafe", LIST_THREADSAFE, LIST_STORAGE_LINKED, 0, 0, 0 };
+    const char* name = "foreach_parallel/threadsafe/1M";
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned maxThreads = cpus > 1 ? (unsigned) cpus : 1;
+
+    if (!bench_enabled(name)) {
+        return;
+    }
+    if (maxThreads > BENCH_MAX_THREADS) {
+        maxThreads = BENCH_MAX_THREADS;
+    }
+    size_t n = bench_scale(BENCH_MAX_ELEMENTS);
+    sList* l = bench_createFilled(&mode, 0, n);
+    for (unsigned t = 1; t <= maxThreads; t *= 2) {
+        sListExecutor* ex = t > 1 ? list_executorCreate(t - 1) : NULL;
+        long zeros = 0;
+        uint64_t start = bench_now();
+        list_foreachParallel(l, bench_work, &zeros, ex, 0);
+        bench_report(name, t, n, bench_now() - start);
+        list_executorDestroy(ex);
+    }
+    list_destroy(l);
+}
+
+
+/*---------------------------- vn::List vs C -----------------------------*/
+
+template <typename Policy>
+static uint64_t bench_vnPushPop(void* arg, unsigned id)
+{
+    uint64_t n = *(uint64_t*) arg;
+    vn::List<long, Policy> list;
+    long value = 0;
+    (void) id;
+
+    for (long i = 0; i < 1024; i++) {
+        list.pushBack(std::move(i));
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        list.popFront(value);
+        list.pushBack(std::move(value));
+    }
+    return n * 2;
+}
+
+template <typename Policy>
+static uint64_t bench_vnForeach(void* arg, unsigned id)
+{
+    uint64_t n = *(uint64_t*) arg;
+    vn::List<long, Policy> list;
+    long sum = 0;
+    (void) id;
+
+    for (long i = 0; i < 65536; i++) {
+        list.pushBack(std::move(i));
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        list.foreach([&sum](long& v) { sum += v; return true; });
+    }
+    bench_use(&sum);
+    return n * 65536;
+}
+
+/*
+ * vn::List<long> stores the values in its nodes, where the C API stores
+ * pointers to them; the C figures are the pushpop and foreach ones above.
+ */
+static void bench_vnList(void)
+{
+    uint64_t pushPops = bench_scale(1 << 24);
+    uint64_t walks = bench_scale(1 << 24) / 65536;
+
+    if (bench_enabled("vn_pushpop/locked/1024")) {
+        bench_run("vn_pushpop/locked/1024", 1,
+                bench_vnPushPop<vn::ListLocked>, &pushPops);
+    }
+    if (bench_enabled("vn_pushpop/unlocked/1024")) {
+        bench_run("vn_pushpop/unlocked/1024", 1,
+                bench_vnPushPop<vn::ListUnlocked>, &pushPops);
+    }
+    if (bench_enabled("vn_foreach/locked/65536")) {
+        bench_run("vn_foreach/locked/65536", 1,
+                bench_vnForeach<vn::ListLocked>, &walks);
+    }
+    if (bench_enabled("vn_foreach/unlocked/65536")) {
+        bench_run("vn_foreach/unlocked/65536", 1,
+                bench_vnForeach<vn::ListUnlocked>, &walks);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    for (long i = 0; i < BENCH_MAX_ELEMENTS; i++) {
+        bench_values[i] = i;
+    }
+    bench_init(argc, argv);
+
+    bench_runSingle("pushpop", bench_pushPop, BENCH_CONSTANT);
+    bench_runSingle("find", bench_find, BENCH_LINEAR);
+    bench_runSingle("exists", bench_exists, BENCH_LINEAR_UNLESS_HASH);
+    bench_runSingle("remove", bench_remove, BENCH_LINEAR_UNLESS_HASH);
+    bench_runSingle("foreach", bench_foreach, BENCH_LINEAR);
+    bench_cat();
+    bench_index();
+    bench_traverse();
+    bench_batches();
+
+    bench_threads();
+    bench_ring();
+    bench_readWrite();
+    bench_foreachParallel();
+
+    bench_vnList();
+    return 0;
+}
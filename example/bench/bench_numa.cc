@@ -0,0 +1,167 @@
+/*-----------------------------------------------------------------------
+ * Traversal of lists placed on a local or a remote NUMA node.
+ *
+ *   bench_numa [filter] [--quick]
+ *
+ * A list of 1M elements is created with each placement policy and sorted
+ * by a random key, so walking it jumps around its slabs and every node is
+ * a cache miss. It is then traversed with list_foreach() by a thread pinned
+ * to each NUMA node in turn:
+ *
+ *   node<a>/run<r>     - LIST_NUMA_NODE on node a, walked from node r
+ *   interleave/run<r>  - LIST_NUMA_INTERLEAVE, walked from node r
+ *   firsttouch/run<r>  - LIST_NUMA_FIRST_TOUCH, filled from node 0
+ *
+ * ns/op is the time per element visited. Without LIST_NUMA, or on a
+ * single-node machine, only the local runs are done.
+ *-----------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "u_list.h"
+
+#ifdef LIST_NUMA
+#include <numa.h>
+#endif
+
+typedef struct {
+    sList* list;
+    int runNode;
+    uint64_t passes;
+} sBenchWalk;
+
+static int bench_nodes(void)
+{
+#ifdef LIST_NUMA
+    if (numa_available() >= 0) {
+        return numa_max_node() + 1;
+    }
+#endif
+    return 1;
+}
+
+static void bench_runOn(int node)
+{
+#ifdef LIST_NUMA
+    if (bench_nodes() > 1) {
+        numa_run_on_node(node);
+    }
+#else
+    (void) node;
+#endif
+}
+
+static int bench_byKey(void* a, void* b)
+{
+    uint64_t x = *(uint64_t*) a;
+    uint64_t y = *(uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+static int32_t bench_sum(void* element, void* param)
+{
+    *(uint64_t*) param += *(uint64_t*) element;
+    return 1;
+}
+
+static uint64_t bench_walk(void* arg, unsigned id)
+{
+    sBenchWalk* w = (sBenchWalk*) arg;
+    uint64_t sum = 0;
+    (void) id;
+
+    bench_runOn(w->runNode);
+    for (uint64_t p = 0; p < w->passes; p++) {
+        list_foreach(w->list, bench_sum, &sum);
+    }
+    bench_use((void*) (uintptr_t) sum);
+    return w->passes * list_size(w->list);
+}
+
+/*
+ * Fills a list placed by 'policy' with the elements of 'keys' in random
+ * order. The filling thread runs on 'fillNode', which decides where
+ * first-touch lists end up.
+ */
+static sList* bench_createPlaced(eListNumaPolicy policy, int node,
+        int fillNode, uint64_t* keys, size_t n)
+{
+    sListAttr attr;
+
+    list_attrInit(&attr);
+    attr.threadAlt = LIST_NOT_THREADSAFE;
+    attr.numaPolicy = policy;
+    attr.numaNode = node;
+    sList* l = list_createAttr(NULL, &attr);
+    if (!l) {
+        fprintf(stderr, "list_createAttr failed for node %d\n", node);
+        exit(1);
+    }
+    bench_runOn(fillNode);
+    for (size_t i = 0; i < n; i++) {
+        list_pushBack(l, &keys[i]);
+    }
+    list_sort(l, bench_byKey);
+    return l;
+}
+
+static void bench_placement(const char* label, eListNumaPolicy policy,
+        int node, uint64_t* keys, size_t n)
+{
+    char name[64];
+    sList* l = NULL;
+
+    for (int run = 0; run < bench_nodes(); run++) {
+        snprintf(name, sizeof(name), "%s/run%d", label, run);
+        if (!bench_enabled(name)) {
+            continue;
+        }
+        if (!l) {
+            l = bench_createPlaced(policy, node, 0, keys, n);
+        }
+        sBenchWalk w;
+        w.list = l;
+        w.runNode = run;
+        w.passes = bench_scale(16);
+        bench_run(name, 1, bench_walk, &w);
+    }
+    list_destroy(l);
+}
+
+
+int main(int argc, char** argv)
+{
+    size_t n;
+    uint64_t rng = 88172645463325252ULL;
+    char label[32];
+
+    bench_init(argc, argv);
+    n = bench_scale(1 << 20);
+    if (bench_nodes() == 1) {
+        printf("# single NUMA node%s, local runs only\n",
+#ifdef LIST_NUMA
+                ""
+#else
+                " (built without LIST_NUMA)"
+#endif
+                );
+    }
+
+    uint64_t* keys = (uint64_t*) malloc(n * sizeof(uint64_t));
+    if (!keys) {
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        keys[i] = rng;
+    }
+    for (int node = 0; node < bench_nodes(); node++) {
+        snprintf(label, sizeof(label), "node%d", node);
+        bench_placement(label, LIST_NUMA_NODE, node, keys, n);
+    }
+    bench_placement("interleave", LIST_NUMA_INTERLEAVE, 0, keys, n);
+    bench_placement("firsttouch", LIST_NUMA_FIRST_TOUCH, 0, keys, n);
+    free(keys);
+    return 0;
+}
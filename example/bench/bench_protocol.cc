@@ -0,0 +1,381 @@
+/*-----------------------------------------------------------------------
+ * FILE_FEED_RESPONSE parsing and FILE_FEED_REQUEST encoding throughput.
+ *
+ *   bench_protocol [filter] [--quick]
+ *
+ * Responses with a chunk of 'size' bytes and a NODE_BUSY extended info
+ * entry are taken apart and their chunk stored into a slice buffer, the
+ * way transport_storeSliceData() would:
+ *
+ *   parse/<size>  - protocol_parseFileFeedResponse(), the chunk is stored
+ *                   straight from the payload
+ *   naive/<size>  - fields decoded with memcpy() and ntohs()/ntohl() into a
+ *                   response struct owning a malloc()ed copy of the chunk,
+ *                   which is then stored and freed
+ *   header/<size> - protocol_parseFileFeedResponse() only, nothing stored
+ *
+ * Requests are encoded with BENCH_IN_FLIGHT of them outstanding, one per
+ * connection, and the oldest is given back for every new one:
+ *
+ *   request/spsc   - protocol_encodeFileFeedRequest() and
+ *                    protocol_encoderRelease() on a RING_SPSC encoder
+ *   request/mpmc   - the same on a RING_MPMC encoder
+ *   request/naive  - a malloc()ed buffer per request, filled with the crid
+ *                    and the htons()/htonl() encoded fields, then freed
+ *
+ * A response tail of five extended info entries, two of them with
+ * unknown ids, is scanned for the busy and no-slice signals:
+ *
+ *   extinfo/registry - protocol_scanExtInfo(), dispatching on the id
+ *                      through the u_extinfo.hpp table
+ *   extinfo/ifchain  - protocol_extInfoNext() and a chain of ifs on the id
+ *
+ * ns/op is the time per response, request or tail.
+ *-----------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "u_protocol.h"
+
+#define BENCH_RESPONSES     64      /* Distinct payloads, cycled through. */
+#define BENCH_SLICE_SIZE    (4 << 20)
+#define BENCH_IN_FLIGHT     32      /* Outstanding requests. */
+
+typedef struct {
+    uint8_t* payloads[BENCH_RESPONSES];
+    int32_t size;
+    uint8_t* slice;
+    uint64_t n;
+} sBenchResponses;
+
+/* What a consumer decoding by hand ends up with. */
+typedef struct {
+    char crid[FILE_FEED_CRID_SIZE + 1];
+    uint16_t sliceId;
+    uint32_t offset;
+    uint32_t chunkSize;
+    uint8_t* chunkData;
+    uint8_t busy;
+} sBenchNaive;
+
+static void bench_putLong(uint8_t* p, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static uint8_t* bench_response(uint32_t chunkSize, uint32_t offset,
+        int32_t* size)
+{
+    *size = FILE_FEED_HEADER_SIZE + chunkSize + EXTENDED_INFO_HEADER_SIZE + 4;
+    uint8_t* p = (uint8_t*) malloc(*size);
+    uint16_t sliceId = htons(7);
+
+    if (!p) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memset(p, 'a', FILE_FEED_CRID_SIZE);
+    memcpy(p + FILE_FEED_CRID_SIZE, &sliceId, 2);
+    bench_putLong(p + FILE_FEED_CRID_SIZE + 2, offset);
+    bench_putLong(p + FILE_FEED_CRID_SIZE + 6, chunkSize);
+    memset(p + FILE_FEED_HEADER_SIZE, 0x5a, chunkSize);
+    uint8_t* ext = p + FILE_FEED_HEADER_SIZE + chunkSize;
+    ext[0] = 1;
+    bench_putLong(ext + 1, 4);
+    bench_putLong(ext + EXTENDED_INFO_HEADER_SIZE, 0);
+    return p;
+}
+
+/* Stands in for transport_storeSliceData(). */
+static void bench_store(sBenchResponses* b, const uint8_t* data,
+        uint32_t offset, uint32_t length)
+{
+    memcpy(b->slice + offset, data, length);
+}
+
+static uint64_t bench_parse(void* arg, unsigned id)
+{
+    sBenchResponses* b = (sBenchResponses*) arg;
+    sFileFeedResponse r;
+    sExtInfo info;
+    uint32_t busy = 0;
+    (void) id;
+
+    for (uint64_t i = 0; i < b->n; i++) {
+        if (protocol_parseFileFeedResponse(b->payloads[i % BENCH_RESPONSES],
+                    b->size, &r) != 0) {
+            exit(1);
+        }
+        while (protocol_extInfoNext(&r.extInfo, &info) > 0) {
+            busy += info.id == 1;
+        }
+        bench_store(b, r.chunkData, r.offset, r.chunkSize);
+    }
+    bench_use(&busy);
+    return b->n;
+}
+
+static uint64_t bench_naive(void* arg, unsigned id)
+{
+    sBenchResponses* b = (sBenchResponses*) arg;
+    sBenchNaive r;
+    uint32_t busy = 0;
+    (void) id;
+
+    for (uint64_t i = 0; i < b->n; i++) {
+        const uint8_t* p = b->payloads[i % BENCH_RESPONSES];
+        const uint8_t* end = p + b->size;
+        uint16_t s;
+        uint32_t l;
+
+        memcpy(r.crid, p, FILE_FEED_CRID_SIZE);
+        r.crid[FILE_FEED_CRID_SIZE] = '\0';
+        p += FILE_FEED_CRID_SIZE;
+        memcpy(&s, p, 2);
+        r.sliceId = ntohs(s);
+        memcpy(&l, p + 2, 4);
+        r.offset = ntohl(l);
+        memcpy(&l, p + 6, 4);
+        r.chunkSize = ntohl(l);
+        p += 10;
+        r.chunkData = (uint8_t*) malloc(r.chunkSize);
+        memcpy(r.chunkData, p, r.chunkSize);
+        p += r.chunkSize;
+        r.busy = 0;
+        while (end - p >= EXTENDED_INFO_HEADER_SIZE) {
+            memcpy(&l, p + 1, 4);
+            r.busy |= p[0] == 1;
+            p += EXTENDED_INFO_HEADER_SIZE + ntohl(l);
+        }
+        busy += r.busy;
+        bench_store(b, r.chunkData, r.offset, r.chunkSize);
+        free(r.chunkData);
+    }
+    bench_use(&busy);
+    return b->n;
+}
+
+static uint64_t bench_header(void* arg, unsigned id)
+{
+    sBenchResponses* b = (sBenchResponses*) arg;
+    sFileFeedResponse r;
+    uint64_t sum = 0;
+    (void) id;
+
+    for (uint64_t i = 0; i < b->n; i++) {
+        if (protocol_parseFileFeedResponse(b->payloads[i % BENCH_RESPONSES],
+                    b->size, &r) != 0) {
+            exit(1);
+        }
+        sum += r.offset + r.chunkSize;
+    }
+    bench_use(&sum);
+    return b->n;
+}
+
+static uint64_t bench_requestPooled(void* arg, unsigned id)
+{
+    sFileFeedEncoder* enc = (sFileFeedEncoder*) arg;
+    uint8_t* inFlight[BENCH_IN_FLIGHT] = { NULL };
+    uint64_t n = bench_scale(1 << 24);
+    (void) id;
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint8_t** slot = &inFlight[i % BENCH_IN_FLIGHT];
+        if (*slot) {
+            protocol_encoderRelease(enc, *slot);
+        }
+        *slot = protocol_encodeFileFeedRequest(enc, 7,
+                (uint32_t) i * MAX_FILE_FEED_CHUNK_SIZE, MAX_FILE_FEED_CHUNK_SIZE);
+        bench_use(*slot);
+    }
+    for (unsigned i = 0; i < BENCH_IN_FLIGHT; i++) {
+        protocol_encoderRelease(enc, inFlight[i]);
+    }
+    return n;
+}
+
+static uint64_t bench_requestNaive(void* arg, unsigned id)
+{
+    const sTransport* transport = (const sTransport*) arg;
+    uint8_t* inFlight[BENCH_IN_FLIGHT] = { NULL };
+    uint64_t n = bench_scale(1 << 24);
+    uint16_t sliceId = htons(7);
+    (void) id;
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint8_t** slot = &inFlight[i % BENCH_IN_FLIGHT];
+        free(*slot);
+        uint8_t* buf = (uint8_t*) malloc(FILE_FEED_REQUEST_SIZE);
+        memcpy(buf, transport->crid_p, FILE_FEED_CRID_SIZE);
+        memcpy(buf + FILE_FEED_CRID_SIZE, &sliceId, 2);
+        bench_putLong(buf + FILE_FEED_CRID_SIZE + 2,
+                (uint32_t) i * MAX_FILE_FEED_CHUNK_SIZE);
+        bench_putLong(buf + FILE_FEED_CRID_SIZE + 6, MAX_FILE_FEED_CHUNK_SIZE);
+        bench_use(buf);
+        *slot = buf;
+    }
+    for (unsigned i = 0; i < BENCH_IN_FLIGHT; i++) {
+        free(inFlight[i]);
+    }
+    return n;
+}
+typedef struct {
+    uint8_t tail[128];
+    int32_t size;
+} sBenchTail;
+
+static void bench_fillTail(sBenchTail* t)
+{
+    static const uint8_t busy[4] = { 0, 0, 0, 1 };
+    uint8_t* p = t->tail;
+    int32_t cap = sizeof(t->tail);
+
+    t->size = 0;
+    t->size += protocol_putExtInfo(p + t->size, cap - t->size,
+            PULL_PROT_EXTENDED_INFO_NODE_BUSY, busy, 4);
+    t->size += protocol_putExtInfo(p + t->size, cap - t->size, 7, busy, 2);
+    t->size += protocol_putMaxChunkOffer(p + t->size, cap - t->size,
+            MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+    t->size += protocol_putExtInfo(p + t->size, cap - t->size, 200, NULL, 0);
+    t->size += protocol_putExtInfo(p + t->size, cap - t->size,
+            FILE_FEED_EXTENDED_INFO_NO_SLICE_AVAILABLE, NULL, 0);
+}
+
+static uint64_t bench_extInfoRegistry(void* arg, unsigned id)
+{
+    sBenchTail* t = (sBenchTail*) arg;
+    uint64_t n = bench_scale(1 << 24);
+    uint32_t signals = 0;
+    sExtInfoSignals s;
+    sFileFeedPeer peer;
+    sExtInfoIter it;
+    (void) id;
+
+    protocol_peerInit(&peer, MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+    it.pos = t->tail;
+    it.end = t->tail + t->size;
+    for (uint64_t i = 0; i < n; i++) {
+        protocol_scanExtInfo(it, &s, &peer);
+        signals += s.nodeBusy + s.noSliceAvailable;
+    }
+    bench_use(&signals);
+    return n;
+}
+
+static uint64_t bench_extInfoIfChain(void* arg, unsigned id)
+{
+    sBenchTail* t = (sBenchTail*) arg;
+    uint64_t n = bench_scale(1 << 24);
+    uint32_t signals = 0;
+    uint32_t maxChunkSize = 0;
+    sExtInfoIter it;
+    sExtInfo info;
+    (void) id;
+
+    for (uint64_t i = 0; i < n; i++) {
+        int busy = 0;
+        int noSlice = 0;
+        it.pos = t->tail;
+        it.end = t->tail + t->size;
+        while (protocol_extInfoNext(&it, &info) > 0) {
+            if (info.id == PULL_PROT_EXTENDED_INFO_NODE_BUSY) {
+                busy = info.size >= 4;
+            } else if (info.id == FILE_FEED_EXTENDED_INFO_NO_SLICE_AVAILABLE) {
+                noSlice = 1;
+            } else if (info.id == FILE_FEED_EXTENDED_INFO_MULTI_RANGE) {
+                bench_use(info.data);
+            } else if (info.id == FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE &&
+                    info.size >= 4) {
+                uint32_t v;
+                memcpy(&v, info.data, 4);
+                maxChunkSize = ntohl(v);
+            }
+        }
+        signals += busy + noSlice;
+    }
+    bench_use(&signals);
+    bench_use(&maxChunkSize);
+    return n;
+}
+
+
+int main(int argc, char** argv)
+{
+    static const uint32_t sizes[] = { 1024, 16384, MAX_FILE_FEED_CHUNK_SIZE };
+    static const struct {
+        const char* name;
+        benchFunc fn;
+    } kinds[] = {
+        { "parse", bench_parse },
+        { "naive", bench_naive },
+        { "header", bench_header },
+    };
+    char name[64];
+    sBenchResponses b;
+
+    bench_init(argc, argv);
+    b.slice = (uint8_t*) malloc(BENCH_SLICE_SIZE);
+    if (!b.slice) {
+        return 1;
+    }
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (unsigned i = 0; i < BENCH_RESPONSES; i++) {
+            uint32_t offset = i * sizes[s] % (BENCH_SLICE_SIZE - sizes[s]);
+            b.payloads[i] = bench_response(sizes[s], offset, &b.size);
+        }
+        for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+            snprintf(name, sizeof(name), "%s/%u", kinds[k].name, sizes[s]);
+            if (!bench_enabled(name)) {
+                continue;
+            }
+            /* Keep the bytes moved per run about the same for all sizes. */
+            b.n = bench_scale((1ULL << 31) / (sizes[s] + 4096));
+            if (k == 2) {
+                b.n = bench_scale(1 << 24);
+            }
+            bench_run(name, 1, kinds[k].fn, &b);
+        }
+        for (unsigned i = 0; i < BENCH_RESPONSES; i++) {
+            free(b.payloads[i]);
+        }
+    }
+    free(b.slice);
+
+    uint8_t crid[FILE_FEED_CRID_SIZE];
+    sTransport transport;
+    memset(crid, 'c', sizeof(crid));
+    transport.crid_p = crid;
+    static const struct {
+        const char* name;
+        eRingThreadAlt threadAlt;
+    } encoders[] = {
+        { "request/spsc", RING_SPSC },
+        { "request/mpmc", RING_MPMC },
+    };
+    for (size_t e = 0; e < sizeof(encoders) / sizeof(encoders[0]); e++) {
+        if (!bench_enabled(encoders[e].name)) {
+            continue;
+        }
+        sFileFeedEncoder* enc = protocol_encoderCreate(&transport,
+                BENCH_IN_FLIGHT, encoders[e].threadAlt);
+        if (!enc) {
+            return 1;
+        }
+        bench_run(encoders[e].name, 1, bench_requestPooled, enc);
+        protocol_encoderDestroy(enc);
+    }
+    if (bench_enabled("request/naive")) {
+        bench_run("request/naive", 1, bench_requestNaive, &transport);
+    }
+
+    sBenchTail tail;
+    bench_fillTail(&tail);
+    if (bench_enabled("extinfo/registry")) {
+        bench_run("extinfo/registry", 1, bench_extInfoRegistry, &tail);
+    }
+    if (bench_enabled("extinfo/ifchain")) {
+        bench_run("extinfo/ifchain", 1, bench_extInfoIfChain, &tail);
+    }
+    return 0;
+}
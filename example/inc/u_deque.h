@@ -0,0 +1,93 @@
+/*-----------------------------------------------------------------------
+ * Work-stealing deque (Chase-Lev). Each worker thread owns one deque: it
+ * pushes and pops its own work at the bottom, like stack_push() and
+ * stack_pop(), without any lock or atomic read-modify-write except when
+ * taking the very last element. Idle workers steal from the top, the oldest
+ * end, like queue_dequeue(), with one compare-and-swap per element. Busy
+ * owners and thieves work at opposite ends, so they rarely touch the same
+ * element.
+ *
+ * The deque grows when the owner pushes into a full one, so pushing never
+ * fails for lack of room as long as memory lasts. Arrays outgrown by the
+ * deque are kept until deque_destroy(), as thieves may still be reading
+ * them. Like sList, only pointers should be stored in the deque, and NULL
+ * can't be stored as it stands for "empty".
+ *
+ * Example - Download workers balancing chunks between them
+ * ====================================================================
+ *   // one deque per worker, created by the worker's owner
+ *   sDeque* own = deque_create(256, free);
+ *   ...
+ *   // worker loop
+ *   for (;;) {
+ *       sChunk* chunk = (sChunk*) deque_pop(own);
+ *       for (unsigned i = 1; !chunk && i < workers; i++) {
+ *           chunk = (sChunk*) deque_steal(deques[(self + i) % workers]);
+ *       }
+ *       if (!chunk) {
+ *           // nothing anywhere, wait for more work
+ *           continue;
+ *       }
+ *       // download the chunk; split new work with deque_push(own, ...)
+ *   }
+ *   ...
+ *   deque_destroy(own);
+ *-----------------------------------------------------------------------*/
+
+#ifndef DEQUE_H_
+#define DEQUE_H_
+
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Type for the deque itself. */
+typedef struct sDequeT sDeque;
+
+/**
+ * Creates a new empty deque with room for at least 'capacity' elements
+ * before it has to grow; the capacity is rounded up to a power of two.
+ * 'destroyFunc' is called on all remaining elements by deque_destroy() and
+ * deque_clear(), see list_create() for details. On failure returns NULL.
+ */
+sDeque* deque_create(size_t capacity, void (*destroyFunc)(void*));
+
+/**
+ * Frees up memory taken up by 'd', calling its destroyFunc on all remaining
+ * elements. No other thread may use the deque any longer. Returns 0 on
+ * success, -1 on failure.
+ */
+int deque_destroy(sDeque* d);
+
+/**
+ * Adds a new element at the bottom of 'd'. Owner only. Returns 0 on
+ * success, -1 on failure or if 'data' is NULL.
+ */
+int deque_push(sDeque* d, void* data);
+
+/**
+ * Removes the bottom element, the one pushed last, and returns it. Owner
+ * only. Returns NULL if the deque is empty, or if 'd' is NULL.
+ */
+void* deque_pop(sDeque* d);
+
+/**
+ * Removes the top element, the oldest one, and returns it. May be called by
+ * any thread at any time. Returns NULL if the deque is empty, or if 'd' is
+ * NULL.
+ */
+void* deque_steal(sDeque* d);
+
+/**
+ * Removes all elements from 'd', cleaning them up with the deque's
+ * destroyFunc. Owner only; thieves may keep stealing meanwhile. Returns 0
+ * on success, -1 on failure.
+ */
+int deque_clear(sDeque* d);
+
+/**
+ * Returns the number of elements in the deque, or 0 if 'd' is NULL. Only
+ * approximate while other threads push, pop and steal.
+ */
+size_t deque_size(sDeque* d);
+
+#endif /* DEQUE_H_ */
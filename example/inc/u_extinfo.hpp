@@ -0,0 +1,237 @@
+/*-----------------------------------------------------------------------
+ * Registry of the extended info ids, for C++ code.
+ *
+ * Every known id has a specialization of vn::ExtInfo<Id> giving the size of
+ * its data, the type its data decodes to, and the handler it is delivered
+ * to. vn::extInfoScan() walks the extended info of a response once and
+ * dispatches every entry through a table of 256 handlers, built at compile
+ * time from the registry for the handler type, so finding the handler is
+ * one indexed load whatever the id. Ids without a specialization have a
+ * NULL slot; they are skipped after that one load.
+ *
+ * Data shorter than the registered size makes the entry malformed and it
+ * isn't decoded. Longer data is decoded from the front, so a later version
+ * may append to an entry without breaking older nodes.
+ *
+ * Handlers derive from vn::ExtInfoHandler, which ignores everything, and
+ * define the on*() functions for the ids they care about. The calls are
+ * resolved at compile time, nothing is virtual.
+ *
+ * Example - Reacting to a busy node
+ * ====================================================================
+ *   struct BusyHandler : vn::ExtInfoHandler {
+ *       bool busy = false;
+ *       void onNodeBusy(uint32_t) { busy = true; }
+ *   };
+ *   ...
+ *   BusyHandler h;
+ *   vn::extInfoScan(response.extInfo, h);
+ *
+ * Adding an id
+ * ====================================================================
+ * Define its number in u_protocol.h, specialize ExtInfo<> for it with
+ * REGISTERED, SIZE, Value, decode() and deliver(), and add the on*()
+ * function it delivers to to ExtInfoHandler.
+ *-----------------------------------------------------------------------*/
+
+#ifndef EXTINFO_HPP_
+#define EXTINFO_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "u_protocol.h"
+
+namespace vn {
+
+inline uint32_t extInfoLong(const uint8_t* p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+           ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+/* Handler ignoring all entries; derive from it and hide what is needed. */
+struct ExtInfoHandler {
+    void onNodeBusy(uint32_t) {}
+    void onNoSliceAvailable() {}
+    void onMultiRange(uint8_t /* version */, uint16_t /* maxRanges */) {}
+    void onMaxChunkSize(uint32_t) {}
+    /* Called for ids which aren't registered. */
+    void onUnknown(const sExtInfo&) {}
+    /* Called for registered ids with less data than their SIZE. */
+    void onMalformed(const sExtInfo&) {}
+};
+
+/* Registry entry of id 'Id'. Ids without a specialization are unknown. */
+template <uint8_t Id>
+struct ExtInfo {
+    static const bool REGISTERED = false;
+};
+
+template <>
+struct ExtInfo<PULL_PROT_EXTENDED_INFO_NODE_BUSY> {
+    static const bool REGISTERED = true;
+    static const uint32_t SIZE = 4;
+    typedef uint32_t Value;
+    static Value decode(const uint8_t* data) { return extInfoLong(data); }
+    template <typename Handler>
+    static void deliver(Handler& h, Value v) { h.onNodeBusy(v); }
+};
+
+template <>
+struct ExtInfo<FILE_FEED_EXTENDED_INFO_NO_SLICE_AVAILABLE> {
+    static const bool REGISTERED = true;
+    static const uint32_t SIZE = 0;
+    struct Value {};
+    static Value decode(const uint8_t*) { return Value(); }
+    template <typename Handler>
+    static void deliver(Handler& h, Value) { h.onNoSliceAvailable(); }
+};
+
+template <>
+struct ExtInfo<FILE_FEED_EXTENDED_INFO_MULTI_RANGE> {
+    static const bool REGISTERED = true;
+    static const uint32_t SIZE = 3;
+    struct Value {
+        uint8_t version;
+        uint16_t maxRanges;
+    };
+    static Value decode(const uint8_t* data)
+    {
+        Value v;
+        v.version = data[0];
+        v.maxRanges = (uint16_t) ((data[1] << 8) | data[2]);
+        return v;
+    }
+    template <typename Handler>
+    static void deliver(Handler& h, Value v) { h.onMultiRange(v.version, v.maxRanges); }
+};
+
+template <>
+struct ExtInfo<FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE> {
+    static const bool REGISTERED = true;
+    static const uint32_t SIZE = 4;
+    typedef uint32_t Value;
+    static Value decode(const uint8_t* data) { return extInfoLong(data); }
+    template <typename Handler>
+    static void deliver(Handler& h, Value v) { h.onMaxChunkSize(v); }
+};
+
+/*
+ * Slot of id 'Id' in the dispatch table for 'Handler': a function checking
+ * the size, decoding and delivering the entry, or NULL if 'Id' is unknown.
+ */
+template <typename Handler, uint8_t Id, bool = ExtInfo<Id>::REGISTERED>
+struct ExtInfoSlot {
+    typedef void (*Fn)(Handler&, const sExtInfo&);
+    static constexpr Fn fn() { return NULL; }
+};
+
+template <typename Handler, uint8_t Id>
+struct ExtInfoSlot<Handler, Id, true> {
+    typedef void (*Fn)(Handler&, const sExtInfo&);
+    static void dispatch(Handler& h, const sExtInfo& info)
+    {
+        if (info.size < ExtInfo<Id>::SIZE) {
+            h.onMalformed(info);
+            return;
+        }
+        ExtInfo<Id>::deliver(h, ExtInfo<Id>::decode(info.data));
+    }
+    static constexpr Fn fn() { return &dispatch; }
+};
+
+template <size_t... I>
+struct ExtInfoIds {};
+
+/* ExtInfoIds<0, 1, ..., N - 1>, halving the depth at every step. */
+template <typename A, typename B>
+struct ExtInfoIdsCat;
+
+template <size_t... A, size_t... B>
+struct ExtInfoIdsCat<ExtInfoIds<A...>, ExtInfoIds<B...> > {
+    typedef ExtInfoIds<A..., (sizeof...(A) + B)...> type;
+};
+
+template <size_t N>
+struct ExtInfoIdsUpTo {
+    typedef typename ExtInfoIdsCat<typename ExtInfoIdsUpTo<N / 2>::type,
+            typename ExtInfoIdsUpTo<N - N / 2>::type>::type type;
+};
+
+template <>
+struct ExtInfoIdsUpTo<0> {
+    typedef ExtInfoIds<> type;
+};
+
+template <>
+struct ExtInfoIdsUpTo<1> {
+    typedef ExtInfoIds<0> type;
+};
+
+template <typename Handler, typename Ids>
+struct ExtInfoTableOf;
+
+template <typename Handler, size_t... I>
+struct ExtInfoTableOf<Handler, ExtInfoIds<I...> > {
+    typedef void (*Fn)(Handler&, const sExtInfo&);
+    static constexpr Fn slots[sizeof...(I)] = {
+        ExtInfoSlot<Handler, (uint8_t) I>::fn()...
+    };
+};
+
+template <typename Handler, size_t... I>
+constexpr typename ExtInfoTableOf<Handler, ExtInfoIds<I...> >::Fn
+        ExtInfoTableOf<Handler, ExtInfoIds<I...> >::slots[sizeof...(I)];
+
+/* The dispatch table for 'Handler', one slot per possible id. */
+template <typename Handler>
+struct ExtInfoTable : ExtInfoTableOf<Handler, ExtInfoIdsUpTo<256>::type> {};
+
+/* Delivers the single entry 'info' to 'h'. */
+template <typename Handler>
+inline void extInfoDispatch(Handler& h, const sExtInfo& info)
+{
+    typename ExtInfoTable<Handler>::Fn fn = ExtInfoTable<Handler>::slots[info.id];
+    if (fn) {
+        fn(h, info);
+    } else {
+        h.onUnknown(info);
+    }
+}
+
+/*
+ * Delivers every entry from 'it' on to 'h', in order. Returns 0 on
+ * success, -1 if the entries don't fit the payload; the ones before the
+ * bad one have been delivered then.
+ */
+template <typename Handler>
+inline int32_t extInfoScan(sExtInfoIter it, Handler& h)
+{
+    sExtInfo info;
+
+    /* protocol_extInfoNext() inlined, the loop is on the hot path. */
+    while (it.pos != it.end) {
+        size_t left = (size_t) (it.end - it.pos);
+        if (left < EXTENDED_INFO_HEADER_SIZE) {
+            return -1;
+        }
+        info.id = it.pos[0];
+        info.size = extInfoLong(it.pos + 1);
+        if (info.size > left - EXTENDED_INFO_HEADER_SIZE) {
+            return -1;
+        }
+        info.data = it.pos + EXTENDED_INFO_HEADER_SIZE;
+        it.pos = info.data + info.size;
+        extInfoDispatch(h, info);
+    }
+    return 0;
+}
+
+static_assert(ExtInfo<PULL_PROT_EXTENDED_INFO_NODE_BUSY>::SIZE == 4,
+        "NODE_BUSY carries a netlong");
+static_assert(!ExtInfo<0>::REGISTERED && !ExtInfo<255>::REGISTERED,
+        "unassigned ids must stay unknown");
+
+} // namespace vn
+
+#endif /* EXTINFO_HPP_ */
@@ -0,0 +1,131 @@
+/*-----------------------------------------------------------------------
+ * Priority queue implemented as a binary heap, for finding the chunk or
+ * slice with the earliest deadline without scanning a list. The element
+ * which compares lowest with the heap's cmpFunc is at the front.
+ *
+ * heap_push() returns a handle to the pushed element. Through it the
+ * element can later be removed, or its position fixed up after the caller
+ * changed its key, both in O(log n). A handle stays valid until its element
+ * leaves the heap.
+ *
+ * Example - Chunks ordered by deadline
+ * ====================================================================
+ *   static int byDeadline(void* a, void* b)
+ *   {
+ *       uint64_t x = ((sChunk*) a)->deadline, y = ((sChunk*) b)->deadline;
+ *       return x < y ? -1 : x > y;
+ *   }
+ *   ...
+ *   sHeap* pending = heap_create(byDeadline, free, LIST_THREADSAFE);
+ *   chunk->handle = heap_push(pending, chunk);
+ *   ...
+ *   // the chunk became urgent
+ *   heap_lock(pending);
+ *   chunk->deadline = now + 10;
+ *   heap_updateLocked(pending, chunk->handle);
+ *   heap_unlock(pending);
+ *   ...
+ *   // next chunk to request
+ *   sChunk* next = (sChunk*) heap_pop(pending);
+ *
+ * Locking follows eListThreadAlt: LIST_THREADSAFE heaps are guarded by a
+ * mutex, LIST_THREADSAFE_RW heaps by a reader-writer lock which heap_peek()
+ * and heap_size() take shared, and LIST_NOT_THREADSAFE heaps not at all.
+ * Lock-free modes are not supported.
+ *-----------------------------------------------------------------------*/
+
+#ifndef HEAP_H_
+#define HEAP_H_
+
+#include "u_list.h"
+
+/* Handle of an element in a heap. */
+typedef struct sHeapNodeT {
+  void* data;                 /* The element. */
+  size_t index;               /* Position in the heap array. */
+} sHeapNode;
+
+/* Slab of nodes, see sHeap::freeNodes. */
+typedef struct sHeapSlabT sHeapSlab;
+
+/* Type for the heap itself. */
+typedef struct {
+  sHeapNode** nodes;          /* The heap array, front at index 0. */
+  size_t size;                /* Number of elements in the heap. */
+  size_t capacity;            /* Length of 'nodes'. */
+  int (*cmpFunc)(void* a, void* b);
+  void (*destroyFunc)(void*); /* Ptr to destructor function. */
+  sHeapNode* freeNodes;       /* Recycled nodes, linked through 'data'. */
+  sHeapSlab* slabs;           /* Slabs the nodes are carved out of. */
+  eListThreadAlt isThreadsafe;
+  pthread_mutex_t mutex;      /* Lock of LIST_THREADSAFE heaps. */
+  pthread_rwlock_t rwlock;    /* Lock of LIST_THREADSAFE_RW heaps. */
+} sHeap;
+
+/**
+ * Creates a new empty heap ordered by 'cmpFunc', which returns a negative
+ * value if 'a' should leave the heap before 'b', 0 if they are equal and a
+ * positive value otherwise. 'destroyFunc' is called on the elements still
+ * in the heap by heap_destroy() and heap_clear(), see list_create(). On
+ * failure, or for lock-free modes, returns NULL.
+ */
+sHeap* heap_create(int (*cmpFunc)(void* a, void* b),
+        void (*destroyFunc)(void*), eListThreadAlt threadAlt);
+
+/**
+ * Frees up memory taken up by 'h', calling destroyFunc on the elements
+ * still in it. Returns 0 on success, -1 on failure.
+ */
+int heap_destroy(sHeap* h);
+
+/**
+ * Adds 'data' to the heap in O(log n). Returns the handle of the element,
+ * or NULL on failure.
+ */
+sHeapNode* heap_push(sHeap* h, void* data);
+
+/**
+ * Removes the front element from 'h' and returns it, in O(log n). Returns
+ * NULL if the heap is empty, or if 'h' is NULL.
+ */
+void* heap_pop(sHeap* h);
+
+/** Retrieves the front element without removing it from the heap. */
+void* heap_peek(sHeap* h);
+
+/**
+ * Removes the element of 'node' from 'h' in O(log n) and returns it. Does
+ * _not_ call destroyFunc. Returns NULL on failure.
+ */
+void* heap_remove(sHeap* h, sHeapNode* node);
+
+/**
+ * Moves the element of 'node' to its place after its key was changed, in
+ * either direction, in O(log n). The key may only change while the heap is
+ * locked, so on thread-safe heaps change it between heap_lock() and
+ * heap_unlock() and call heap_updateLocked() before unlocking. Returns 0 on
+ * success, -1 on failure.
+ */
+int heap_update(sHeap* h, sHeapNode* node);
+int heap_updateLocked(sHeap* h, sHeapNode* node);
+
+/**
+ * Locks 'h' exclusively, so the caller can change the keys of elements in
+ * it. No other heap_* function may be called on 'h' meanwhile, except
+ * heap_updateLocked(). Returns 0 on success, -1 on failure.
+ */
+int heap_lock(sHeap* h);
+
+/** Releases the lock taken by heap_lock(). */
+int heap_unlock(sHeap* h);
+
+/**
+ * Removes all elements from 'h'. Elements are cleaned up using the heap's
+ * destroyFunc if non-NULL. Returns 0 on success, -1 on failure.
+ */
+int heap_clear(sHeap* h);
+
+/** Returns the number of elements in the heap, or 0 if 'h' is NULL. */
+size_t heap_size(sHeap* h);
+
+#endif /* HEAP_H_ */
@@ -0,0 +1,153 @@
+/*-----------------------------------------------------------------------
+ * Intrusive list. Instead of wrapping every element in an sListNode, the
+ * caller embeds an sIListLink in its own object and the list links the
+ * objects together through it. Pushing allocates nothing, removing an
+ * object is O(1) without searching for it, and an object with several
+ * links can be in several lists at the same time.
+ *
+ * The list is told where the link sits in the object when it is created, so
+ * the functions take and return pointers to the objects themselves, like
+ * the list_* functions. Locking works like sList: LIST_THREADSAFE lists are
+ * guarded by a mutex, LIST_THREADSAFE_RW lists by a reader-writer lock and
+ * LIST_NOT_THREADSAFE lists not at all. Lock-free modes are not supported.
+ *
+ * Example - Chunks waiting for a connection and for a timeout at once
+ * ====================================================================
+ *   typedef struct {
+ *       uint32_t offset;
+ *       sIListLink connLink;    // in the connection's pending list
+ *       sIListLink timerLink;   // in the timeout list
+ *   } sChunk;
+ *
+ *   sIList* pending = ilist_create(offsetof(sChunk, connLink), NULL,
+ *                                  LIST_THREADSAFE);
+ *   sIList* timeouts = ilist_create(offsetof(sChunk, timerLink), free,
+ *                                   LIST_THREADSAFE);
+ *   ...
+ *   sChunk* chunk = (sChunk*) calloc(1, sizeof(sChunk));
+ *   ilist_pushBack(pending, chunk);
+ *   ilist_pushBack(timeouts, chunk);
+ *   ...
+ *   // chunk received, O(1) removal from both lists
+ *   ilist_remove(pending, chunk);
+ *   ilist_remove(timeouts, chunk);
+ *   free(chunk);
+ *
+ * Links must be zeroed, or set to ILIST_LINK_INIT, before first use. An
+ * object must stay alive while it is in a list, and a link can only be in
+ * one list at a time.
+ *-----------------------------------------------------------------------*/
+
+#ifndef ILIST_H_
+#define ILIST_H_
+
+#include <stddef.h>
+#include "u_list.h"
+
+/* Link embedded in objects stored in an sIList. */
+typedef struct sIListLinkT {
+  struct sIListLinkT* prev;   /* Previous link in the list. */
+  struct sIListLinkT* next;   /* Next link in the list. */
+  struct sIListT* list;       /* List the link is in, NULL if none. */
+} sIListLink;
+
+#define ILIST_LINK_INIT     { NULL, NULL, NULL }
+
+/* Type for the list itself. */
+typedef struct sIListT {
+  sIListLink* head;           /* Head link. */
+  sIListLink* tail;           /* Tail link. */
+  size_t size;                /* Number of objects in the list. */
+  size_t linkOffset;          /* Offset of the link in the objects. */
+  void (*destroyFunc)(void*); /* Ptr to destructor function. */
+  eListThreadAlt isThreadsafe;
+  pthread_mutex_t mutex;      /* Lock of LIST_THREADSAFE lists. */
+  pthread_rwlock_t rwlock;    /* Lock of LIST_THREADSAFE_RW lists. */
+} sIList;
+
+/* Returns the object containing 'link' in list 'l'. */
+#define ILIST_OBJECT(l, link)   ((void*) ((char*) (link) - (l)->linkOffset))
+
+/**
+ * Creates a new empty intrusive list of objects carrying an sIListLink at
+ * 'linkOffset', usually given with offsetof(). 'destroyFunc' is called on
+ * the objects still in the list by ilist_destroy() and ilist_clear(), see
+ * list_create(). On failure, or for lock-free modes, returns NULL.
+ */
+sIList* ilist_create(size_t linkOffset, void (*destroyFunc)(void*),
+        eListThreadAlt threadAlt);
+
+/**
+ * Frees up memory taken up by 'l', calling destroyFunc on the objects still
+ * in it. Returns 0 on success, -1 on failure.
+ */
+int ilist_destroy(sIList* l);
+
+/**
+ * Adds 'obj' to the front of the list. Returns 0 on success, -1 on failure
+ * or if the object's link is already in a list.
+ */
+int ilist_pushFront(sIList* l, void* obj);
+
+/**
+ * Adds 'obj' to the end of the list. Returns 0 on success, -1 on failure or
+ * if the object's link is already in a list.
+ */
+int ilist_pushBack(sIList* l, void* obj);
+
+/**
+ * Adds 'obj' right before 'next', which must be in 'l'. If next==NULL, the
+ * object is placed at the end of the list. Returns 0 on success, -1 on
+ * failure.
+ */
+int ilist_insert(sIList* l, void* obj, void* next);
+
+/**
+ * Removes the head object from 'l' and returns it. Returns NULL if the list
+ * is empty, or if 'l' is NULL.
+ */
+void* ilist_popFront(sIList* l);
+
+/** Like ilist_popFront(), for the tail object. */
+void* ilist_popBack(sIList* l);
+
+/** Retrieves the front object without removing it from the list. */
+void* ilist_peekFront(sIList* l);
+
+/** Retrieves the back object without removing it from the list. */
+void* ilist_peekBack(sIList* l);
+
+/**
+ * Removes 'obj' from 'l' in O(1). Does _not_ free the object. Returns 0 on
+ * success, -1 on failure or if the object isn't in 'l'.
+ */
+int ilist_remove(sIList* l, void* obj);
+
+/** Returns 1 if 'obj' is in 'l', otherwise 0. O(1) complexity. */
+int ilist_contains(sIList* l, void* obj);
+
+/**
+ * Removes all objects from 'l'. Objects are cleaned up using the list's
+ * destroyFunc if non-NULL. Returns 0 on success, -1 on failure.
+ */
+int ilist_clear(sIList* l);
+
+/** Returns the number of objects in the list, or 0 if 'l' is NULL. */
+size_t ilist_size(sIList* l);
+
+/**
+ * Returns the object after 'obj' in 'l', or the first object if 'obj' is
+ * NULL. Returns NULL at the end of the list. Like walking list->head, this
+ * doesn't lock the list, which must not be modified meanwhile.
+ */
+void* ilist_next(sIList* l, void* obj);
+
+/**
+ * Loops through the objects in 'l' like list_foreach(), holding the lock of
+ * 'l', so the foreach function must not call ilist_* functions on 'l'.
+ * Returns 0 if all objects were visited, -1 on failure or if the foreach
+ * function stopped the loop.
+ */
+int ilist_foreach(sIList* l, foreachFunc foreach, void* param);
+
+#endif /* ILIST_H_ */
@@ -41,6 +41,8 @@
 
 #include <sys/types.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <pthread.h>
 
 /* List node type. */
@@ -50,11 +52,95 @@ typedef struct sListNodeT {
   struct sListNodeT* next;  /* Next node in the list. */
 } sListNode;
 
+/*
+ * Locking mode of a list. LIST_LOCKFREE_MPSC and LIST_LOCKFREE_MPMC turn the
+ * list into a queue without any mutex: only list_pushBack(), list_popFront(),
+ * list_size(), list_stats(), list_clear() and list_destroy() (and the queue_*
+ * aliases) may be used on them, all other calls fail. list_peekFront() is
+ * supported on MPSC lists when called from the consumer. head and tail are not
+ * maintained, so such lists can't be iterated. Concurrent calls to
+ * list_clear() or list_destroy() are not allowed, and list_size() is only
+ * approximate while other threads push and pop. NULL elements can't be
+ * stored in lock-free lists, as list_popFront() returns NULL when empty.
+ */
 typedef enum {
     LIST_THREADSAFE,
     LIST_NOT_THREADSAFE,
+    LIST_LOCKFREE_MPSC,     /* Lock-free, any producers, one consumer. */
+    LIST_LOCKFREE_MPMC,     /* Lock-free, any producers and consumers. */
+    LIST_THREADSAFE_RW,     /* Reader-writer lock, see below. */
 } eListThreadAlt;
 
+/*
+ * LIST_THREADSAFE_RW lists are protected by a reader-writer lock instead of a
+ * mutex, for lists which are read much more often than they are modified.
+ * list_exists(), list_find(), list_foreach(), list_peekFront(),
+ * list_peekBack(), list_size() and list_stats() take the lock shared, so
+ * they run in parallel with each other; all other calls take it exclusive.
+ * Waiting writers are preferred over new readers so that a steady stream of
+ * lookups can't starve them. list_popFrontWait() isn't supported on these
+ * lists.
+ */
+
+/*
+ * Pool of list nodes. Nodes are carved out of slabs and recycled through a
+ * free-list, so that pushing and popping elements on a list which has reached
+ * its steady-state size does not touch the heap. Every list has a private
+ * pool unless it is created with a shared one, see list_createAttr().
+ */
+typedef struct sListPoolT sListPool;
+
+/* State of lock-free lists, see eListThreadAlt. */
+typedef struct sListLockFreeT sListLockFree;
+
+/* Hash index from element pointer to node, see sListAttr::hashIndex. */
+typedef struct sListIndexT sListIndex;
+
+/*
+ * Storage layout of a list. LIST_STORAGE_UNROLLED keeps the element pointers
+ * in arrays of several elements per node (about 9 bytes per element instead
+ * of 24), so that a scan touches a fraction of the cache lines and only
+ * follows a pointer every few dozen elements. The list_* functions work as
+ * usual, except list_insert() and list_removeNode(), which fail as there are
+ * no sListNodes. head and tail stay NULL; iterate with an sListCursor.
+ * Unrolled storage doesn't use a node pool or hash index and is ignored by
+ * lock-free lists.
+ */
+typedef enum {
+    LIST_STORAGE_LINKED,    /* One sListNode per element (default). */
+    LIST_STORAGE_UNROLLED,  /* Arrays of elements per node. */
+} eListStorage;
+
+/*
+ * Where the nodes of a list's private pool are placed on NUMA hosts, for
+ * long-lived lists which are mostly used from one socket. LIST_NUMA_NODE
+ * places the slabs on sListAttr::numaNode (other nodes are only used when it
+ * runs out of memory), so threads on that node traverse the list without
+ * remote memory accesses; LIST_NUMA_INTERLEAVE spreads the
+ * slabs page by page over all nodes, for lists used evenly from everywhere.
+ * The policy only applies to linked storage with a private pool, and needs
+ * a build with LIST_NUMA (libnuma). On single-node hosts, or without
+ * LIST_NUMA, every policy behaves like LIST_NUMA_FIRST_TOUCH.
+ */
+typedef enum {
+    LIST_NUMA_FIRST_TOUCH,  /* Node of the thread which first writes a slab. */
+    LIST_NUMA_NODE,         /* Node sListAttr::numaNode. */
+    LIST_NUMA_INTERLEAVE,   /* Pages spread over all nodes. */
+} eListNumaPolicy;
+
+/* Reader slots and retired nodes, see sListAttr::epochReclaim. */
+typedef struct sListEpochT sListEpoch;
+
+/* Sub-lists of a sharded list, see sListAttr::shards. */
+typedef struct sListShardsT sListShards;
+
+/* Instrumentation counters, see list_getStats(). */
+typedef struct sListInstrT sListInstr;
+
+/* Node of an unrolled list, and its state. */
+typedef struct sListChunkT sListChunk;
+typedef struct sListUnrolledT sListUnrolled;
+
 /* Type for the list itself. */
 typedef struct {
   sListNode* head;            /* Head node. */
@@ -63,8 +149,124 @@ typedef struct {
   void (*destroyFunc)(void*); /* Ptr to destructor function. */
   eListThreadAlt isThreadsafe;            /* 1 if this list is threadsafe 0 if not */
   pthread_mutex_t mutex;      /* Mutex lock to make the list thread safe. */
+  pthread_rwlock_t rwlock;    /* Used instead of 'mutex' by RW lists. */
+  pthread_cond_t nonEmpty;    /* Signalled on push, see list_popFrontWait(). */
+  int waiters;                /* Threads blocked in list_popFrontWait(). */
+  int closed;                 /* Set by list_close(). */
+  sListPool* pool;            /* Pool the nodes of the list are taken from. */
+  sListLockFree* lockfree;    /* Queue state for LIST_LOCKFREE_* lists. */
+  sListIndex* index;          /* Element index, NULL if not enabled. */
+  sListUnrolled* unrolled;    /* Chunks of LIST_STORAGE_UNROLLED lists. */
+  sListEpoch* epoch;          /* Epoch reclamation state, NULL if disabled. */
+  sListShards* shards;        /* Sub-lists of a sharded list, or NULL. */
+  sListInstr* instr;          /* NULL unless built with LIST_INSTRUMENT. */
 } sList;
 
+/* Creation attributes for list_createAttr(). Initialize with list_attrInit(). */
+typedef struct {
+  eListThreadAlt threadAlt;   /* Locking mode, LIST_THREADSAFE by default. */
+  sListPool* pool;            /* Shared node pool, NULL for a private pool.
+                                 Ignored by lock-free lists. */
+  size_t slabSize;            /* Nodes per slab of a private pool, 0 = default. */
+  int hashIndex;              /* 1 to keep a hash index of the elements, which
+                                 makes list_exists() and list_remove() O(1) on
+                                 average. Ignored by lock-free lists. */
+  eListStorage storage;       /* Storage layout, LIST_STORAGE_LINKED default. */
+  int epochReclaim;           /* 1 to allow lock-free readers, see below.
+                                 Linked storage only, ignored otherwise. */
+  unsigned shards;            /* Number of sub-lists, 0 or 1 = not sharded,
+                                 see below. */
+  eListNumaPolicy numaPolicy; /* Node placement of the private pool,
+                                 LIST_NUMA_FIRST_TOUCH by default. */
+  int numaNode;               /* NUMA node for LIST_NUMA_NODE. */
+} sListAttr;
+
+/*
+ * Sharded lists. A list created with sListAttr::shards > 1 is made of that
+ * many internal sub-lists with a lock each, created with the other
+ * attributes (threadAlt must be LIST_THREADSAFE or LIST_THREADSAFE_RW).
+ * Each thread pushes to its own home sub-list, so producers on many cores
+ * don't contend on one mutex, and pops take from the home sub-list first
+ * and steal from the others when it is empty.
+ *
+ * The price is ordering: elements pushed by one thread come out in order,
+ * but there is no order between elements pushed by different threads. These
+ * calls are supported: list_pushFront(), list_pushBack(), list_popFront(),
+ * list_popBack(), list_pushBackN(), list_popFrontN(), list_exists(),
+ * list_find(), list_remove(), list_foreach(), list_size(), list_stats(),
+ * list_close(), list_clear() and list_destroy(), plus the queue and stack
+ * aliases; all other calls fail, list_popFrontWait() included.
+ * list_size() is exact once other threads stop pushing and popping, and
+ * approximate while they do. list_foreach() locks one sub-list at a time,
+ * so it sees each sub-list consistently but not the list as a whole. NULL
+ * elements can't be stored in sharded lists.
+ */
+
+/*
+ * Lock-free reading with epoch-based reclamation. On a linked list created
+ * with sListAttr::epochReclaim, any thread may walk the list without taking
+ * its lock, while other threads keep pushing and removing elements through
+ * the normal list_* calls:
+ *
+ *   sListEpochGuard guard;
+ *   if (list_epochEnter(list, &guard) == 0) {
+ *       for (cur = list_epochFirst(&guard); cur != NULL;
+ *               cur = list_epochNext(&guard, cur)) {
+ *           char* element = (char*) cur->data;
+ *           ...
+ *       }
+ *       list_epochExit(&guard);
+ *   }
+ *
+ * Removed nodes are only reused after every reader which could have seen
+ * them has called list_epochExit(), so a reader never sees a node change
+ * under it. It may or may not see elements added or removed while it walks
+ * the list. Readers must not follow prev pointers, and should not stay
+ * inside for long: nodes removed meanwhile can't be reused until they leave.
+ * Up to 128 readers can be inside at the same time.
+ */
+typedef struct {
+  sList* list;                /* Guarded list. */
+  unsigned slot;              /* Reader slot taken by list_epochEnter(). */
+} sListEpochGuard;
+
+/*
+ * Cursor for iterating over a list regardless of its storage layout. Like
+ * walking list->head, a cursor doesn't lock the list, and the list must not
+ * be modified while the cursor is in use.
+ *
+ * Example - Sum all elements of a list of int*
+ *   sListCursor cur;
+ *   void* const* items;
+ *   size_t n;
+ *   list_cursorInit(&cur, list);
+ *   while ((n = list_cursorNextBlock(&cur, &items)) > 0) {
+ *       for (size_t i = 0; i < n; i++) {
+ *           sum += *(int*) items[i];
+ *       }
+ *   }
+ */
+typedef struct {
+  sList* list;                /* List being iterated. */
+  sListNode* node;            /* Next node, linked storage. */
+  sListChunk* chunk;          /* Next chunk, unrolled storage. */
+  size_t pos;                 /* Next item in 'chunk'. */
+} sListCursor;
+
+/*
+ * Node and pool statistics of a list, see list_stats(). For unrolled lists
+ * the pool figures count chunks, each of which is its own slab.
+ */
+typedef struct {
+  size_t size;                /* Number of elements in the list. */
+  size_t poolSize;            /* Nodes owned by the pool, in use or free. */
+  size_t poolFree;            /* Nodes currently on the pool free-list. */
+  size_t poolHighWater;       /* Max number of pool nodes in use at once. */
+  size_t poolSlabs;           /* Number of slabs allocated by the pool. */
+  size_t retired;             /* Removed nodes not yet reclaimed, see
+                                 sListAttr::epochReclaim. */
+} sListStats;
+
 /** 
  * Creates a new empty list. It should be freed with list_destroy() when no
  * longer needed. On failure returns NULL. 'destroyFunc' is called on all
@@ -83,6 +285,39 @@ typedef struct {
 typedef void (*destroyFunc2)(void*);
 sList* list_create(void (*destroyFunc)(void*));
 
+/** Sets 'attr' to the defaults used by list_create(). */
+void list_attrInit(sListAttr* attr);
+
+/**
+ * Like list_create(), but with the locking mode and node pool taken from
+ * 'attr'. A NULL 'attr' gives the same list as list_create(). On failure
+ * returns NULL.
+ */
+sList* list_createAttr(void (*destroyFunc)(void*), const sListAttr* attr);
+
+/**
+ * Creates a node pool which can be shared between several lists through
+ * sListAttr::pool. 'slabSize' is the number of nodes allocated at a time when
+ * the pool runs dry, 0 selects the default. A shared pool is always protected
+ * by its own mutex, regardless of the locking mode of the lists using it.
+ * Returns NULL on failure.
+ */
+sListPool* list_poolCreate(size_t slabSize);
+
+/**
+ * Frees a pool created with list_poolCreate() together with all its nodes.
+ * Returns 0 on success, -1 on failure or if lists still use the pool.
+ */
+int list_poolDestroy(sListPool* pool);
+
+/**
+ * Fills in 'stats' with the size of 'l' and the state of its node pool. For
+ * a shared pool the pool figures cover all lists using it. Use poolHighWater
+ * to size 'slabSize' so that a list never has to grow its pool. Returns 0 on
+ * success, -1 on failure.
+ */
+int list_stats(sList* l, sListStats* stats);
+
 /**
  * Frees up memory taken up by 'l'. If the list's 'destroyFunc' member is
  * non-NULL, it is called on all data elements before freeing 'l'. Returns 0 on
@@ -91,6 +326,42 @@ sList* list_create(void (*destroyFunc)(void*));
  */
 int list_destroy(sList* l);
 
+/**
+ * Iteration guard. Between list_readBegin() and list_readEnd() the list can't
+ * be modified by other threads, so it is safe to walk head->next or use an
+ * sListCursor. The lock is shared on LIST_THREADSAFE_RW lists and exclusive
+ * on LIST_THREADSAFE lists; other lists aren't locked. No list_* function may
+ * be called on the same list while the guard is held, as the lock isn't
+ * recursive. Returns 0 on success, -1 on failure.
+ *
+ *   if (list_readBegin(list) == 0) {
+ *       for (cur = list->head; cur != NULL; cur = cur->next) {
+ *           ...
+ *       }
+ *       list_readEnd(list);
+ *   }
+ */
+int list_readBegin(sList* l);
+
+/** Ends an iteration guard started with list_readBegin(). */
+int list_readEnd(sList* l);
+
+/**
+ * Starts a lock-free read of 'l', which must have been created with
+ * sListAttr::epochReclaim. Returns 0 on success, -1 on failure or if all
+ * reader slots are in use.
+ */
+int list_epochEnter(sList* l, sListEpochGuard* guard);
+
+/** Ends a read started with list_epochEnter(). */
+void list_epochExit(sListEpochGuard* guard);
+
+/** Returns the first node of the guarded list, or NULL if it is empty. */
+sListNode* list_epochFirst(sListEpochGuard* guard);
+
+/** Returns the node after 'node' in the guarded list, or NULL. */
+sListNode* list_epochNext(sListEpochGuard* guard, sListNode* node);
+
 /**
  * Adds a new element to the front of the list. Returns 0 on success, -1 on
  * failure.
@@ -121,6 +392,47 @@ void* list_popBack(sList* l);
  */
 //void* list_popBack(sList* l);
 
+/**
+ * Adds the 'n' elements of 'items' to the end of the list, in order, locking
+ * the list only once. Either all or none of the elements are added. Returns 0
+ * on success, -1 on failure.
+ */
+int list_pushBackN(sList* l, void** items, size_t n);
+
+/**
+ * Removes up to 'max' elements from the head of 'l' and stores them in 'out',
+ * locking the list only once. Returns the number of elements removed, 0 if
+ * the list is empty or 'l' is NULL.
+ */
+size_t list_popFrontN(sList* l, void** out, size_t max);
+
+/**
+ * Moves all elements of 'l' to the end of 'out', leaving 'l' empty, while
+ * holding the locks of both lists. Nodes are relinked rather than copied when
+ * both lists share a node pool or both are unrolled. The lists must have the
+ * same destroyFunc. Returns the number of elements moved, or -1 on failure.
+ */
+ssize_t list_drain(sList* l, sList* out);
+
+/**
+ * Like list_popFront(), but if 'l' is empty waits up to 'timeoutMs'
+ * milliseconds for an element to be pushed. A negative 'timeoutMs' waits
+ * forever, 0 doesn't wait at all. Waiting threads sleep on a condition
+ * variable, so an idle consumer costs no CPU. Returns NULL on timeout, or
+ * once 'l' is empty after list_close() has been called. Only supported on
+ * LIST_THREADSAFE lists which aren't sharded; on any other list it returns
+ * NULL without popping, whatever the timeout.
+ */
+void* list_popFrontWait(sList* l, int32_t timeoutMs);
+
+/**
+ * Closes 'l' for pushing: all following pushes and inserts fail, and every
+ * thread blocked in list_popFrontWait() is woken up. Elements already in the
+ * list can still be popped. Returns 0 on success, -1 on failure or if 'l' is
+ * a lock-free list.
+ */
+int list_close(sList* l);
+
 /** Retrieves the front element without removing it from the list. */
 void* list_peekFront(sList* l);
 
@@ -136,7 +448,7 @@ int list_clear(sList* l);
 /**
  * Returns 1 on success if 'data' exists in 'l', otherwise returns 0. Pointers,
  * not data, is compared, which might lead to surprising results if not
- * careful.
+ * careful. O(n) complexity, O(1) on average if 'l' has a hash index.
  */
 int list_exists(sList* l, void* data);
 
@@ -154,7 +466,8 @@ void* list_find(sList* l, void* el, int (*cmpFunc)(void* a, void* b));
  * Removes the first element from 'l' matching 'data'. Does _not_ free the
  * sListNode->data pointer, only the sListNode pointer. Returns 0 on success,
  * -1 on failure, or when no element was removed. Note that the comparison is
- * done as pointer equality, it doesn't inspect the actual data.
+ * done as pointer equality, it doesn't inspect the actual data. O(n)
+ * complexity, O(1) on average if 'l' has a hash index.
  */
 int list_remove(sList* l, void* data);
 
@@ -168,19 +481,91 @@ int list_removeNode(sList *l, sListNode *node);
 /** Returns the number of elements in the list, or 0 if 'l' is NULL. */
 size_t list_size(sList* l);
 
+/** Positions 'cur' before the first element of 'l'. */
+void list_cursorInit(sListCursor* cur, sList* l);
+
+/**
+ * Stores the next element of the cursor's list in 'data' and returns 1, or
+ * returns 0 when all elements have been visited.
+ */
+int list_cursorNext(sListCursor* cur, void** data);
+
+/**
+ * Sets 'items' to the next run of elements stored next to each other and
+ * returns their number, or returns 0 when all elements have been visited. A
+ * run is the rest of a node for unrolled lists and a single element for
+ * linked lists. The node after the run is prefetched, so walking an unrolled
+ * list block by block keeps the memory system busy ahead of the loop.
+ */
+size_t list_cursorNextBlock(sListCursor* cur, void* const** items);
+
 /** 
  * Append src to dest. Return the concatenated list, dest, or NULL if dest 
- * or src is NULL or if they don have the same destroyFunc.
+ * or src is NULL or if they don have the same destroyFunc or storage layout.
  * list_cat() does NOT destroy dest. src IS consumed and destroyed.
+ * Relinking takes O(1) when the lists share a pool or src has a private one,
+ * and the two locks are taken in address order, so two threads
+ * concatenating the same lists in opposite directions don't deadlock.
  */
 sList* list_cat(sList* dest, sList* src);
 
+/**
+ * Moves the nodes from 'first' up to, not including, 'last' out of 'src' and
+ * right before the node 'pos' of 'dest'. last==NULL moves everything from
+ * 'first' to the end of src, and pos==NULL appends to dest. 'first' and
+ * 'last' must be nodes of src and 'pos' a node of dest; src and dest may be
+ * the same list as long as 'pos' isn't in the range. The lists must have the
+ * same destroyFunc and be linked lists, not lock-free, unrolled or sharded.
+ *
+ * When both lists share a pool (see sListAttr::pool) the range is relinked,
+ * costing one walk over the moved nodes to count them and no allocation;
+ * the rest of either list isn't touched. Otherwise, or if src has epoch
+ * readers, the elements are moved into new nodes one by one. Both locks are
+ * taken in address order, so concurrent splices and list_cat() calls between
+ * the same lists in opposite directions don't deadlock.
+ *
+ * Returns the number of elements moved, or -1 on failure, if dest is closed
+ * or if 'pos' lies in the range. If moving into new nodes runs out of memory
+ * the elements moved so far stay in dest.
+ */
+ssize_t list_splice(sList* dest, sListNode* pos, sList* src,
+        sListNode* first, sListNode* last);
+
 /**
  * Adds a new element to the list, right before the node "next".
  * If next==NULL, the element will be placed at the end of the list.
  */
 int list_insert(sList *list, void *data, sListNode *next);
 
+/**
+ * Sorts 'l' in place with a stable merge sort, O(n log n) complexity:
+ * elements comparing equal keep their order. 'cmpFunc' has the same
+ * signature as for list_find(), but here it must return a negative value,
+ * zero or a positive value when 'a' is less than, equal to or greater than
+ * 'b', like for qsort(). Linked lists are sorted without allocating memory,
+ * except with sListAttr::epochReclaim: epoch readers may be walking the
+ * list, so the sorted elements are moved into new nodes, published at once,
+ * and the old nodes are retired. Fails on lock-free and sharded lists.
+ * Returns 0 on success, -1 on failure.
+ */
+int list_sort(sList* l, int (*cmpFunc)(void* a, void* b));
+
+/**
+ * Like list_sort(), but lists of at least 16384 elements are sorted by up to
+ * 'threads' threads, 0 meaning one per online CPU. This needs a temporary
+ * array of one pointer per element. The list stays locked until the sort is
+ * done.
+ */
+int list_sortParallel(sList* l, int (*cmpFunc)(void* a, void* b),
+        unsigned threads);
+
+/**
+ * Inserts 'data' into the list 'l', which must be sorted by 'cmpFunc', after
+ * the last element not greater than it, so that 'l' stays sorted. O(n)
+ * complexity. Returns 0 on success, -1 on failure.
+ */
+int list_insertSorted(sList* l, void* data, int (*cmpFunc)(void* a, void* b));
+
 
 typedef int32_t (*foreachFunc)(void *element, void *param);
 
@@ -192,4 +577,134 @@ typedef int32_t (*foreachFunc)(void *element, void *param);
  */
 int list_foreach(sList *list, foreachFunc foreach, void *param);
 
+/*
+ * Pool of worker threads shared by list_foreachParallel() calls, so that
+ * threads aren't started for every call.
+ */
+typedef struct sListExecutorT sListExecutor;
+
+/**
+ * Creates a pool of 'threads' worker threads, 0 meaning one per online CPU.
+ * Returns NULL on failure.
+ */
+sListExecutor* list_executorCreate(unsigned threads);
+
+/**
+ * Stops and joins the workers of 'ex' and frees it. No call may be using the
+ * executor any longer. Returns 0 on success, -1 on failure.
+ */
+int list_executorDestroy(sListExecutor* ex);
+
+/** Returns the number of worker threads of 'ex', or 0 if 'ex' is NULL. */
+unsigned list_executorThreads(sListExecutor* ex);
+
+/**
+ * Like list_foreach(), but the list is cut into ranges of 'grain' elements
+ * which the workers of 'executor' and the calling thread take in turn, so
+ * the foreach function runs on several threads at once and must be thread
+ * safe. A 'grain' of 0 picks one which gives every thread a few ranges.
+ * Without an executor, on sharded lists or when there is only one range,
+ * it simply calls list_foreach().
+ *
+ * Once the foreach function returns something but a true, no new calls are
+ * started and list_foreachParallel() returns -1, but calls already running
+ * on other threads finish, and elements after the one which stopped the
+ * loop may have been visited. The list is locked (shared, on RW lists) for
+ * the whole call. Must not be called from a foreach function running on the
+ * same executor. Returns 0 when all elements were visited, -1 on failure or
+ * if the loop was stopped.
+ */
+int list_foreachParallel(sList *list, foreachFunc foreach, void *param,
+        sListExecutor* executor, size_t grain);
+
+
+/*
+ * Instrumentation. When u_list.cc and friends are built with
+ * -DLIST_INSTRUMENT, every list records how long its lock was waited for and
+ * held, how many operations of each kind ran and how long they took, and the
+ * largest size it reached. All lists are kept in a process-wide registry
+ * which list_dumpStatsJson() writes out, so that hot lists can be found in
+ * production. Without LIST_INSTRUMENT nothing is recorded and the calls
+ * below fail.
+ *
+ * Lock times are only recorded for LIST_THREADSAFE and LIST_THREADSAFE_RW
+ * lists; hold times only for exclusive holders. Each operation is timed from
+ * entry to return, so list_popFrontWait() includes the time spent waiting.
+ */
+typedef enum {
+    LIST_OP_PUSH,           /* Pushes and inserts. */
+    LIST_OP_POP,            /* Pops and drains. */
+    LIST_OP_PEEK,
+    LIST_OP_FIND,           /* list_exists() and list_find(). */
+    LIST_OP_REMOVE,         /* list_remove() and list_removeNode(). */
+    LIST_OP_ITERATE,        /* Foreach loops and sorts. */
+    LIST_OP_OTHER,          /* list_clear(), list_cat() and list_splice(). */
+    LIST_OP_COUNT
+} eListOp;
+
+/* Latency histogram buckets; bucket i counts operations of [2^i, 2^(i+1)) ns. */
+#define LIST_LATENCY_BUCKETS    32
+/* Longest list name kept by list_setName(), including the terminator. */
+#define LIST_NAME_MAX           48
+
+/* Counters of one kind of operation. */
+typedef struct {
+  uint64_t count;
+  uint64_t totalNs;
+  uint64_t latency[LIST_LATENCY_BUCKETS];
+} sListStatsOp;
+
+/* Instrumentation counters of a list, see list_getStats(). */
+typedef struct {
+  uint64_t lockAcquired;      /* Times the lock was taken. */
+  uint64_t lockContended;     /* Times the lock had to be waited for. */
+  uint64_t lockWaitNs;        /* Total time spent waiting for the lock. */
+  uint64_t lockWaitMaxNs;
+  uint64_t lockHoldNs;        /* Total time the lock was held exclusive. */
+  uint64_t lockHoldMaxNs;
+  uint64_t maxSize;           /* Largest size seen after a push. */
+  sListStatsOp ops[LIST_OP_COUNT];
+} sListOpStats;
+
+/**
+ * Names 'l' in the JSON dump, 'name' is copied. Returns 0 on success, -1 on
+ * failure or without LIST_INSTRUMENT.
+ */
+int list_setName(sList* l, const char* name);
+
+/**
+ * Copies the instrumentation counters of 'l' to 'stats'. Returns 0 on
+ * success, -1 on failure or without LIST_INSTRUMENT.
+ */
+int list_getStats(sList* l, sListOpStats* stats);
+
+/**
+ * Writes the counters of every live list to 'out' as one JSON object, with
+ * the 50th and 99th latency percentiles of each operation rounded up to a
+ * power of two nanoseconds. Returns 0 on success, -1 on failure or without
+ * LIST_INSTRUMENT.
+ */
+int list_dumpStatsJson(FILE* out);
+
+
+/*
+ * Queue and stack aliases for the list functions.
+ */
+#define queue_create        list_create
+#define queue_createAttr    list_createAttr
+#define queue_destroy       list_destroy
+#define queue_enqueue       list_pushBack
+#define queue_dequeue       list_popFront
+#define queue_peek          list_peekFront
+#define queue_size          list_size
+#define queue_clear         list_clear
+
+#define stack_create        list_create
+#define stack_destroy       list_destroy
+#define stack_push          list_pushFront
+#define stack_pop           list_popFront
+#define stack_peek          list_peekFront
+#define stack_size          list_size
+#define stack_clear         list_clear
+
 #endif /* LIST_H_ */
@@ -0,0 +1,366 @@
+/*-----------------------------------------------------------------------
+ * Type-safe list for C++ code, the template counterpart of sList.
+ *
+ * vn::List<T, ThreadPolicy> stores each T inside its node instead of behind
+ * a void*, so a list of small structs needs no allocation per element, and
+ * destroys elements by calling ~T() directly instead of through destroyFunc.
+ * Elements are moved or constructed in place, so move-only types can be
+ * stored. Nodes are recycled through a free-list like the sList node pool.
+ * The locking mode is a template parameter: vn::ListLocked guards every
+ * call with a mutex like LIST_THREADSAFE, vn::ListUnlocked compiles the
+ * locking away like LIST_NOT_THREADSAFE.
+ *
+ * Example - Queue of fixed-size requests shared between threads
+ * ====================================================================
+ *   struct Request { uint16_t sliceId; uint32_t offset; };
+ *   vn::List<Request, vn::ListLocked> queue;
+ *   ...
+ *   queue.emplaceBack(Request{sliceId, offset});
+ *   ...
+ *   Request req;
+ *   while (queue.popFront(req)) {
+ *       // handle req
+ *   }
+ *
+ * A list of pointers interoperates with sList: moveTo() and moveFrom()
+ * transfer all elements to or from an sList, using the batch list_* calls.
+ *-----------------------------------------------------------------------*/
+
+#ifndef LIST_HPP_
+#define LIST_HPP_
+
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <stdlib.h>
+#include <pthread.h>
+#include "u_list.h"
+
+namespace vn {
+
+/* Thread policy guarding every call with a mutex. */
+class ListLocked {
+public:
+    ListLocked() { pthread_mutex_init(&mutex_, NULL); }
+    ~ListLocked() { pthread_mutex_destroy(&mutex_); }
+    void lock() { pthread_mutex_lock(&mutex_); }
+    void unlock() { pthread_mutex_unlock(&mutex_); }
+
+private:
+    ListLocked(const ListLocked&);
+    ListLocked& operator=(const ListLocked&);
+
+    pthread_mutex_t mutex_;
+};
+
+/* Thread policy for lists only used by one thread at a time. */
+class ListUnlocked {
+public:
+    void lock() {}
+    void unlock() {}
+};
+
+template <typename T, typename ThreadPolicy = ListLocked>
+class List {
+public:
+    /* Nodes allocated at a time when the free-list runs dry. */
+    static const size_t SLAB_SIZE = 64;
+
+    List() : head_(NULL), tail_(NULL), free_(NULL), slabs_(NULL), size_(0) {}
+
+    ~List()
+    {
+        clearLocked();
+        while (slabs_) {
+            Slab* next = slabs_->next;
+            free(slabs_);
+            slabs_ = next;
+        }
+    }
+
+    /* Adds 'value' to the end of the list. Returns 0 on success, -1 on failure. */
+    int pushBack(T&& value) { return emplaceBack(std::move(value)); }
+
+    /* Adds 'value' to the front of the list. Returns 0 on success, -1 on failure. */
+    int pushFront(T&& value) { return emplaceFront(std::move(value)); }
+
+    /* Constructs a new element from 'args' at the end of the list. */
+    template <typename... Args>
+    int emplaceBack(Args&&... args)
+    {
+        Guard guard(policy_);
+        Node* node = newNode(std::forward<Args>(args)...);
+        if (!node) {
+            return -1;
+        }
+        linkBack(node);
+        return 0;
+    }
+
+    /* Constructs a new element from 'args' at the front of the list. */
+    template <typename... Args>
+    int emplaceFront(Args&&... args)
+    {
+        Guard guard(policy_);
+        Node* node = newNode(std::forward<Args>(args)...);
+        if (!node) {
+            return -1;
+        }
+        node->prev = NULL;
+        node->next = head_;
+        if (head_) {
+            head_->prev = node;
+        } else {
+            tail_ = node;
+        }
+        head_ = node;
+        size_++;
+        return 0;
+    }
+
+    /*
+     * Moves the head element into 'out' and removes it. Returns false if the
+     * list is empty.
+     */
+    bool popFront(T& out)
+    {
+        Guard guard(policy_);
+        if (!head_) {
+            return false;
+        }
+        out = std::move(head_->value);
+        unlink(head_);
+        return true;
+    }
+
+    /* Like popFront(), for the tail element. */
+    bool popBack(T& out)
+    {
+        Guard guard(policy_);
+        if (!tail_) {
+            return false;
+        }
+        out = std::move(tail_->value);
+        unlink(tail_);
+        return true;
+    }
+
+    /*
+     * Removes the first element for which 'pred' returns true. Returns true
+     * if an element was removed.
+     */
+    template <typename Pred>
+    bool removeIf(Pred pred)
+    {
+        Guard guard(policy_);
+        for (Node* cur = head_; cur; cur = cur->next) {
+            if (pred(static_cast<const T&>(cur->value))) {
+                unlink(cur);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Calls 'func' on every element in order while holding the lock. Stops
+     * as soon as 'func' returns false, like list_foreach(). Returns 0 if all
+     * elements were visited, -1 if 'func' stopped the walk.
+     */
+    template <typename Func>
+    int foreach(Func func)
+    {
+        Guard guard(policy_);
+        for (Node* cur = head_; cur; cur = cur->next) {
+            if (!func(cur->value)) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    /* Removes and destroys all elements. */
+    void clear()
+    {
+        Guard guard(policy_);
+        clearLocked();
+    }
+
+    size_t size()
+    {
+        Guard guard(policy_);
+        return size_;
+    }
+
+    bool empty() { return size() == 0; }
+
+    /*
+     * Moves all elements to the end of 'l' in order, leaving this list
+     * empty, with one list_pushBackN() call per SLAB_SIZE elements. Only for
+     * lists of pointers. Returns the number of elements moved; on failure
+     * the rest stays in this list.
+     */
+    size_t moveTo(sList* l)
+    {
+        static_assert(std::is_pointer<T>::value, "moveTo() needs a list of pointers");
+        Guard guard(policy_);
+        void* items[SLAB_SIZE];
+        size_t moved = 0;
+
+        while (head_) {
+            size_t n = 0;
+            for (Node* cur = head_; cur && n < SLAB_SIZE; cur = cur->next) {
+                items[n++] = (void*) cur->value;
+            }
+            if (list_pushBackN(l, items, n) != 0) {
+                break;
+            }
+            for (size_t i = 0; i < n; i++) {
+                unlink(head_);
+            }
+            moved += n;
+        }
+        return moved;
+    }
+
+    /*
+     * Moves all elements of 'l' to the end of this list in order, leaving
+     * 'l' empty. Only for lists of pointers. Returns the number of elements
+     * moved; if out of memory the rest is put back at the end of 'l'.
+     */
+    size_t moveFrom(sList* l)
+    {
+        static_assert(std::is_pointer<T>::value, "moveFrom() needs a list of pointers");
+        Guard guard(policy_);
+        void* items[SLAB_SIZE];
+        size_t moved = 0;
+        size_t n;
+
+        while ((n = list_popFrontN(l, items, SLAB_SIZE)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                Node* node = newNode((T) items[i]);
+                if (!node) {
+                    list_pushBackN(l, &items[i], n - i);
+                    return moved;
+                }
+                linkBack(node);
+                moved++;
+            }
+        }
+        return moved;
+    }
+
+private:
+    struct Node {
+        template <typename... Args>
+        explicit Node(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+        Node* prev;
+        Node* next;
+        T value;
+    };
+
+    /* A slab of nodes, the nodes follow the header in the same allocation. */
+    struct Slab {
+        Slab* next;
+    };
+
+    struct Guard {
+        explicit Guard(ThreadPolicy& policy) : policy_(policy) { policy_.lock(); }
+        ~Guard() { policy_.unlock(); }
+        ThreadPolicy& policy_;
+    };
+
+    /* Size of a node slot, rounded up so that every slot is aligned. */
+    static const size_t NODE_SLOT = (sizeof(Node) + alignof(Node) - 1) /
+                                    alignof(Node) * alignof(Node);
+    static const size_t SLAB_HEADER = (sizeof(Slab) + alignof(Node) - 1) /
+                                      alignof(Node) * alignof(Node);
+
+    List(const List&);
+    List& operator=(const List&);
+
+    bool grow()
+    {
+        void* mem;
+        size_t align = alignof(Node) > sizeof(void*) ? alignof(Node) : sizeof(void*);
+        if (posix_memalign(&mem, align, SLAB_HEADER + SLAB_SIZE * NODE_SLOT) != 0) {
+            return false;
+        }
+        Slab* slab = (Slab*) mem;
+        slab->next = slabs_;
+        slabs_ = slab;
+        char* nodes = (char*) mem + SLAB_HEADER;
+        for (size_t i = 0; i < SLAB_SIZE; i++) {
+            void* slot = nodes + i * NODE_SLOT;
+            *(void**) slot = free_;
+            free_ = slot;
+        }
+        return true;
+    }
+
+    /*
+     * Takes a slot from the free-list and constructs a node in it. Returns
+     * NULL on failure.
+     */
+    template <typename... Args>
+    Node* newNode(Args&&... args)
+    {
+        if (!free_ && !grow()) {
+            return NULL;
+        }
+        void* slot = free_;
+        free_ = *(void**) slot;
+        return new (slot) Node(std::forward<Args>(args)...);
+    }
+
+    void linkBack(Node* node)
+    {
+        node->next = NULL;
+        node->prev = tail_;
+        if (tail_) {
+            tail_->next = node;
+        } else {
+            head_ = node;
+        }
+        tail_ = node;
+        size_++;
+    }
+
+    /* Unlinks and destroys 'node', returning its slot to the free-list. */
+    void unlink(Node* node)
+    {
+        if (node->prev) {
+            node->prev->next = node->next;
+        } else {
+            head_ = node->next;
+        }
+        if (node->next) {
+            node->next->prev = node->prev;
+        } else {
+            tail_ = node->prev;
+        }
+        size_--;
+        node->~Node();
+        *(void**) node = free_;
+        free_ = node;
+    }
+
+    void clearLocked()
+    {
+        while (head_) {
+            unlink(head_);
+        }
+    }
+
+    ThreadPolicy policy_;
+    Node* head_;
+    Node* tail_;
+    void* free_;            /* Unused node slots, each holding the next one. */
+    Slab* slabs_;
+    size_t size_;
+};
+
+} // namespace vn
+
+#endif /* LIST_HPP_ */
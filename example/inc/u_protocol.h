@@ -1,6 +1,10 @@
 #ifndef PROTOCOL_H_
 #define PROTOCOL_H_
 
+#include <stdint.h>
+#include "u_fw_interface.h"
+#include "u_ring.h"
+
 /*
 
 FILE_FEED_REQUEST:   <crid><slice_id><offset><chunk_size>
@@ -13,6 +17,18 @@ FILE_FEED_RESPONSE:  <crid><slice_id><offset><chunk_size>*<chunk_data>*<extended
 # FILE_FEED_EXTENDED_INFO_NO_SLICE_AVAILABLE
 # id:        128
 # data size: 0
+#
+# FILE_FEED_EXTENDED_INFO_MULTI_RANGE
+# id:        129
+# data size: 3     <multi_version><max_ranges>
+#
+# FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE
+# id:        130
+# data size: 4     <netlong>
+
+FILE_FEED_MULTI_REQUEST:   <multi_version><crid><slice_id><range_count>*<range>
+
+FILE_FEED_MULTI_RESPONSE:  <multi_version><crid><slice_id><chunk_count>*<chunk>*<extended_info>
 
 
 <crid>:                     136<ascii>
@@ -24,6 +40,12 @@ FILE_FEED_RESPONSE:  <crid><slice_id><offset><chunk_size>*<chunk_data>*<extended
 <extended_info_id>:         <uint8>
 <extended_info_data_size>:  <netlong> 
 <extended_info_data>:       binary data
+<multi_version>:            <uint8>
+<range_count>:              <netshort>
+<range>:                    <offset><chunk_size>
+<chunk_count>:              <netshort>
+<chunk>:                    <offset><chunk_size>*<chunk_data>
+<max_ranges>:               <netshort>
 <netshort>:                 unsigned 16 bit integer in network byte order
 <netlong>:                  unsigned 32 bit integer in network byte order
 
@@ -32,5 +54,450 @@ FILE_FEED_RESPONSE:  <crid><slice_id><offset><chunk_size>*<chunk_data>*<extended
 #define MAX_FILE_FEED_CHUNK_SIZE    51200
 #define FILE_FEED_REQUEST           (uint16_t) 0x4036
 #define FILE_FEED_RESPONSE          (uint16_t) 0x3938
+#define FILE_FEED_MULTI_REQUEST     (uint16_t) 0x4037
+#define FILE_FEED_MULTI_RESPONSE    (uint16_t) 0x3939
+
+#define FILE_FEED_CRID_SIZE         136
+#define FILE_FEED_HEADER_SIZE       (FILE_FEED_CRID_SIZE + 2 + 4 + 4)
+#define FILE_FEED_REQUEST_SIZE      FILE_FEED_HEADER_SIZE
+#define EXTENDED_INFO_HEADER_SIZE   (1 + 4)
+
+#define PULL_PROT_EXTENDED_INFO_NODE_BUSY           1
+#define FILE_FEED_EXTENDED_INFO_NO_SLICE_AVAILABLE  128
+#define FILE_FEED_EXTENDED_INFO_MULTI_RANGE         129
+#define FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE      130
+#define FILE_FEED_MULTI_VERSION                 1
+
+/* Room a server keeps for extended info after the chunk of a response. */
+#define FILE_FEED_EXTENDED_INFO_RESERVE     64
+/* Largest chunk size which can be negotiated, fills a whole payload. */
+#define MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE \
+    (MAX_PAYLOAD_SIZE - FILE_FEED_HEADER_SIZE - FILE_FEED_EXTENDED_INFO_RESERVE)
+#define FILE_FEED_MULTI_HEADER_SIZE (1 + FILE_FEED_CRID_SIZE + 2 + 2)
+#define FILE_FEED_RANGE_SIZE        (4 + 4)
+#define FILE_FEED_MULTI_REQUEST_SIZE(ranges) \
+    (FILE_FEED_MULTI_HEADER_SIZE + (ranges) * FILE_FEED_RANGE_SIZE)
+
+/*-----------------------------------------------------------------------
+ * Parsing FILE_FEED_RESPONSE
+ *
+ * protocol_parseFileFeedResponse() checks that the fields and every
+ * extended info entry fit in the payload, and decodes the numbers. Nothing
+ * is copied: the crid, the chunk data and the extended info are handed out
+ * as pointers into the payload, valid for as long as the message is. The
+ * <chunk_size> of a response is a <netlong>, like in the request.
+ *
+ * Example - Storing a chunk straight from the message
+ * ====================================================================
+ *   static int32_t onResponse(message_h_t msg, connection_h_t conn)
+ *   {
+ *       sFileFeedResponse r;
+ *       sExtInfo info;
+ *
+ *       if (protocol_parseFileFeedResponseMsg(msg, &r) != 0) {
+ *           // drop the connection, CONN_ERROR_PROTOCOL
+ *       }
+ *       while (protocol_extInfoNext(&r.extInfo, &info) > 0) {
+ *           // info.id, info.size bytes at info.data
+ *       }
+ *       transport_storeSliceData(transport, slice, r.chunkData, r.offset,
+ *               r.chunkSize);
+ *       ...
+ *   }
+ *-----------------------------------------------------------------------*/
+
+/* One <extended_info> entry, see protocol_extInfoNext(). */
+typedef struct {
+    uint8_t id;
+    uint32_t size;              /* Bytes of data. */
+    const uint8_t* data;        /* Points into the payload. */
+} sExtInfo;
+
+/* Position in the extended info of a response. */
+typedef struct {
+    const uint8_t* pos;         /* Next entry. */
+    const uint8_t* end;         /* End of the payload. */
+} sExtInfoIter;
+
+/* A parsed FILE_FEED_RESPONSE, pointing into the payload it came from. */
+typedef struct {
+    const uint8_t* crid;        /* FILE_FEED_CRID_SIZE ascii characters,
+                                   not null terminated. */
+    uint16_t sliceId;
+    uint32_t offset;            /* Offset of the chunk in the slice. */
+    uint32_t chunkSize;         /* Bytes at 'chunkData', may be 0. */
+    uint8_t* chunkData;
+    sExtInfoIter extInfo;       /* Extended info following the chunk. */
+} sFileFeedResponse;
+
+/**
+ * Parses the FILE_FEED_RESPONSE payload of 'size' bytes at 'payload' into
+ * 'out'. Returns 0 on success, or -1 if the payload is too short for its
+ * fields, or has bytes left over which aren't complete extended info
+ * entries. 'out' is undefined after a failure.
+ */
+int32_t protocol_parseFileFeedResponse(uint8_t* payload, int32_t size,
+        sFileFeedResponse* out);
+
+/** Parses the payload of the FILE_FEED_RESPONSE message 'msg'. */
+static inline int32_t protocol_parseFileFeedResponseMsg(message_h_t msg,
+        sFileFeedResponse* out)
+{
+    if (vn_fw_message_getType(msg) != FILE_FEED_RESPONSE) {
+        return -1;
+    }
+    return protocol_parseFileFeedResponse(vn_fw_message_getPayload(msg),
+            vn_fw_message_getPayloadSize(msg), out);
+}
+
+/**
+ * Reads the next extended info entry of 'it' into 'info'. Returns 1 if
+ * there was one, 0 at the end of the payload, or -1 if the rest of it is
+ * malformed, which can't happen with the iterator of a parsed response.
+ */
+int32_t protocol_extInfoNext(sExtInfoIter* it, sExtInfo* info);
+
+/**
+ * Writes an extended info entry with 'size' bytes of 'data' to 'buf', which
+ * has room for 'cap' bytes, for appending to a response. Returns the number
+ * of bytes written, or -1 if they don't fit.
+ */
+int32_t protocol_putExtInfo(uint8_t* buf, int32_t cap, uint8_t id,
+        const void* data, uint32_t size);
+
+/*-----------------------------------------------------------------------
+ * Encoding FILE_FEED_REQUEST
+ *
+ * An sFileFeedEncoder belongs to one sTransport and keeps a pool of
+ * FILE_FEED_REQUEST_SIZE byte buffers which already hold its crid. Encoding
+ * a request takes a buffer from the pool and writes the slice id, offset
+ * and chunk size into it; nothing is allocated while the pool lasts. The
+ * buffer is handed to vn_fw_message_create() and must stay untouched until
+ * the message is done with, so give it back from the response or error
+ * handler.
+ *
+ * Example - Requesting a chunk
+ * ====================================================================
+ *   sFileFeedEncoder* enc = protocol_encoderCreate(transport, 32, RING_SPSC);
+ *   ...
+ *   uint8_t* buf = protocol_encodeFileFeedRequest(enc, slice->sliceId,
+ *           offset, chunkSize);
+ *   message_h_t msg = vn_fw_message_create(FILE_FEED_REQUEST,
+ *           FILE_FEED_REQUEST_SIZE, buf, onResponse, onError);
+ *   vn_fw_connection_sendMessage(conn, msg);
+ *   ...
+ *   // in onResponse() and onError()
+ *   protocol_encoderRelease(enc,
+ *           vn_fw_message_getPayload(vn_fw_message_getRequest(msg)));
+ *-----------------------------------------------------------------------*/
+
+/* Request encoder of one transport. */
+typedef struct {
+    uint8_t* buffers;           /* 'count' preallocated buffers. */
+    size_t count;
+    sRing* free;                /* Buffers of 'buffers' not in use. */
+    uint8_t crid[FILE_FEED_CRID_SIZE];
+} sFileFeedEncoder;
+
+/**
+ * Creates an encoder for the requests of 'transport', with 'buffers'
+ * preallocated request buffers; about the number of connections the
+ * transport downloads from. With RING_SPSC, requests may only be encoded
+ * by one thread and released by one thread, which can be the same one;
+ * RING_MPMC encoders can be used from any thread. Returns NULL on failure.
+ */
+sFileFeedEncoder* protocol_encoderCreate(const sTransport* transport,
+        size_t buffers, eRingThreadAlt threadAlt);
+
+/**
+ * Frees up memory taken up by 'enc'. All buffers must have been released.
+ * Returns 0 on success, -1 on failure.
+ */
+int32_t protocol_encoderDestroy(sFileFeedEncoder* enc);
+
+/**
+ * Encodes a FILE_FEED_REQUEST for 'chunkSize' bytes at 'offset' of slice
+ * 'sliceId' into a buffer of FILE_FEED_REQUEST_SIZE bytes, and returns it.
+ * When all preallocated buffers are in use a new one is allocated, which
+ * protocol_encoderRelease() frees again. Returns NULL on failure.
+ */
+uint8_t* protocol_encodeFileFeedRequest(sFileFeedEncoder* enc,
+        uint16_t sliceId, uint32_t offset, uint32_t chunkSize);
+
+/**
+ * Gives 'buf', returned by protocol_encodeFileFeedRequest(), back to 'enc'.
+ * Returns 0 on success, -1 on failure.
+ */
+int32_t protocol_encoderRelease(sFileFeedEncoder* enc, uint8_t* buf);
+
+/*-----------------------------------------------------------------------
+ * Multi-range FILE_FEED
+ *
+ * A FILE_FEED_MULTI_REQUEST asks for a list of ranges of a slice, and the
+ * FILE_FEED_MULTI_RESPONSE carries as many of them as fit in one payload of
+ * MAX_PAYLOAD_SIZE bytes, each chunk with its own offset and size. The
+ * last chunk may be cut short and ranges may be left out; the requester
+ * asks for what is missing in its next request. Fewer round trips are
+ * needed per slice, with still one request at a time per connection.
+ *
+ * Old nodes don't know these messages, so they are only sent once the
+ * peer has offered them. A node which serves them appends a
+ * FILE_FEED_EXTENDED_INFO_MULTI_RANGE entry to its FILE_FEED_RESPONSEs,
+ * holding the highest <multi_version> it speaks and the most ranges it
+ * takes per request; nodes which don't know the id skip it. The requester
+ * then uses the lower of the two versions, sFileFeedPeer::multiVersion, in
+ * its requests, and the server answers in the version of the request. Both
+ * messages start with the version, so a later version can change what
+ * follows it.
+ *
+ * Example - Switching a connection over
+ * ====================================================================
+ *   // requester, for every FILE_FEED_RESPONSE
+ *   while (protocol_extInfoNext(&r.extInfo, &info) > 0) {
+ *       if (protocol_multiRangeAccept(&info, &peer->maxRanges) > 0) {
+ *           peer->multi = 1;
+ *       }
+ *   }
+ *   ...
+ *   // server, answering a FILE_FEED_MULTI_REQUEST
+ *   sFileFeedMultiBuilder b;
+ *   protocol_multiResponseInit(&b, buf, MAX_PAYLOAD_SIZE, req.version,
+ *           req.crid, req.sliceId);
+ *   for (uint16_t i = 0; i < req.rangeCount; i++) {
+ *       protocol_multiRequestRange(&req, i, &range);
+ *       uint32_t size = protocol_multiResponseRoom(&b);
+ *       if (size > range.size) {
+ *           size = range.size;
+ *       }
+ *       uint8_t* data = protocol_multiResponseAddChunk(&b, range.offset,
+ *               size);
+ *       // read 'size' bytes of the slice at range.offset into 'data'
+ *   }
+ *   msg = vn_fw_message_create(FILE_FEED_MULTI_RESPONSE, b.size, buf, ...);
+ *-----------------------------------------------------------------------*/
+
+/* A range of a slice. */
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} sFileFeedRange;
+
+/* A parsed FILE_FEED_MULTI_REQUEST, pointing into its payload. */
+typedef struct {
+    uint8_t version;
+    const uint8_t* crid;        /* FILE_FEED_CRID_SIZE ascii characters. */
+    uint16_t sliceId;
+    uint16_t rangeCount;
+    const uint8_t* ranges;      /* Encoded ranges, see
+                                   protocol_multiRequestRange(). */
+} sFileFeedMultiRequest;
+
+/* One chunk of a multi-range response, see protocol_chunkNext(). */
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+    uint8_t* data;              /* Points into the payload. */
+} sFileFeedChunk;
+
+/* Position in the chunks of a multi-range response. */
+typedef struct {
+    uint8_t* pos;               /* Next chunk. */
+    uint16_t left;              /* Chunks from 'pos' on. */
+} sFileFeedChunkIter;
+
+/* A parsed FILE_FEED_MULTI_RESPONSE, pointing into its payload. */
+typedef struct {
+    uint8_t version;
+    const uint8_t* crid;        /* FILE_FEED_CRID_SIZE ascii characters. */
+    uint16_t sliceId;
+    uint16_t chunkCount;
+    sFileFeedChunkIter chunks;
+    sExtInfoIter extInfo;       /* Extended info following the chunks. */
+} sFileFeedMultiResponse;
+
+/* Builds a FILE_FEED_MULTI_RESPONSE in a buffer of the caller. */
+typedef struct {
+    uint8_t* buf;
+    int32_t cap;                /* Bytes at 'buf'. */
+    int32_t size;               /* Bytes of payload so far. */
+    uint16_t chunkCount;
+    int hasExtInfo;             /* 1 once extended info was added. */
+} sFileFeedMultiBuilder;
+
+/**
+ * Returns the version of the multi-range messages to use with a peer if
+ * 'info' is its FILE_FEED_EXTENDED_INFO_MULTI_RANGE offer, and stores the
+ * most ranges it takes per request in 'maxRanges'. Returns 0 if 'info' is
+ * something else or the offer can't be used.
+ */
+int32_t protocol_multiRangeAccept(const sExtInfo* info, uint16_t* maxRanges);
+
+/**
+ * Writes the FILE_FEED_EXTENDED_INFO_MULTI_RANGE offer of this node, taking
+ * up to 'maxRanges' ranges per request, to 'buf' of 'cap' bytes. Returns
+ * the number of bytes written, or -1 if they don't fit.
+ */
+int32_t protocol_putMultiRangeOffer(uint8_t* buf, int32_t cap,
+        uint16_t maxRanges);
+
+/**
+ * Encodes a FILE_FEED_MULTI_REQUEST for the 'count' ranges at 'ranges' into
+ * 'buf' of 'cap' bytes; it takes FILE_FEED_MULTI_REQUEST_SIZE(count).
+ * 'version' is the one negotiated with the peer, sFileFeedPeer::multiVersion.
+ * Returns the size of the payload, or -1 on failure or if this node doesn't
+ * speak 'version'.
+ */
+int32_t protocol_encodeFileFeedMultiRequest(uint8_t* buf, int32_t cap,
+        uint8_t version, const uint8_t* crid, uint16_t sliceId,
+        const sFileFeedRange* ranges, uint16_t count);
+
+/**
+ * Parses the FILE_FEED_MULTI_REQUEST payload of 'size' bytes at 'payload'.
+ * Returns 0 on success, -1 if it is malformed or of an unknown version.
+ */
+int32_t protocol_parseFileFeedMultiRequest(uint8_t* payload, int32_t size,
+        sFileFeedMultiRequest* out);
+
+/**
+ * Reads range 'index' of a parsed request into 'range'. Returns 0 on
+ * success, -1 if there is no such range.
+ */
+int32_t protocol_multiRequestRange(const sFileFeedMultiRequest* req,
+        uint16_t index, sFileFeedRange* range);
+
+/**
+ * Starts a FILE_FEED_MULTI_RESPONSE for slice 'sliceId' in 'buf' of 'cap'
+ * bytes, at most MAX_PAYLOAD_SIZE, in 'version', the one of the request.
+ * Chunks are added with protocol_multiResponseAddChunk(), then any extended
+ * info; 'b->size' is the payload size. Returns 0 on success, -1 if 'cap' is
+ * too small or this node doesn't speak 'version'.
+ */
+int32_t protocol_multiResponseInit(sFileFeedMultiBuilder* b, uint8_t* buf,
+        int32_t cap, uint8_t version, const uint8_t* crid, uint16_t sliceId);
+
+/**
+ * Returns the most bytes of data the next chunk can have, 0 if no more
+ * chunks fit.
+ */
+uint32_t protocol_multiResponseRoom(const sFileFeedMultiBuilder* b);
+
+/**
+ * Adds a chunk of 'size' bytes at 'offset' of the slice to the response,
+ * and returns where its data goes, so it can be read straight into the
+ * payload. Returns NULL if the chunk doesn't fit, or extended info was
+ * already added.
+ */
+uint8_t* protocol_multiResponseAddChunk(sFileFeedMultiBuilder* b,
+        uint32_t offset, uint32_t size);
+
+/**
+ * Appends an extended info entry to the response. Returns 0 on success, -1
+ * if it doesn't fit.
+ */
+int32_t protocol_multiResponseAddExtInfo(sFileFeedMultiBuilder* b,
+        uint8_t id, const void* data, uint32_t size);
+
+/**
+ * Parses the FILE_FEED_MULTI_RESPONSE payload of 'size' bytes at 'payload',
+ * checking that all chunks and extended info fit. Returns 0 on success, -1
+ * if it is malformed or of an unknown version.
+ */
+int32_t protocol_parseFileFeedMultiResponse(uint8_t* payload, int32_t size,
+        sFileFeedMultiResponse* out);
+
+/**
+ * Reads the next chunk of 'it' into 'chunk'. Returns 1 if there was one, 0
+ * at the end. Iterators of a parsed response can't fail otherwise.
+ */
+int32_t protocol_chunkNext(sFileFeedChunkIter* it, sFileFeedChunk* chunk);
+
+/*-----------------------------------------------------------------------
+ * Per-connection negotiation
+ *
+ * Without negotiation <chunk_size> is at most MAX_FILE_FEED_CHUNK_SIZE,
+ * which leaves a fifth of each payload unused. A server which can send
+ * larger chunks appends a FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE entry to
+ * its FILE_FEED_RESPONSEs, holding the largest <chunk_size> it answers, up
+ * to MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE; old requesters skip it. Until a
+ * requester has seen the entry on a connection it stays at the default.
+ *
+ * An sFileFeedPeer keeps what was learned from the responses on one
+ * connection: the chunk size to request and the multi-range offer, see
+ * protocol_multiRangeAccept(). The requester also sets a limit of its own,
+ * for example MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE for peers with a short
+ * round trip time and the default for the others.
+ *
+ * Example - Learning from every response
+ * ====================================================================
+ *   protocol_peerInit(&conn->peer, MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+ *   ...
+ *   while (protocol_extInfoNext(&r.extInfo, &info) > 0) {
+ *       if (protocol_peerLearn(&conn->peer, &info) == 0) {
+ *           // not a negotiation entry, handle it
+ *       }
+ *   }
+ *   ...
+ *   chunkSize = left < conn->peer.maxChunkSize ? left :
+ *           conn->peer.maxChunkSize;
+ *-----------------------------------------------------------------------*/
+
+/* What was negotiated with the peer of a connection. */
+typedef struct {
+    uint32_t maxChunkSize;      /* Largest <chunk_size> to request. */
+    uint32_t localMaxChunkSize; /* Limit set by the requester. */
+    int32_t multiVersion;       /* Multi-range version, 0 = not offered. */
+    uint16_t maxRanges;         /* Ranges per multi-range request. */
+} sFileFeedPeer;
+
+/**
+ * Initializes 'peer' for a new connection, on which chunks of at most
+ * 'localMaxChunkSize' bytes are to be requested once the peer allows it.
+ * The limit is clamped to MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE.
+ */
+void protocol_peerInit(sFileFeedPeer* peer, uint32_t localMaxChunkSize);
+
+/**
+ * Updates 'peer' from an extended info entry of one of its responses.
+ * Returns 1 if 'info' was a negotiation entry, 0 otherwise.
+ */
+int32_t protocol_peerLearn(sFileFeedPeer* peer, const sExtInfo* info);
+
+/**
+ * Writes the FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE entry of a server
+ * answering chunks of up to 'maxChunkSize' bytes to 'buf' of 'cap' bytes.
+ * Returns the number of bytes written, or -1 on failure.
+ */
+int32_t protocol_putMaxChunkOffer(uint8_t* buf, int32_t cap,
+        uint32_t maxChunkSize);
+
+/*-----------------------------------------------------------------------
+ * Scanning extended info
+ *
+ * protocol_scanExtInfo() walks the extended info of a response once and
+ * reports what the scheduler acts on: whether the node is busy, and
+ * whether it has the slice at all. Negotiation entries found on the way
+ * update the connection's sFileFeedPeer. The entries are dispatched on
+ * their id through the table of u_extinfo.hpp, which C++ code can also
+ * use with handlers of its own.
+ *-----------------------------------------------------------------------*/
+
+/* Signals from the extended info of one response. */
+typedef struct {
+    int nodeBusy;               /* 1 if PULL_PROT_EXTENDED_INFO_NODE_BUSY. */
+    uint32_t busyData;          /* Its data, as a netlong. */
+    int noSliceAvailable;       /* 1 if FILE_FEED_EXTENDED_INFO_NO_SLICE_AVAILABLE. */
+    uint32_t unknown;           /* Entries with ids not registered. */
+    uint32_t malformed;         /* Registered ids with too little data. */
+} sExtInfoSignals;
+
+/**
+ * Scans the extended info from 'it' on into 'signals', updating 'peer'
+ * from negotiation entries unless it is NULL. Entries with unknown ids are
+ * skipped and counted, as are entries shorter than their id's size.
+ * Returns 0 on success, -1 if the entries don't fit the payload, which
+ * can't happen for the iterator of a parsed response.
+ */
+int32_t protocol_scanExtInfo(sExtInfoIter it, sExtInfoSignals* signals,
+        sFileFeedPeer* peer);
 
 #endif /*PROTOCOL_H_*/
@@ -0,0 +1,97 @@
+/*-----------------------------------------------------------------------
+ * Bounded queue implemented as a ring buffer with a fixed capacity, for hot
+ * paths with a known maximum depth such as chunk completions and timer
+ * events. Like sList, only pointers should be stored in the ring.
+ *
+ * Nothing is allocated after ring_create(), and pushing and popping never
+ * take a lock. When the ring is full ring_push() returns RING_FULL instead of
+ * growing, so the producer can apply back-pressure.
+ *
+ * Example - Queue completed chunks from an I/O thread to the scheduler
+ * ====================================================================
+ *   sRing* ring = ring_create(256, free, RING_MPMC);
+ *   if (!ring) {
+ *       // report error
+ *   }
+ *   ...
+ *   // producer
+ *   if (ring_push(ring, chunk) == RING_FULL) {
+ *       // slow down, retry later
+ *   }
+ *   ...
+ *   // consumer
+ *   while ((chunk = ring_pop(ring)) != NULL) {
+ *       // handle chunk
+ *   }
+ *   ...
+ *   ring_destroy(ring);
+ *-----------------------------------------------------------------------*/
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Returned by ring_push() when there is no room for the element. */
+#define RING_FULL   1
+
+typedef enum {
+    RING_SPSC,      /* One producer thread and one consumer thread. */
+    RING_MPMC,      /* Any number of producer and consumer threads. */
+} eRingThreadAlt;
+
+/* Type for the ring itself. */
+typedef struct sRingT sRing;
+
+/**
+ * Creates a new empty ring holding at least 'capacity' elements; the
+ * capacity is rounded up to a power of two. 'destroyFunc' is called on all
+ * remaining elements by ring_destroy() and ring_clear(), see list_create()
+ * for details. On failure returns NULL.
+ */
+sRing* ring_create(size_t capacity, void (*destroyFunc)(void*),
+        eRingThreadAlt threadAlt);
+
+/**
+ * Frees up memory taken up by 'r', calling its destroyFunc on all remaining
+ * elements. No other thread may use the ring any longer. Returns 0 on
+ * success, -1 on failure.
+ */
+int ring_destroy(sRing* r);
+
+/**
+ * Adds a new element to the end of the ring. Returns 0 on success, RING_FULL
+ * if the ring is full, -1 on failure.
+ */
+int ring_push(sRing* r, void* data);
+
+/**
+ * Removes the front element from 'r' and returns it. Returns NULL if the ring
+ * is empty, or if 'r' is NULL.
+ */
+void* ring_pop(sRing* r);
+
+/**
+ * Retrieves the front element without removing it from the ring. On an MPMC
+ * ring another consumer may remove the element at any time.
+ */
+void* ring_peek(sRing* r);
+
+/**
+ * Removes all elements from 'r', cleaning them up with the ring's
+ * destroyFunc. Must only be called by a consumer. Returns 0 on success, -1
+ * on failure.
+ */
+int ring_clear(sRing* r);
+
+/**
+ * Returns the number of elements in the ring, or 0 if 'r' is NULL. Only
+ * approximate while other threads push and pop.
+ */
+size_t ring_size(sRing* r);
+
+/** Returns the capacity of the ring, or 0 if 'r' is NULL. */
+size_t ring_capacity(sRing* r);
+
+#endif /* RING_H_ */
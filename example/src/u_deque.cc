@@ -0,0 +1,236 @@
+
+/*-----------------------------------------------------------------------
+ * Chase-Lev work-stealing deque, with the memory ordering of Le et al.,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+ *
+ * 'bottom' is only written by the owner and 'top' only moves forward,
+ * through a CAS by a thief or by the owner taking the last element. Elements
+ * live in a circular array at positions top..bottom-1. The owner's pop
+ * first lowers 'bottom' and then reads 'top', while a thief reads 'top' and
+ * then 'bottom'; those four accesses are sequentially consistent, which is
+ * what the paper's fences provide, so that an owner and a thief can't both
+ * take the last element without one of them going through the CAS.
+ *-----------------------------------------------------------------------*/
+
+#include "u_deque.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define DEQUE_CACHE_LINE 64
+
+typedef struct sDequeArrayT {
+    struct sDequeArrayT* retired;   /* Older, outgrown array. */
+    int64_t mask;                   /* Capacity - 1. */
+    void* slots[];
+} sDequeArray;
+
+struct sDequeT {
+    alignas(DEQUE_CACHE_LINE) int64_t top;      /* Next position to steal. */
+    alignas(DEQUE_CACHE_LINE) int64_t bottom;   /* Next position to push. */
+    sDequeArray* array;
+    void (*destroyFunc)(void*);
+};
+
+static sDequeArray* deque_arrayCreate(int64_t capacity)
+{
+    void* mem;
+
+    if (posix_memalign(&mem, DEQUE_CACHE_LINE,
+                sizeof(sDequeArray) + capacity * sizeof(void*)) != 0) {
+        return NULL;
+    }
+    sDequeArray* a = (sDequeArray*) mem;
+    a->retired = NULL;
+    a->mask = capacity - 1;
+    return a;
+}
+
+static inline void* deque_slotGet(sDequeArray* a, int64_t pos)
+{
+    return __atomic_load_n(&a->slots[pos & a->mask], __ATOMIC_RELAXED);
+}
+
+static inline void deque_slotSet(sDequeArray* a, int64_t pos, void* data)
+{
+    __atomic_store_n(&a->slots[pos & a->mask], data, __ATOMIC_RELAXED);
+}
+
+/*
+ * Replaces the array of 'd' with one twice the size, holding the elements
+ * top..bottom-1. The old array is kept for thieves still reading it.
+ * Owner only.
+ */
+static sDequeArray* deque_grow(sDeque* d, int64_t top, int64_t bottom)
+{
+    sDequeArray* old = d->array;
+    sDequeArray* a = deque_arrayCreate((old->mask + 1) * 2);
+
+    if (!a) {
+        return NULL;
+    }
+    for (int64_t i = top; i < bottom; i++) {
+        deque_slotSet(a, i, deque_slotGet(old, i));
+    }
+    a->retired = old;
+    __atomic_store_n(&d->array, a, __ATOMIC_RELEASE);
+    return a;
+}
+
+
+/**
+ * Creates a new empty deque with room for at least 'capacity' elements
+ * before it has to grow. On failure returns NULL.
+ */
+sDeque* deque_create(size_t capacity, void (*destroyFunc)(void*))
+{
+    int64_t size = 2;
+    void* mem;
+
+    if (capacity == 0 || capacity > (size_t) INT64_MAX / 2 / sizeof(void*)) {
+        return NULL;
+    }
+    while ((size_t) size < capacity) {
+        size <<= 1;
+    }
+    if (posix_memalign(&mem, DEQUE_CACHE_LINE, sizeof(sDeque)) != 0) {
+        return NULL;
+    }
+    sDeque* d = (sDeque*) mem;
+    memset(d, 0, sizeof(sDeque));
+    d->array = deque_arrayCreate(size);
+    if (!d->array) {
+        free(d);
+        return NULL;
+    }
+    d->destroyFunc = destroyFunc;
+    return d;
+}
+
+
+/**
+ * Frees up memory taken up by 'd', calling its destroyFunc on all remaining
+ * elements. Returns 0 on success, -1 on failure.
+ */
+int deque_destroy(sDeque* d)
+{
+    if (!d) {
+        return -1;
+    }
+    deque_clear(d);
+    sDequeArray* a = d->array;
+    while (a) {
+        sDequeArray* retired = a->retired;
+        free(a);
+        a = retired;
+    }
+    free(d);
+    return 0;
+}
+
+
+/** Adds a new element at the bottom of 'd'. Returns 0 on success, -1 on failure. */
+int deque_push(sDeque* d, void* data)
+{
+    if (!d || !data) {
+        return -1;
+    }
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    sDequeArray* a = d->array;
+
+    if (bottom - top > a->mask) {
+        a = deque_grow(d, top, bottom);
+        if (!a) {
+            return -1;
+        }
+    }
+    deque_slotSet(a, bottom, data);
+    __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+/** Removes the bottom element and returns it, NULL if the deque is empty. */
+void* deque_pop(sDeque* d)
+{
+    void* data = NULL;
+
+    if (!d) {
+        return NULL;
+    }
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    sDequeArray* a = d->array;
+    __atomic_store_n(&d->bottom, bottom, __ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+
+    if (top <= bottom) {
+        data = deque_slotGet(a, bottom);
+        if (top == bottom) {
+            /* Last element: race the thieves for it. */
+            if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, false,
+                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                data = NULL;
+            }
+            __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return data;
+}
+
+
+/** Removes the top element and returns it, NULL if the deque is empty. */
+void* deque_steal(sDeque* d)
+{
+    if (!d) {
+        return NULL;
+    }
+    for (;;) {
+        int64_t top = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+        int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+        if (top >= bottom) {
+            return NULL;
+        }
+        sDequeArray* a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+        void* data = deque_slotGet(a, top);
+        if (__atomic_compare_exchange_n(&d->top, &top, top + 1, false,
+                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return data;
+        }
+        /* Another thief or the owner took it; try the next one. */
+    }
+}
+
+
+/**
+ * Removes all elements from 'd', cleaning them up with the deque's
+ * destroyFunc. Returns 0 on success, -1 on failure.
+ */
+int deque_clear(sDeque* d)
+{
+    void* data;
+
+    if (!d) {
+        return -1;
+    }
+    while ((data = deque_pop(d)) != NULL) {
+        if (d->destroyFunc) {
+            d->destroyFunc(data);
+        }
+    }
+    return 0;
+}
+
+
+/** Returns the number of elements in the deque, or 0 if 'd' is NULL. */
+size_t deque_size(sDeque* d)
+{
+    if (!d) {
+        return 0;
+    }
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    return bottom > top ? (size_t) (bottom - top) : 0;
+}
@@ -0,0 +1,386 @@
+
+/*-----------------------------------------------------------------------
+ * Binary min-heap of sHeapNode handles. Every node knows its index in the
+ * heap array, so a handle can be sifted up or down from where it is
+ * without searching for it. Nodes are carved out of slabs and recycled
+ * through a free-list, so pushing onto a heap which has reached its
+ * steady-state size doesn't touch the allocator.
+ *-----------------------------------------------------------------------*/
+
+#include "u_heap.h"
+#include <stdlib.h>
+
+#define HEAP_SLAB_NODES     64
+#define HEAP_MIN_CAPACITY   16
+
+struct sHeapSlabT {
+    struct sHeapSlabT* next;
+    sHeapNode nodes[HEAP_SLAB_NODES];
+};
+
+
+/* Locks 'h' for modification. */
+static void heap_lockExclusive(sHeap* h)
+{
+    if (h->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_lock(&h->mutex);
+    } else if (h->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_wrlock(&h->rwlock);
+    }
+}
+
+/* Locks 'h' for reading only, shared with other readers on RW heaps. */
+static void heap_lockShared(sHeap* h)
+{
+    if (h->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_lock(&h->mutex);
+    } else if (h->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_rdlock(&h->rwlock);
+    }
+}
+
+/* Releases a lock taken with heap_lockExclusive() or heap_lockShared(). */
+static void heap_release(sHeap* h)
+{
+    if (h->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_unlock(&h->mutex);
+    } else if (h->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_unlock(&h->rwlock);
+    }
+}
+
+static sHeapNode* heap_nodeGet(sHeap* h)
+{
+    if (!h->freeNodes) {
+        sHeapSlab* slab = (sHeapSlab*) malloc(sizeof(sHeapSlab));
+        if (!slab) {
+            return NULL;
+        }
+        slab->next = h->slabs;
+        h->slabs = slab;
+        for (size_t i = 0; i < HEAP_SLAB_NODES; i++) {
+            slab->nodes[i].data = h->freeNodes;
+            h->freeNodes = &slab->nodes[i];
+        }
+    }
+    sHeapNode* node = h->freeNodes;
+    h->freeNodes = (sHeapNode*) node->data;
+    return node;
+}
+
+static void heap_nodePut(sHeap* h, sHeapNode* node)
+{
+    node->data = h->freeNodes;
+    node->index = (size_t) -1;
+    h->freeNodes = node;
+}
+
+static inline void heap_place(sHeap* h, sHeapNode* node, size_t index)
+{
+    h->nodes[index] = node;
+    node->index = index;
+}
+
+/* Moves 'node' up from 'index' to its place. Called with 'h' locked. */
+static void heap_siftUp(sHeap* h, sHeapNode* node, size_t index)
+{
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (h->cmpFunc(node->data, h->nodes[parent]->data) >= 0) {
+            break;
+        }
+        heap_place(h, h->nodes[parent], index);
+        index = parent;
+    }
+    heap_place(h, node, index);
+}
+
+/* Moves 'node' down from 'index' to its place. Called with 'h' locked. */
+static void heap_siftDown(sHeap* h, sHeapNode* node, size_t index)
+{
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= h->size) {
+            break;
+        }
+        if (child + 1 < h->size &&
+                h->cmpFunc(h->nodes[child + 1]->data, h->nodes[child]->data) < 0) {
+            child++;
+        }
+        if (h->cmpFunc(h->nodes[child]->data, node->data) >= 0) {
+            break;
+        }
+        heap_place(h, h->nodes[child], index);
+        index = child;
+    }
+    heap_place(h, node, index);
+}
+
+/* Puts 'node' where it belongs, up or down from 'index'. */
+static void heap_fix(sHeap* h, sHeapNode* node, size_t index)
+{
+    if (index > 0 && h->cmpFunc(node->data, h->nodes[(index - 1) / 2]->data) < 0) {
+        heap_siftUp(h, node, index);
+    } else {
+        heap_siftDown(h, node, index);
+    }
+}
+
+/*
+ * Takes the node at 'index' out of the heap and returns its element.
+ * Called with 'h' locked.
+ */
+static void* heap_removeAt(sHeap* h, size_t index)
+{
+    sHeapNode* node = h->nodes[index];
+    void* data = node->data;
+    sHeapNode* last = h->nodes[--h->size];
+
+    if (last != node) {
+        heap_fix(h, last, index);
+    }
+    heap_nodePut(h, node);
+    return data;
+}
+
+/* Returns 1 if 'node' is a handle of an element in 'h'. */
+static inline int heap_owns(sHeap* h, sHeapNode* node)
+{
+    return node->index < h->size && h->nodes[node->index] == node;
+}
+
+
+/**
+ * Creates a new empty heap ordered by 'cmpFunc'. On failure, or for
+ * lock-free modes, returns NULL.
+ */
+sHeap* heap_create(int (*cmpFunc)(void* a, void* b),
+        void (*destroyFunc)(void*), eListThreadAlt threadAlt)
+{
+    int ret = 0;
+
+    if (!cmpFunc || (threadAlt != LIST_THREADSAFE &&
+                threadAlt != LIST_NOT_THREADSAFE &&
+                threadAlt != LIST_THREADSAFE_RW)) {
+        return NULL;
+    }
+    sHeap* h = (sHeap*) calloc(1, sizeof(sHeap));
+    if (!h) {
+        return NULL;
+    }
+    h->nodes = (sHeapNode**) malloc(HEAP_MIN_CAPACITY * sizeof(sHeapNode*));
+    if (!h->nodes) {
+        free(h);
+        return NULL;
+    }
+    h->capacity = HEAP_MIN_CAPACITY;
+    h->cmpFunc = cmpFunc;
+    h->destroyFunc = destroyFunc;
+    h->isThreadsafe = threadAlt;
+    if (threadAlt == LIST_THREADSAFE) {
+        ret = pthread_mutex_init(&h->mutex, NULL);
+    } else if (threadAlt == LIST_THREADSAFE_RW) {
+        ret = pthread_rwlock_init(&h->rwlock, NULL);
+    }
+    if (ret != 0) {
+        free(h->nodes);
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+
+/**
+ * Frees up memory taken up by 'h', calling destroyFunc on the elements
+ * still in it. Returns 0 on success, -1 on failure.
+ */
+int heap_destroy(sHeap* h)
+{
+    if (!h) {
+        return -1;
+    }
+    heap_clear(h);
+    while (h->slabs) {
+        sHeapSlab* next = h->slabs->next;
+        free(h->slabs);
+        h->slabs = next;
+    }
+    if (h->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_destroy(&h->mutex);
+    } else if (h->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_destroy(&h->rwlock);
+    }
+    free(h->nodes);
+    free(h);
+    return 0;
+}
+
+
+/** Adds 'data' to the heap. Returns its handle, or NULL on failure. */
+sHeapNode* heap_push(sHeap* h, void* data)
+{
+    sHeapNode* node = NULL;
+
+    if (!h) {
+        return NULL;
+    }
+    heap_lockExclusive(h);
+    if (h->size == h->capacity) {
+        sHeapNode** nodes = (sHeapNode**) realloc(h->nodes,
+                2 * h->capacity * sizeof(sHeapNode*));
+        if (!nodes) {
+            heap_release(h);
+            return NULL;
+        }
+        h->nodes = nodes;
+        h->capacity *= 2;
+    }
+    node = heap_nodeGet(h);
+    if (node) {
+        node->data = data;
+        h->size++;
+        heap_siftUp(h, node, h->size - 1);
+    }
+    heap_release(h);
+    return node;
+}
+
+
+/** Removes the front element from 'h' and returns it, NULL if it is empty. */
+void* heap_pop(sHeap* h)
+{
+    void* data = NULL;
+
+    if (!h) {
+        return NULL;
+    }
+    heap_lockExclusive(h);
+    if (h->size > 0) {
+        data = heap_removeAt(h, 0);
+    }
+    heap_release(h);
+    return data;
+}
+
+
+/** Retrieves the front element without removing it from the heap. */
+void* heap_peek(sHeap* h)
+{
+    void* data = NULL;
+
+    if (!h) {
+        return NULL;
+    }
+    heap_lockShared(h);
+    if (h->size > 0) {
+        data = h->nodes[0]->data;
+    }
+    heap_release(h);
+    return data;
+}
+
+
+/** Removes the element of 'node' from 'h' and returns it, NULL on failure. */
+void* heap_remove(sHeap* h, sHeapNode* node)
+{
+    void* data = NULL;
+
+    if (!h || !node) {
+        return NULL;
+    }
+    heap_lockExclusive(h);
+    if (heap_owns(h, node)) {
+        data = heap_removeAt(h, node->index);
+    }
+    heap_release(h);
+    return data;
+}
+
+
+/**
+ * Moves the element of 'node' to its place after its key was changed.
+ * Returns 0 on success, -1 on failure.
+ */
+int heap_update(sHeap* h, sHeapNode* node)
+{
+    int ret;
+
+    if (!h || !node) {
+        return -1;
+    }
+    heap_lockExclusive(h);
+    ret = heap_updateLocked(h, node);
+    heap_release(h);
+    return ret;
+}
+
+/** Like heap_update(), with 'h' locked by heap_lock(). */
+int heap_updateLocked(sHeap* h, sHeapNode* node)
+{
+    if (!h || !node || !heap_owns(h, node)) {
+        return -1;
+    }
+    heap_fix(h, node, node->index);
+    return 0;
+}
+
+
+/** Locks 'h' exclusively. Returns 0 on success, -1 on failure. */
+int heap_lock(sHeap* h)
+{
+    if (!h) {
+        return -1;
+    }
+    heap_lockExclusive(h);
+    return 0;
+}
+
+
+/** Releases the lock taken by heap_lock(). */
+int heap_unlock(sHeap* h)
+{
+    if (!h) {
+        return -1;
+    }
+    heap_release(h);
+    return 0;
+}
+
+
+/**
+ * Removes all elements from 'h', cleaning them up with the heap's
+ * destroyFunc if non-NULL.
+ */
+int heap_clear(sHeap* h)
+{
+    if (!h) {
+        return -1;
+    }
+    heap_lockExclusive(h);
+    while (h->size > 0) {
+        sHeapNode* node = h->nodes[--h->size];
+        void* data = node->data;
+        heap_nodePut(h, node);
+        if (h->destroyFunc) {
+            h->destroyFunc(data);
+        }
+    }
+    heap_release(h);
+    return 0;
+}
+
+
+/** Returns the number of elements in the heap, or 0 if 'h' is NULL. */
+size_t heap_size(sHeap* h)
+{
+    size_t size;
+
+    if (!h) {
+        return 0;
+    }
+    heap_lockShared(h);
+    size = h->size;
+    heap_release(h);
+    return size;
+}
@@ -0,0 +1,368 @@
+
+#include "u_ilist.h"
+#include <stdlib.h>
+
+
+/* Locks 'l' for modification. */
+static void ilist_lock(sIList* l)
+{
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_lock(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_wrlock(&l->rwlock);
+    }
+}
+
+/* Locks 'l' for reading only, shared with other readers on RW lists. */
+static void ilist_lockShared(sIList* l)
+{
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_lock(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_rdlock(&l->rwlock);
+    }
+}
+
+/* Releases a lock taken with ilist_lock() or ilist_lockShared(). */
+static void ilist_unlock(sIList* l)
+{
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_unlock(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_unlock(&l->rwlock);
+    }
+}
+
+static inline sIListLink* ilist_link(sIList* l, void* obj)
+{
+    return (sIListLink*) ((char*) obj + l->linkOffset);
+}
+
+/*
+ * Links 'link' into 'l' right before 'next', or at the end if 'next' is
+ * NULL. Called with 'l' locked.
+ */
+static void ilist_linkBefore(sIList* l, sIListLink* link, sIListLink* next)
+{
+    link->next = next;
+    link->prev = next ? next->prev : l->tail;
+    if (link->prev) {
+        link->prev->next = link;
+    } else {
+        l->head = link;
+    }
+    if (next) {
+        next->prev = link;
+    } else {
+        l->tail = link;
+    }
+    link->list = l;
+    l->size++;
+}
+
+/* Unlinks 'link' from 'l'. Called with 'l' locked. */
+static void ilist_unlink(sIList* l, sIListLink* link)
+{
+    if (link->prev) {
+        link->prev->next = link->next;
+    } else {
+        l->head = link->next;
+    }
+    if (link->next) {
+        link->next->prev = link->prev;
+    } else {
+        l->tail = link->prev;
+    }
+    link->prev = link->next = NULL;
+    link->list = NULL;
+    l->size--;
+}
+
+/* Links 'obj' before 'next', taking the lock. */
+static int ilist_add(sIList* l, void* obj, sIListLink* next, int front)
+{
+    if (!l || !obj) {
+        return -1;
+    }
+    sIListLink* link = ilist_link(l, obj);
+    int ret = -1;
+
+    ilist_lock(l);
+    if (!link->list) {
+        ilist_linkBefore(l, link, front ? l->head : next);
+        ret = 0;
+    }
+    ilist_unlock(l);
+    return ret;
+}
+
+
+/**
+ * Creates a new empty intrusive list of objects carrying an sIListLink at
+ * 'linkOffset'. On failure, or for lock-free modes, returns NULL.
+ */
+sIList* ilist_create(size_t linkOffset, void (*destroyFunc)(void*),
+        eListThreadAlt threadAlt)
+{
+    int ret = 0;
+
+    if (threadAlt != LIST_THREADSAFE && threadAlt != LIST_NOT_THREADSAFE &&
+            threadAlt != LIST_THREADSAFE_RW) {
+        return NULL;
+    }
+    sIList* l = (sIList*) calloc(1, sizeof(sIList));
+    if (!l) {
+        return NULL;
+    }
+    l->linkOffset = linkOffset;
+    l->destroyFunc = destroyFunc;
+    l->isThreadsafe = threadAlt;
+    if (threadAlt == LIST_THREADSAFE) {
+        ret = pthread_mutex_init(&l->mutex, NULL);
+    } else if (threadAlt == LIST_THREADSAFE_RW) {
+        ret = pthread_rwlock_init(&l->rwlock, NULL);
+    }
+    if (ret != 0) {
+        free(l);
+        return NULL;
+    }
+    return l;
+}
+
+
+/**
+ * Frees up memory taken up by 'l', calling destroyFunc on the objects still
+ * in it. Returns 0 on success, -1 on failure.
+ */
+int ilist_destroy(sIList* l)
+{
+    if (!l) {
+        return -1;
+    }
+    ilist_clear(l);
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_destroy(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_destroy(&l->rwlock);
+    }
+    free(l);
+    return 0;
+}
+
+
+/** Adds 'obj' to the front of the list. Returns 0 on success, -1 on failure. */
+int ilist_pushFront(sIList* l, void* obj)
+{
+    return ilist_add(l, obj, NULL, 1);
+}
+
+
+/** Adds 'obj' to the end of the list. Returns 0 on success, -1 on failure. */
+int ilist_pushBack(sIList* l, void* obj)
+{
+    return ilist_add(l, obj, NULL, 0);
+}
+
+
+/**
+ * Adds 'obj' right before 'next', which must be in 'l'. If next==NULL, the
+ * object is placed at the end of the list.
+ */
+int ilist_insert(sIList* l, void* obj, void* next)
+{
+    if (!l || !obj) {
+        return -1;
+    }
+    sIListLink* link = ilist_link(l, obj);
+    sIListLink* nextLink = next ? ilist_link(l, next) : NULL;
+    int ret = -1;
+
+    ilist_lock(l);
+    if (!link->list && (!nextLink || nextLink->list == l)) {
+        ilist_linkBefore(l, link, nextLink);
+        ret = 0;
+    }
+    ilist_unlock(l);
+    return ret;
+}
+
+
+/** Removes the head object from 'l' and returns it, NULL if it is empty. */
+void* ilist_popFront(sIList* l)
+{
+    void* obj = NULL;
+
+    if (!l) {
+        return NULL;
+    }
+    ilist_lock(l);
+    if (l->head) {
+        obj = ILIST_OBJECT(l, l->head);
+        ilist_unlink(l, l->head);
+    }
+    ilist_unlock(l);
+    return obj;
+}
+
+
+/** Removes the tail object from 'l' and returns it, NULL if it is empty. */
+void* ilist_popBack(sIList* l)
+{
+    void* obj = NULL;
+
+    if (!l) {
+        return NULL;
+    }
+    ilist_lock(l);
+    if (l->tail) {
+        obj = ILIST_OBJECT(l, l->tail);
+        ilist_unlink(l, l->tail);
+    }
+    ilist_unlock(l);
+    return obj;
+}
+
+
+/** Retrieves the front object without removing it from the list. */
+void* ilist_peekFront(sIList* l)
+{
+    void* obj = NULL;
+
+    if (!l) {
+        return NULL;
+    }
+    ilist_lockShared(l);
+    if (l->head) {
+        obj = ILIST_OBJECT(l, l->head);
+    }
+    ilist_unlock(l);
+    return obj;
+}
+
+
+/** Retrieves the back object without removing it from the list. */
+void* ilist_peekBack(sIList* l)
+{
+    void* obj = NULL;
+
+    if (!l) {
+        return NULL;
+    }
+    ilist_lockShared(l);
+    if (l->tail) {
+        obj = ILIST_OBJECT(l, l->tail);
+    }
+    ilist_unlock(l);
+    return obj;
+}
+
+
+/**
+ * Removes 'obj' from 'l' in O(1). Returns 0 on success, -1 on failure or if
+ * the object isn't in 'l'.
+ */
+int ilist_remove(sIList* l, void* obj)
+{
+    int ret = -1;
+
+    if (!l || !obj) {
+        return -1;
+    }
+    sIListLink* link = ilist_link(l, obj);
+    ilist_lock(l);
+    if (link->list == l) {
+        ilist_unlink(l, link);
+        ret = 0;
+    }
+    ilist_unlock(l);
+    return ret;
+}
+
+
+/** Returns 1 if 'obj' is in 'l', otherwise 0. */
+int ilist_contains(sIList* l, void* obj)
+{
+    int found;
+
+    if (!l || !obj) {
+        return 0;
+    }
+    ilist_lockShared(l);
+    found = ilist_link(l, obj)->list == l;
+    ilist_unlock(l);
+    return found;
+}
+
+
+/**
+ * Removes all objects from 'l', cleaning them up with the list's
+ * destroyFunc if non-NULL.
+ */
+int ilist_clear(sIList* l)
+{
+    if (!l) {
+        return -1;
+    }
+    ilist_lock(l);
+    while (l->head) {
+        void* obj = ILIST_OBJECT(l, l->head);
+        ilist_unlink(l, l->head);
+        if (l->destroyFunc) {
+            l->destroyFunc(obj);
+        }
+    }
+    ilist_unlock(l);
+    return 0;
+}
+
+
+/** Returns the number of objects in the list, or 0 if 'l' is NULL. */
+size_t ilist_size(sIList* l)
+{
+    size_t size;
+
+    if (!l) {
+        return 0;
+    }
+    ilist_lockShared(l);
+    size = l->size;
+    ilist_unlock(l);
+    return size;
+}
+
+
+/**
+ * Returns the object after 'obj' in 'l', or the first object if 'obj' is
+ * NULL. Doesn't lock the list.
+ */
+void* ilist_next(sIList* l, void* obj)
+{
+    if (!l) {
+        return NULL;
+    }
+    sIListLink* next = obj ? ilist_link(l, obj)->next : l->head;
+    return next ? ILIST_OBJECT(l, next) : NULL;
+}
+
+
+/**
+ * Loops through the objects in 'l' and calls the foreach function with each
+ * object and param, stopping when it returns false.
+ */
+int ilist_foreach(sIList* l, foreachFunc foreach, void* param)
+{
+    int ret = 0;
+
+    if (!l || !foreach) {
+        return -1;
+    }
+    ilist_lockShared(l);
+    for (sIListLink* cur = l->head; cur != NULL; cur = cur->next) {
+        if (!foreach(ILIST_OBJECT(l, cur), param)) {
+            ret = -1;
+            break;
+        }
+    }
+    ilist_unlock(l);
+    return ret;
+}
@@ -1,11 +1,585 @@
 
 #include "u_list.h"
+#include "u_list_internal.h"
 #include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
 #include <iostream>
 
+struct sListPoolT {
+    sListNode* freeList;      /* Free nodes, linked through their next ptr. */
+    sListNode* freeTail;      /* Last free node, valid if freeList != NULL. */
+    sListSlab* slabs;         /* All slabs owned by the pool. */
+    sListSlab* slabsTail;     /* Last slab, valid if slabs != NULL. */
+    size_t slabSize;          /* Nodes allocated per slab. */
+    size_t total;             /* Nodes owned by the pool. */
+    size_t inUse;             /* Nodes handed out and not yet returned. */
+    size_t highWater;         /* Max value 'inUse' has had. */
+    int shared;               /* 1 if created by list_poolCreate(). */
+    eListNumaPolicy numaPolicy; /* Placement of new slabs. */
+    int numaNode;             /* Node for LIST_NUMA_NODE. */
+    int users;                /* Number of lists using a shared pool. */
+    pthread_mutex_t mutex;    /* Only used for shared pools. */
+};
+
+
+/* Locks 'l' for modification. */
+static void list_lock(sList* l)
+{
+#ifdef LIST_INSTRUMENT
+    if (l->instr && (l->isThreadsafe == LIST_THREADSAFE ||
+                l->isThreadsafe == LIST_THREADSAFE_RW)) {
+        list_instrLock(l, 0);
+        return;
+    }
+#endif
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_lock(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_wrlock(&l->rwlock);
+    }
+}
+
+/* Locks 'l' for reading only, shared with other readers on RW lists. */
+static void list_lockShared(sList* l)
+{
+#ifdef LIST_INSTRUMENT
+    if (l->instr && (l->isThreadsafe == LIST_THREADSAFE ||
+                l->isThreadsafe == LIST_THREADSAFE_RW)) {
+        list_instrLock(l, 1);
+        return;
+    }
+#endif
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_lock(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_rdlock(&l->rwlock);
+    }
+}
+
+/* Releases a lock taken with list_lock() or list_lockShared(). */
+static void list_unlock(sList* l)
+{
+#ifdef LIST_INSTRUMENT
+    if (l->instr && (l->isThreadsafe == LIST_THREADSAFE ||
+                l->isThreadsafe == LIST_THREADSAFE_RW)) {
+        list_instrHoldEnd(l);
+    }
+#endif
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_mutex_unlock(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_unlock(&l->rwlock);
+    }
+}
+
+static sListPool* pool_init(size_t slabSize, int shared)
+{
+    sListPool* pool = (sListPool*) calloc(1, sizeof(sListPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->slabSize = slabSize ? slabSize : LIST_DEFAULT_SLAB_SIZE;
+    pool->shared = shared;
+    if (shared && pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void pool_free(sListPool* pool)
+{
+    sListSlab* slab = pool->slabs;
+    while (slab) {
+        sListSlab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    if (pool->shared) {
+        pthread_mutex_destroy(&pool->mutex);
+    }
+    free(pool);
+}
+
+/*
+ * Allocates a slab of pool->slabSize nodes, placed according to the NUMA
+ * policy of the pool. Bound slabs take whole pages, filled up with nodes.
+ */
+static sListSlab* pool_allocSlab(sListPool* pool)
+{
+    size_t bytes = sizeof(sListSlab) + pool->slabSize * sizeof(sListNode);
+    sListSlab* slab;
+
+    if (pool->numaPolicy != LIST_NUMA_FIRST_TOUCH && list_numaNodes() > 1) {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        void* mem;
+        bytes = (bytes + page - 1) / page * page;
+        if (posix_memalign(&mem, page, bytes) != 0) {
+            return NULL;
+        }
+        slab = (sListSlab*) mem;
+        if (list_numaBind(slab, bytes, pool->numaPolicy, pool->numaNode) != 0) {
+            free(slab);
+            return NULL;
+        }
+    } else {
+        slab = (sListSlab*) malloc(bytes);
+        if (!slab) {
+            return NULL;
+        }
+    }
+    slab->count = (bytes - sizeof(sListSlab)) / sizeof(sListNode);
+    return slab;
+}
+
+/* Adds a new slab to the free-list. Called with the pool locked. */
+static int pool_grow(sListPool* pool)
+{
+    sListSlab* slab = pool_allocSlab(pool);
+    if (!slab) {
+        return -1;
+    }
+    slab->next = pool->slabs;
+    if (!pool->slabs) {
+        pool->slabsTail = slab;
+    }
+    pool->slabs = slab;
+
+    sListNode* nodes = (sListNode*) (slab + 1);
+    if (!pool->freeList) {
+        pool->freeTail = &nodes[0];
+    }
+    for (size_t i = 0; i < slab->count; i++) {
+        nodes[i].next = pool->freeList;
+        pool->freeList = &nodes[i];
+    }
+    pool->total += slab->count;
+    return 0;
+}
+
+static sListNode* pool_get(sListPool* pool)
+{
+    sListNode* node = NULL;
+
+    if (pool->shared) {
+        pthread_mutex_lock(&pool->mutex);
+    }
+    if (pool->freeList || pool_grow(pool) == 0) {
+        node = pool->freeList;
+        pool->freeList = node->next;
+        if (++pool->inUse > pool->highWater) {
+            pool->highWater = pool->inUse;
+        }
+    }
+    if (pool->shared) {
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    return node;
+}
+
+static void pool_put(sListPool* pool, sListNode* node)
+{
+    if (pool->shared) {
+        pthread_mutex_lock(&pool->mutex);
+    }
+    node->next = pool->freeList;
+    if (!pool->freeList) {
+        pool->freeTail = node;
+    }
+    pool->freeList = node;
+    pool->inUse--;
+    if (pool->shared) {
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/* Takes a node from 'pool'. Called with the owning list locked. */
+sListNode* list_poolGet(sListPool* pool)
+{
+    return pool_get(pool);
+}
+
+/* Returns a node to 'pool'. Called with the owning list locked. */
+void list_poolPut(sListPool* pool, sListNode* node)
+{
+    pool_put(pool, node);
+}
+
+/*
+ * Moves all slabs of the private pool 'src' into 'dest', so that nodes taken
+ * from 'src' can be returned to 'dest'. 'src' is freed. O(1), the slab and
+ * free lists are joined through their tails.
+ */
+static void pool_adopt(sListPool* dest, sListPool* src)
+{
+    if (dest->shared) {
+        pthread_mutex_lock(&dest->mutex);
+    }
+    if (src->slabs) {
+        src->slabsTail->next = dest->slabs;
+        if (!dest->slabs) {
+            dest->slabsTail = src->slabsTail;
+        }
+        dest->slabs = src->slabs;
+        src->slabs = NULL;
+    }
+    if (src->freeList) {
+        src->freeTail->next = dest->freeList;
+        if (!dest->freeList) {
+            dest->freeTail = src->freeTail;
+        }
+        dest->freeList = src->freeList;
+        src->freeList = NULL;
+    }
+    dest->total += src->total;
+    dest->inUse += src->inUse;
+    if (dest->inUse > dest->highWater) {
+        dest->highWater = dest->inUse;
+    }
+    if (dest->shared) {
+        pthread_mutex_unlock(&dest->mutex);
+    }
+    pool_free(src);
+}
+
+static void pool_release(sListPool* pool)
+{
+    if (!pool->shared) {
+        pool_free(pool);
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->users--;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * Next and head pointers are stored atomically, as epoch readers may follow
+ * them while the list is modified under its lock.
+ */
+static inline void list_setNext(sListNode* node, sListNode* next)
+{
+    __atomic_store_n(&node->next, next, __ATOMIC_RELEASE);
+}
+
+static inline void list_setHead(sList* l, sListNode* head)
+{
+    __atomic_store_n(&l->head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Unlinks 'node' from 'l' and returns it to the pool, or retires it if 'l'
+ * has epoch readers. Called with 'l' locked.
+ */
+static void list_unlinkNode(sList* l, sListNode* node)
+{
+    if (node->prev) {
+        list_setNext(node->prev, node->next);
+    } else {
+        list_setHead(l, node->next);
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        l->tail = node->prev;
+    }
+    l->size--;
+    if (l->epoch) {
+        list_epochRetire(l, node);
+    } else {
+        pool_put(l->pool, node);
+    }
+}
+
+/* Like list_unlinkNode(), but also drops 'node' from the hash index. */
+static void list_unlinkIndexed(sList* l, sListNode* node)
+{
+    if (l->index) {
+        list_indexRemove(l, node);
+    }
+    list_unlinkNode(l, node);
+}
+
+/*
+ * Links a new node carrying 'data' into 'l' right before 'next', or at the
+ * end if 'next' is NULL. Called with 'l' locked.
+ */
+static int list_linkNode(sList* l, void* data, sListNode* next)
+{
+    sListNode* node = pool_get(l->pool);
+    if (!node) {
+        return -1;
+    }
+    node->data = data;
+    node->next = next;
+    node->prev = next ? next->prev : l->tail;
+    if (node->prev) {
+        list_setNext(node->prev, node);
+    } else {
+        list_setHead(l, node);
+    }
+    if (next) {
+        next->prev = node;
+    } else {
+        l->tail = node;
+    }
+    l->size++;
+    if (l->index && list_indexInsert(l, node) != 0) {
+        list_unlinkNode(l, node);
+        return -1;
+    }
+    return 0;
+}
+
+/* Empties 'l', calling destroyFunc on the elements. Called with 'l' locked. */
+static void list_clearNodes(sList* l)
+{
+    if (l->index) {
+        list_indexClear(l);
+    }
+    while (l->head) {
+        void* data = l->head->data;
+        list_unlinkNode(l, l->head);
+        if (l->destroyFunc) {
+            l->destroyFunc(data);
+        }
+    }
+}
+
+/*
+ * Wakes threads blocked in list_popFrontWait() after 'added' elements have
+ * been pushed. Called with 'l' locked.
+ */
+static void list_wakeWaiters(sList* l, size_t added)
+{
+    LIST_INSTR_SIZE(l);
+    if (l->isThreadsafe != LIST_THREADSAFE || l->waiters == 0 || added == 0) {
+        return;
+    }
+    if (added == 1) {
+        pthread_cond_signal(&l->nonEmpty);
+    } else {
+        pthread_cond_broadcast(&l->nonEmpty);
+    }
+}
+
+/* Adds 'data' at the end of 'l' regardless of layout. Called with 'l' locked. */
+static int list_pushBackLocked(sList* l, void* data)
+{
+    if (list_isLockFree(l)) {
+        return list_lockfreePushBack(l, data);
+    }
+    if (l->unrolled) {
+        return list_unrolledPushBack(l, data);
+    }
+    return list_linkNode(l, data, NULL);
+}
+
+/*
+ * Removes the head element of 'l' regardless of layout and stores it in
+ * 'data'. Returns 1 if an element was removed, 0 if 'l' is empty. Called with
+ * 'l' locked.
+ */
+static int list_popFrontLocked(sList* l, void** data)
+{
+    if (list_isLockFree(l)) {
+        *data = list_lockfreePopFront(l);
+        return *data != NULL;
+    }
+    if (l->size == 0) {
+        return 0;
+    }
+    if (l->unrolled) {
+        *data = list_unrolledPopFront(l);
+    } else {
+        *data = l->head->data;
+        list_unlinkIndexed(l, l->head);
+    }
+    return 1;
+}
+
+/*
+ * Locks two different lists, always in address order, so that two threads
+ * locking the same pair in opposite roles can't deadlock. Every function
+ * taking the locks of two lists must go through here.
+ */
+static void list_lockPair(sList* a, sList* b)
+{
+    if (a < b) {
+        list_lock(a);
+        list_lock(b);
+    } else {
+        list_lock(b);
+        list_lock(a);
+    }
+}
+
+/* Sets up the node pool and hash index of a linked list. */
+static int list_linkedInit(sList* l, const sListAttr* attr)
+{
+    if (attr->pool) {
+        l->pool = attr->pool;
+        pthread_mutex_lock(&l->pool->mutex);
+        l->pool->users++;
+        pthread_mutex_unlock(&l->pool->mutex);
+    } else {
+        if (attr->numaPolicy == LIST_NUMA_NODE && list_numaNodes() > 1 &&
+                (attr->numaNode < 0 || attr->numaNode >= list_numaNodes())) {
+            return -1;
+        }
+        l->pool = pool_init(attr->slabSize, 0);
+        if (!l->pool) {
+            return -1;
+        }
+        l->pool->numaPolicy = attr->numaPolicy;
+        l->pool->numaNode = attr->numaNode;
+    }
+    if (attr->hashIndex && list_indexInit(l) != 0) {
+        pool_release(l->pool);
+        l->pool = NULL;
+        return -1;
+    }
+    if (attr->epochReclaim && list_epochInit(l) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Frees 'l' itself together with its pool, index and mutex. The elements
+ * must already have been removed.
+ */
+static void list_free(sList* l)
+{
+#ifdef LIST_INSTRUMENT
+    if (l->instr) {
+        list_instrDestroy(l);
+    }
+#endif
+    if (l->epoch) {
+        list_epochDestroy(l);
+    }
+    if (l->pool) {
+        pool_release(l->pool);
+    }
+    if (l->index) {
+        list_indexDestroy(l);
+    }
+    if (l->unrolled) {
+        list_unrolledDestroy(l);
+    }
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_cond_destroy(&l->nonEmpty);
+        pthread_mutex_destroy(&l->mutex);
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlock_destroy(&l->rwlock);
+    }
+    free(l);
+}
+
+
+/**
+ * Creates a new empty list. It should be freed with list_destroy() when no
+ * longer needed. On failure returns NULL. 'destroyFunc' is called on all
+ * remaining elements of the list when list_destroy() or list_clear() is called
+ * on it, and is responsible for freeing up memory used by the element.
+ */
+sList* list_create(void (*destroyFunc)(void*))
+{
+    return list_createAttr(destroyFunc, NULL);
+}
+
+
+/** Sets 'attr' to the defaults used by list_create(). */
+void list_attrInit(sListAttr* attr)
+{
+    attr->threadAlt = LIST_THREADSAFE;
+    attr->pool = NULL;
+    attr->slabSize = 0;
+    attr->hashIndex = 0;
+    attr->storage = LIST_STORAGE_LINKED;
+    attr->epochReclaim = 0;
+    attr->shards = 0;
+    attr->numaPolicy = LIST_NUMA_FIRST_TOUCH;
+    attr->numaNode = 0;
+}
+
+
+/**
+ * Like list_create(), but with the locking mode and node pool taken from
+ * 'attr'. A NULL 'attr' gives the same list as list_create(). On failure
+ * returns NULL.
+ */
+sList* list_createAttr(void (*destroyFunc)(void*), const sListAttr* attr)
+{
+    sListAttr defaults;
+    int ret;
+
+    if (!attr) {
+        list_attrInit(&defaults);
+        attr = &defaults;
+    }
+
+    sList* l = (sList*) calloc(1, sizeof(sList));
+    if (!l) {
+        return NULL;
+    }
+    l->destroyFunc = destroyFunc;
+    l->isThreadsafe = attr->threadAlt;
+
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_condattr_t condAttr;
+        if (pthread_mutex_init(&l->mutex, NULL) != 0) {
+            free(l);
+            return NULL;
+        }
+        pthread_condattr_init(&condAttr);
+        pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+        ret = pthread_cond_init(&l->nonEmpty, &condAttr);
+        pthread_condattr_destroy(&condAttr);
+        if (ret != 0) {
+            pthread_mutex_destroy(&l->mutex);
+            free(l);
+            return NULL;
+        }
+    } else if (l->isThreadsafe == LIST_THREADSAFE_RW) {
+        pthread_rwlockattr_t rwAttr;
+        pthread_rwlockattr_init(&rwAttr);
+#ifdef __GLIBC__
+        pthread_rwlockattr_setkind_np(&rwAttr,
+                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        ret = pthread_rwlock_init(&l->rwlock, &rwAttr);
+        pthread_rwlockattr_destroy(&rwAttr);
+        if (ret != 0) {
+            free(l);
+            return NULL;
+        }
+    }
+
+#ifdef LIST_INSTRUMENT
+    if (list_instrInit(l) != 0) {
+        list_free(l);
+        return NULL;
+    }
+#endif
+    if (attr->shards > 1) {
+        ret = list_isLockFree(l) ? -1 : list_shardedInit(l, attr);
+    } else if (list_isLockFree(l)) {
+        ret = list_lockfreeInit(l, attr->slabSize);
+    } else if (attr->storage == LIST_STORAGE_UNROLLED) {
+        ret = list_unrolledInit(l);
+    } else {
+        ret = list_linkedInit(l, attr);
+    }
+    if (ret != 0) {
+        list_free(l);
+        return NULL;
+    }
+    return l;
+}
 
-typedef void (*destroyFunc2)(void*);
-sList* list_create(void (*destroyFunc)(void*));
 
 /**
  * Frees up memory taken up by 'l'. If the list's 'destroyFunc' member is
@@ -15,14 +589,148 @@ sList* list_create(void (*destroyFunc)(void*));
  */
 int list_destroy(sList* l)
 {
+    if (!l) {
+        return -1;
+    }
+    if (l->shards) {
+        list_shardedDestroy(l);
+    } else if (l->lockfree) {
+        list_lockfreeDestroy(l);
+    } else if (l->unrolled) {
+        list_unrolledDestroy(l);
+    } else {
+        list_clearNodes(l);
+    }
+    list_free(l);
+    return 0;
 }
 
+
+/**
+ * Creates a node pool which can be shared between several lists through
+ * sListAttr::pool. 'slabSize' is the number of nodes allocated at a time when
+ * the pool runs dry, 0 selects the default. Returns NULL on failure.
+ */
+sListPool* list_poolCreate(size_t slabSize)
+{
+    return pool_init(slabSize, 1);
+}
+
+
+/**
+ * Frees a pool created with list_poolCreate() together with all its nodes.
+ * Returns 0 on success, -1 on failure or if lists still use the pool.
+ */
+int list_poolDestroy(sListPool* pool)
+{
+    if (!pool || !pool->shared) {
+        return -1;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    int users = pool->users;
+    pthread_mutex_unlock(&pool->mutex);
+    if (users > 0) {
+        return -1;
+    }
+    pool_free(pool);
+    return 0;
+}
+
+
+/**
+ * Fills in 'stats' with the size of 'l' and the state of its node pool.
+ * Returns 0 on success, -1 on failure.
+ */
+int list_stats(sList* l, sListStats* stats)
+{
+    if (!l || !stats) {
+        return -1;
+    }
+    if (list_isLockFree(l)) {
+        list_lockfreeStats(l, stats);
+        return 0;
+    }
+    if (l->shards) {
+        list_shardedStats(l, stats);
+        return 0;
+    }
+    list_lockShared(l);
+    if (l->unrolled) {
+        list_unrolledStats(l, stats);
+        list_unlock(l);
+        return 0;
+    }
+    sListPool* pool = l->pool;
+    if (pool->shared) {
+        pthread_mutex_lock(&pool->mutex);
+    }
+    stats->size = l->size;
+    stats->poolSize = pool->total;
+    stats->poolFree = pool->total - pool->inUse;
+    stats->poolHighWater = pool->highWater;
+    stats->poolSlabs = 0;
+    for (sListSlab* slab = pool->slabs; slab; slab = slab->next) {
+        stats->poolSlabs++;
+    }
+    stats->retired = l->epoch ? list_epochPending(l) : 0;
+    if (pool->shared) {
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    list_unlock(l);
+    return 0;
+}
+
+
+/**
+ * Iteration guard. Between list_readBegin() and list_readEnd() the list can't
+ * be modified by other threads, so it is safe to walk head->next or use an
+ * sListCursor. Returns 0 on success, -1 on failure.
+ */
+int list_readBegin(sList* l)
+{
+    if (!l || list_isLockFree(l) || l->shards) {
+        return -1;
+    }
+    list_lockShared(l);
+    return 0;
+}
+
+
+/** Ends an iteration guard started with list_readBegin(). */
+int list_readEnd(sList* l)
+{
+    if (!l || list_isLockFree(l) || l->shards) {
+        return -1;
+    }
+    list_unlock(l);
+    return 0;
+}
+
+
 /**
  * Adds a new element to the front of the list. Returns 0 on success, -1 on
  * failure.
  */
 int list_pushFront(sList* l, void* data)
 {
+    if (!l || list_isLockFree(l)) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_PUSH);
+    if (l->shards) {
+        return list_shardedPush(l, data, 1);
+    }
+    list_lock(l);
+    int ret = -1;
+    if (!l->closed) {
+        ret = l->unrolled ? list_unrolledPushFront(l, data)
+                          : list_linkNode(l, data, l->head);
+    }
+    if (ret == 0) {
+        list_wakeWaiters(l, 1);
+    }
+    list_unlock(l);
+    return ret;
 }
 
 
@@ -32,6 +740,27 @@ int list_pushFront(sList* l, void* data)
  */
 int list_pushBack(sList* l, void* data)
 {
+    if (!l) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_PUSH);
+    if (list_isLockFree(l)) {
+        return list_lockfreePushBack(l, data);
+    }
+    if (l->shards) {
+        return list_shardedPush(l, data, 0);
+    }
+    list_lock(l);
+    int ret = -1;
+    if (!l->closed) {
+        ret = l->unrolled ? list_unrolledPushBack(l, data)
+                          : list_linkNode(l, data, NULL);
+    }
+    if (ret == 0) {
+        list_wakeWaiters(l, 1);
+    }
+    list_unlock(l);
+    return ret;
 }
 
 
@@ -41,6 +770,27 @@ int list_pushBack(sList* l, void* data)
  */
 void* list_popFront(sList* l)
 {
+    void* data = NULL;
+
+    if (!l) {
+        return NULL;
+    }
+    LIST_OP(l, LIST_OP_POP);
+    if (list_isLockFree(l)) {
+        return list_lockfreePopFront(l);
+    }
+    if (l->shards) {
+        return list_shardedPop(l, 0);
+    }
+    list_lock(l);
+    if (l->unrolled) {
+        data = list_unrolledPopFront(l);
+    } else if (l->head) {
+        data = l->head->data;
+        list_unlinkIndexed(l, l->head);
+    }
+    list_unlock(l);
+    return data;
 }
 
 
@@ -50,24 +800,294 @@ void* list_popFront(sList* l)
  */
 void* list_popBack(sList* l)
 {
+    void* data = NULL;
+
+    if (!l || list_isLockFree(l)) {
+        return NULL;
+    }
+    LIST_OP(l, LIST_OP_POP);
+    if (l->shards) {
+        return list_shardedPop(l, 1);
+    }
+    list_lock(l);
+    if (l->unrolled) {
+        data = list_unrolledPopBack(l);
+    } else if (l->tail) {
+        data = l->tail->data;
+        list_unlinkIndexed(l, l->tail);
+    }
+    list_unlock(l);
+    return data;
 }
 
 
 /**
- * Removes the tail element from 'l' and returns it. Returns NULL if there are
- * no elements in the list, or if 'l' is NULL.
+ * Adds the 'n' elements of 'items' to the end of the list, in order, locking
+ * the list only once. Either all or none of the elements are added. Returns 0
+ * on success, -1 on failure.
+ */
+int list_pushBackN(sList* l, void** items, size_t n)
+{
+    if (!l || (!items && n > 0)) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_PUSH);
+    if (list_isLockFree(l)) {
+        return list_lockfreePushBackN(l, items, n);
+    }
+    if (l->shards) {
+        return list_shardedPushBackN(l, items, n);
+    }
+    list_lock(l);
+    if (l->closed) {
+        list_unlock(l);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (list_pushBackLocked(l, items[i]) != 0) {
+            while (i-- > 0) {
+                if (l->unrolled) {
+                    list_unrolledPopBack(l);
+                } else {
+                    list_unlinkIndexed(l, l->tail);
+                }
+            }
+            list_unlock(l);
+            return -1;
+        }
+    }
+    list_wakeWaiters(l, n);
+    list_unlock(l);
+    return 0;
+}
+
+
+/**
+ * Removes up to 'max' elements from the head of 'l' and stores them in 'out',
+ * locking the list only once. Returns the number of elements removed, 0 if
+ * the list is empty or 'l' is NULL.
+ */
+size_t list_popFrontN(sList* l, void** out, size_t max)
+{
+    size_t n = 0;
+
+    if (!l || !out) {
+        return 0;
+    }
+    LIST_OP(l, LIST_OP_POP);
+    if (l->shards) {
+        return list_shardedPopFrontN(l, out, max);
+    }
+    list_lock(l);
+    while (n < max && list_popFrontLocked(l, &out[n])) {
+        n++;
+    }
+    list_unlock(l);
+    return n;
+}
+
+
+/**
+ * Moves all elements of 'l' to the end of 'out', leaving 'l' empty, while
+ * holding the locks of both lists. The lists must have the same destroyFunc.
+ * Returns the number of elements moved, or -1 on failure.
+ */
+ssize_t list_drain(sList* l, sList* out)
+{
+    ssize_t moved = 0;
+    void* data;
+
+    if (!l || !out || l == out || l->destroyFunc != out->destroyFunc ||
+            l->shards || out->shards) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_POP);
+    list_lockPair(l, out);
+
+    if (out->closed) {
+        moved = -1;
+    } else if (l->unrolled && out->unrolled) {
+        moved = l->size;
+        list_unrolledCat(out, l);
+    } else if (!list_isLockFree(l) && !list_isLockFree(out) &&
+            !l->unrolled && !out->unrolled && l->pool == out->pool &&
+            !l->epoch) {
+        if (out->index && list_indexReserve(out, l->size) != 0) {
+            moved = -1;
+        } else if (l->head) {
+            l->head->prev = out->tail;
+            if (out->tail) {
+                list_setNext(out->tail, l->head);
+            } else {
+                list_setHead(out, l->head);
+            }
+            for (sListNode* cur = l->head; out->index && cur; cur = cur->next) {
+                list_indexInsert(out, cur);
+            }
+            out->tail = l->tail;
+            out->size += l->size;
+            moved = l->size;
+            if (l->index) {
+                list_indexClear(l);
+            }
+            list_setHead(l, NULL);
+            l->tail = NULL;
+            l->size = 0;
+        }
+    } else {
+        /*
+         * Different pools or layouts, or 'l' has epoch readers which must not
+         * follow its nodes into 'out'; move the elements one by one.
+         */
+        while (list_popFrontLocked(l, &data)) {
+            if (list_pushBackLocked(out, data) != 0) {
+                /* Only fails if out of memory, put the element back. */
+                if (list_isLockFree(l)) {
+                    list_lockfreePushBack(l, data);
+                } else if (l->unrolled) {
+                    list_unrolledPushFront(l, data);
+                } else {
+                    list_linkNode(l, data, l->head);
+                }
+                moved = -1;
+                break;
+            }
+            moved++;
+        }
+    }
+    if (moved > 0) {
+        list_wakeWaiters(out, moved);
+    }
+
+    list_unlock(l);
+    list_unlock(out);
+    return moved;
+}
+
+
+/**
+ * Like list_popFront(), but if 'l' is empty waits up to 'timeoutMs'
+ * milliseconds for an element to be pushed. A negative 'timeoutMs' waits
+ * forever, 0 doesn't wait at all. Returns NULL on timeout, or once 'l' is
+ * empty after list_close() has been called. Other lists than unsharded
+ * LIST_THREADSAFE ones have no condition variable to wait on, and always get
+ * NULL.
  */
-//void* list_popBack(sList* l);
+void* list_popFrontWait(sList* l, int32_t timeoutMs)
+{
+    struct timespec deadline;
+    void* data = NULL;
+
+    if (!l || l->isThreadsafe != LIST_THREADSAFE || l->shards) {
+        return NULL;
+    }
+    LIST_OP(l, LIST_OP_POP);
+    if (timeoutMs > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    list_lock(l);
+    while (l->size == 0 && !l->closed && timeoutMs != 0) {
+        int ret;
+        l->waiters++;
+#ifdef LIST_INSTRUMENT
+        if (l->instr) {
+            list_instrHoldEnd(l);
+        }
+#endif
+        if (timeoutMs < 0) {
+            ret = pthread_cond_wait(&l->nonEmpty, &l->mutex);
+        } else {
+            ret = pthread_cond_timedwait(&l->nonEmpty, &l->mutex, &deadline);
+        }
+#ifdef LIST_INSTRUMENT
+        if (l->instr) {
+            list_instrHoldStart(l);
+        }
+#endif
+        l->waiters--;
+        if (ret != 0) {
+            break;
+        }
+    }
+    list_popFrontLocked(l, &data);
+    list_unlock(l);
+    return data;
+}
+
+
+/**
+ * Closes 'l' for pushing: all following pushes and inserts fail, and every
+ * thread blocked in list_popFrontWait() is woken up. Returns 0 on success, -1
+ * on failure or if 'l' is a lock-free list.
+ */
+int list_close(sList* l)
+{
+    if (!l || list_isLockFree(l)) {
+        return -1;
+    }
+    if (l->shards) {
+        list_shardedClose(l);
+    }
+    list_lock(l);
+    l->closed = 1;
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        pthread_cond_broadcast(&l->nonEmpty);
+    }
+    list_unlock(l);
+    return 0;
+}
+
 
 /** Retrieves the front element without removing it from the list. */
 void* list_peekFront(sList* l)
 {
+    void* data = NULL;
+
+    if (!l) {
+        return NULL;
+    }
+    LIST_OP(l, LIST_OP_PEEK);
+    if (list_isLockFree(l)) {
+        return list_lockfreePeekFront(l);
+    }
+    if (l->shards) {
+        return NULL;
+    }
+    list_lockShared(l);
+    if (l->unrolled) {
+        data = list_unrolledPeekFront(l);
+    } else if (l->head) {
+        data = l->head->data;
+    }
+    list_unlock(l);
+    return data;
 }
 
 
 /** Retrieves the back element without removing it from the list. */
 void* list_peekBack(sList* l)
 {
+    void* data = NULL;
+
+    if (!l || list_isLockFree(l) || l->shards) {
+        return NULL;
+    }
+    LIST_OP(l, LIST_OP_PEEK);
+    list_lockShared(l);
+    if (l->unrolled) {
+        data = list_unrolledPeekBack(l);
+    } else if (l->tail) {
+        data = l->tail->data;
+    }
+    list_unlock(l);
+    return data;
 }
 
 
@@ -77,6 +1097,31 @@ void* list_peekBack(sList* l)
  */
 int list_clear(sList* l)
 {
+    if (!l) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_OTHER);
+    if (list_isLockFree(l)) {
+        void* data;
+        while ((data = list_lockfreePopFront(l)) != NULL) {
+            if (l->destroyFunc) {
+                l->destroyFunc(data);
+            }
+        }
+        return 0;
+    }
+    if (l->shards) {
+        list_shardedClear(l);
+        return 0;
+    }
+    list_lock(l);
+    if (l->unrolled) {
+        list_unrolledClear(l);
+    } else {
+        list_clearNodes(l);
+    }
+    list_unlock(l);
+    return 0;
 }
 
 
@@ -87,6 +1132,30 @@ int list_clear(sList* l)
  */
 int list_exists(sList* l, void* data)
 {
+    int found = 0;
+
+    if (!l || list_isLockFree(l)) {
+        return 0;
+    }
+    LIST_OP(l, LIST_OP_FIND);
+    if (l->shards) {
+        return list_shardedFind(l, data, NULL, 0, NULL);
+    }
+    list_lockShared(l);
+    if (l->unrolled) {
+        found = list_unrolledFind(l, data, NULL, 0, NULL);
+    } else if (l->index) {
+        found = list_indexFind(l, data) != NULL;
+    } else {
+        for (sListNode* cur = l->head; cur != NULL; cur = cur->next) {
+            if (cur->data == data) {
+                found = 1;
+                break;
+            }
+        }
+    }
+    list_unlock(l);
+    return found;
 }
 
 
@@ -100,6 +1169,29 @@ int list_exists(sList* l, void* data)
  */
 void* list_find(sList* l, void* el, int (*cmpFunc)(void* a, void* b))
 {
+    void* data = NULL;
+
+    if (!l || !cmpFunc || list_isLockFree(l)) {
+        return NULL;
+    }
+    LIST_OP(l, LIST_OP_FIND);
+    if (l->shards) {
+        list_shardedFind(l, el, cmpFunc, 0, &data);
+        return data;
+    }
+    list_lockShared(l);
+    if (l->unrolled) {
+        list_unrolledFind(l, el, cmpFunc, 0, &data);
+    } else {
+        for (sListNode* cur = l->head; cur != NULL; cur = cur->next) {
+            if (cmpFunc(cur->data, el) == 0) {
+                data = cur->data;
+                break;
+            }
+        }
+    }
+    list_unlock(l);
+    return data;
 }
 
 
@@ -111,6 +1203,35 @@ void* list_find(sList* l, void* el, int (*cmpFunc)(void* a, void* b))
  */
 int list_remove(sList* l, void* data)
 {
+    int ret = -1;
+
+    if (!l || list_isLockFree(l)) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_REMOVE);
+    if (l->shards) {
+        return list_shardedFind(l, data, NULL, 1, NULL) ? 0 : -1;
+    }
+    list_lock(l);
+    if (l->unrolled) {
+        ret = list_unrolledFind(l, data, NULL, 1, NULL) ? 0 : -1;
+    } else if (l->index) {
+        sListNode* node = list_indexFind(l, data);
+        if (node) {
+            list_unlinkIndexed(l, node);
+            ret = 0;
+        }
+    } else {
+        for (sListNode* cur = l->head; cur != NULL; cur = cur->next) {
+            if (cur->data == data) {
+                list_unlinkNode(l, cur);
+                ret = 0;
+                break;
+            }
+        }
+    }
+    list_unlock(l);
+    return ret;
 }
 
 
@@ -121,22 +1242,302 @@ int list_remove(sList* l, void* data)
  */
 int list_removeNode(sList *l, sListNode *node)
 {
+    if (!l || !node || list_isLockFree(l) || l->unrolled || l->shards) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_REMOVE);
+    list_lock(l);
+    list_unlinkIndexed(l, node);
+    list_unlock(l);
+    return 0;
 }
 
 
 /** Returns the number of elements in the list, or 0 if 'l' is NULL. */
 size_t list_size(sList* l)
 {
+    size_t size;
+
+    if (!l) {
+        return 0;
+    }
+    if (list_isLockFree(l)) {
+        return __atomic_load_n(&l->size, __ATOMIC_RELAXED);
+    }
+    if (l->shards) {
+        return list_shardedSize(l);
+    }
+    list_lockShared(l);
+    size = l->size;
+    list_unlock(l);
+    return size;
+}
+
+
+/** Positions 'cur' before the first element of 'l'. */
+void list_cursorInit(sListCursor* cur, sList* l)
+{
+    cur->list = l;
+    cur->node = NULL;
+    cur->chunk = NULL;
+    cur->pos = 0;
+    if (l->unrolled) {
+        list_unrolledCursorInit(cur);
+    } else {
+        cur->node = l->head;
+    }
+}
+
+
+/**
+ * Stores the next element of the cursor's list in 'data' and returns 1, or
+ * returns 0 when all elements have been visited.
+ */
+int list_cursorNext(sListCursor* cur, void** data)
+{
+    if (cur->node) {
+        *data = cur->node->data;
+        cur->node = cur->node->next;
+        return 1;
+    }
+    sListChunk* chunk = cur->chunk;
+    if (!chunk) {
+        return 0;
+    }
+    *data = chunk->items[cur->pos++];
+    if (cur->pos == chunk->end) {
+        cur->chunk = chunk->next;
+        cur->pos = cur->chunk ? cur->chunk->begin : 0;
+    }
+    return 1;
+}
+
+
+/**
+ * Sets 'items' to the next run of elements stored next to each other and
+ * returns their number, or returns 0 when all elements have been visited. A
+ * run is the rest of a node for unrolled lists and a single element for
+ * linked lists.
+ */
+size_t list_cursorNextBlock(sListCursor* cur, void* const** items)
+{
+    if (cur->node) {
+        *items = &cur->node->data;
+        cur->node = cur->node->next;
+        return 1;
+    }
+    return list_unrolledCursorNextBlock(cur, items);
 }
 
 
 /**
  * Append src to dest. Return the concatenated list, dest, or NULL if dest
- * or src is NULL or if they don have the same destroyFunc.
+ * or src is NULL or if they don have the same destroyFunc or storage layout.
  * list_cat() does NOT destroy dest. src IS consumed and destroyed.
+ *
+ * Nodes are relinked, not copied, when both lists share a pool or src has a
+ * private one (which dest then takes over), which takes O(1) unless dest has
+ * a hash index. Otherwise the elements are moved one by one into nodes from
+ * dest's pool. Both locks are taken in address order, see list_lockPair().
  */
 sList* list_cat(sList* dest, sList* src)
 {
+    if (!dest || !src || dest == src || dest->destroyFunc != src->destroyFunc ||
+            list_isLockFree(dest) || list_isLockFree(src) ||
+            dest->shards || src->shards ||
+            !dest->unrolled != !src->unrolled) {
+        return NULL;
+    }
+    LIST_OP(dest, LIST_OP_OTHER);
+    list_lockPair(dest, src);
+    size_t before = dest->size;
+
+    if (dest->closed) {
+        list_unlock(src);
+        list_unlock(dest);
+        return NULL;
+    } else if (src->unrolled) {
+        list_unrolledCat(dest, src);
+    } else if (src->pool == dest->pool || !src->pool->shared) {
+        if (dest->index && list_indexReserve(dest, src->size) != 0) {
+            list_unlock(src);
+            list_unlock(dest);
+            return NULL;
+        }
+        if (src->head) {
+            src->head->prev = dest->tail;
+            if (dest->tail) {
+                list_setNext(dest->tail, src->head);
+            } else {
+                list_setHead(dest, src->head);
+            }
+            sListNode* first = src->head;
+            dest->tail = src->tail;
+            dest->size += src->size;
+            for (sListNode* cur = first; dest->index && cur; cur = cur->next) {
+                list_indexInsert(dest, cur);
+            }
+        }
+        if (src->epoch) {
+            list_epochDestroy(src);
+        }
+        if (src->pool != dest->pool) {
+            pool_adopt(dest->pool, src->pool);
+            src->pool = NULL;
+        }
+    } else {
+        /*
+         * Keep both indexes in step with the nodes, so that src is still
+         * consistent if moving runs out of memory half way.
+         */
+        if (dest->index && list_indexReserve(dest, src->size) != 0) {
+            list_unlock(src);
+            list_unlock(dest);
+            return NULL;
+        }
+        while (src->head) {
+            if (list_linkNode(dest, src->head->data, NULL) != 0) {
+                list_wakeWaiters(dest, dest->size - before);
+                list_unlock(src);
+                list_unlock(dest);
+                return NULL;
+            }
+            list_unlinkIndexed(src, src->head);
+        }
+    }
+    src->head = src->tail = NULL;
+    src->size = 0;
+    list_wakeWaiters(dest, dest->size - before);
+
+    list_unlock(src);
+    list_unlock(dest);
+
+    list_free(src);
+    return dest;
+}
+
+
+/*
+ * Moves the nodes [first, last) of 'src' right before 'pos' in 'dest' by
+ * relinking them. 'src' and 'dest' may be the same list. Called with both
+ * lists locked.
+ */
+static void list_spliceNodes(sList* dest, sListNode* pos, sList* src,
+        sListNode* first, sListNode* last, size_t count)
+{
+    sListNode* rangeLast = last ? last->prev : src->tail;
+
+    /* Cut the range out of 'src'. */
+    if (first->prev) {
+        list_setNext(first->prev, last);
+    } else {
+        list_setHead(src, last);
+    }
+    if (last) {
+        last->prev = first->prev;
+    } else {
+        src->tail = first->prev;
+    }
+    src->size -= count;
+
+    /* The range is complete before it is published to epoch readers. */
+    list_setNext(rangeLast, pos);
+    first->prev = pos ? pos->prev : dest->tail;
+    if (first->prev) {
+        list_setNext(first->prev, first);
+    } else {
+        list_setHead(dest, first);
+    }
+    if (pos) {
+        pos->prev = rangeLast;
+    } else {
+        dest->tail = rangeLast;
+    }
+    dest->size += count;
+}
+
+/**
+ * Moves the nodes from 'first' up to, not including, 'last' out of 'src' and
+ * right before 'pos' in 'dest'. last==NULL moves up to the end of src, and
+ * pos==NULL appends to dest. Returns the number of elements moved, or -1 on
+ * failure.
+ */
+ssize_t list_splice(sList* dest, sListNode* pos, sList* src,
+        sListNode* first, sListNode* last)
+{
+    ssize_t moved = 0;
+
+    if (!dest || !src || !first || dest->destroyFunc != src->destroyFunc ||
+            list_isLockFree(dest) || list_isLockFree(src) ||
+            dest->unrolled || src->unrolled || dest->shards || src->shards) {
+        return -1;
+    }
+    LIST_OP(dest, LIST_OP_OTHER);
+    if (dest == src) {
+        list_lock(dest);
+    } else {
+        list_lockPair(dest, src);
+    }
+
+    /* Count the range, checking that it ends at 'last' and skips 'pos'. */
+    size_t count = 0;
+    sListNode* cur;
+    for (cur = first; cur && cur != last; cur = cur->next) {
+        if (cur == pos && dest == src) {
+            break;
+        }
+        count++;
+    }
+    if (cur != last || dest->closed) {
+        moved = -1;
+    } else if (count > 0 && dest->pool == src->pool && !src->epoch) {
+        /*
+         * Relink; only the hash indexes need the nodes one by one. They are
+         * unindexed at their old place and indexed again at the new one, as
+         * a moved node may now come before, or after, other nodes carrying
+         * the same element. This holds for moves within one list too.
+         */
+        if (dest != src && dest->index &&
+                list_indexReserve(dest, count) != 0) {
+            moved = -1;
+        } else {
+            for (cur = first; src->index && cur != last; cur = cur->next) {
+                list_indexRemove(src, cur);
+            }
+            list_spliceNodes(dest, pos, src, first, last, count);
+            cur = first;
+            for (size_t i = 0; dest->index && i < count; i++) {
+                list_indexInsert(dest, cur);
+                cur = cur->next;
+            }
+            moved = count;
+        }
+    } else {
+        /*
+         * Different pools, or 'src' has epoch readers which may be walking
+         * the range: move the elements into new nodes. The loop runs on the
+         * count, as within one list the new nodes may follow the range.
+         */
+        cur = first;
+        for (size_t i = 0; i < count; i++, moved++) {
+            sListNode* next = cur->next;
+            if (list_linkNode(dest, cur->data, pos) != 0) {
+                moved = -1;
+                break;
+            }
+            list_unlinkIndexed(src, cur);
+            cur = next;
+        }
+    }
+    if (moved > 0 && dest != src) {
+        list_wakeWaiters(dest, moved);
+    }
+
+    if (dest != src) {
+        list_unlock(src);
+    }
+    list_unlock(dest);
+    return moved;
 }
 
 
@@ -146,12 +1547,85 @@ sList* list_cat(sList* dest, sList* src)
  */
 int list_insert(sList *list, void *data, sListNode *next)
 {
+    if (!list || list_isLockFree(list) || list->unrolled || list->shards) {
+        return -1;
+    }
+    LIST_OP(list, LIST_OP_PUSH);
+    list_lock(list);
+    int ret = list->closed ? -1 : list_linkNode(list, data, next);
+    if (ret == 0) {
+        list_wakeWaiters(list, 1);
+    }
+    list_unlock(list);
+    return ret;
 }
 
 
+/**
+ * Sorts 'l' in place with a stable merge sort: elements comparing equal keep
+ * their order. 'cmpFunc' is defined like for list_find(), but here the sign
+ * of the return value matters. Returns 0 on success, -1 on failure.
+ */
+int list_sort(sList* l, int (*cmpFunc)(void* a, void* b))
+{
+    return list_sortParallel(l, cmpFunc, 1);
+}
 
-typedef int32_t (*foreachFunc)(void *element, void *param)
+
+/**
+ * Like list_sort(), but lists of at least 16384 elements are sorted by up to
+ * 'threads' threads, 0 meaning one per online CPU. The list stays locked
+ * until the sort is done.
+ */
+int list_sortParallel(sList* l, int (*cmpFunc)(void* a, void* b),
+        unsigned threads)
 {
+    if (!l || !cmpFunc || list_isLockFree(l) || l->shards) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_ITERATE);
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned) cpus : 1;
+    }
+    list_lock(l);
+    int ret = list_sortLocked(l, cmpFunc, threads);
+    list_unlock(l);
+    return ret;
+}
+
+
+/**
+ * Inserts 'data' into the sorted list 'l' after the last element which is
+ * not greater than it according to 'cmpFunc', so that 'l' stays sorted and
+ * equal elements stay in insertion order. O(n) complexity. Returns 0 on
+ * success, -1 on failure.
+ */
+int list_insertSorted(sList* l, void* data, int (*cmpFunc)(void* a, void* b))
+{
+    int ret = -1;
+
+    if (!l || !cmpFunc || list_isLockFree(l) || l->shards) {
+        return -1;
+    }
+    LIST_OP(l, LIST_OP_PUSH);
+    list_lock(l);
+    if (!l->closed) {
+        if (l->unrolled) {
+            ret = list_unrolledInsertSorted(l, data, cmpFunc);
+        } else {
+            sListNode* next = l->head;
+            while (next && cmpFunc(next->data, data) <= 0) {
+                next = next->next;
+            }
+            ret = list_linkNode(l, data, next);
+        }
+    }
+    if (ret == 0) {
+        list_wakeWaiters(l, 1);
+    }
+    list_unlock(l);
+    return ret;
 }
 
 
@@ -160,8 +1634,146 @@ typedef int32_t (*foreachFunc)(void *element, void *param)
  * and param as arguments. If the foreach function returns something but a true
  * the list _foreach will return without calling the foreach function with any
  * remaining elements
+ *
+ * Returns 0 when all elements were visited, -1 if 'list' or 'foreach' is NULL
+ * or the loop was stopped early. The list is locked during the whole loop, so
+ * 'foreach' must not call back into the same list.
  */
 int list_foreach(sList *list, foreachFunc foreach, void *param)
 {
+    int ret = 0;
+
+    if (!list || !foreach || list_isLockFree(list)) {
+        return -1;
+    }
+    LIST_OP(list, LIST_OP_ITERATE);
+    if (list->shards) {
+        return list_shardedForeach(list, foreach, param);
+    }
+    list_lockShared(list);
+    if (list->unrolled) {
+        ret = list_unrolledForeach(list, foreach, param);
+    } else {
+        for (sListNode* cur = list->head; cur != NULL; cur = cur->next) {
+            if (!foreach(cur->data, param)) {
+                ret = -1;
+                break;
+            }
+        }
+    }
+    list_unlock(list);
+    return ret;
+}
+
+
+/* A list_foreachParallel() call, shared by the threads working on it. */
+typedef struct {
+    foreachFunc foreach;
+    void* param;
+    sListCursor* starts;        /* Cursor at the start of every range. */
+    size_t ranges;
+    size_t grain;               /* Elements per range. */
+    size_t next;                /* Next range to take. */
+    int stop;                   /* Set once 'foreach' returned false. */
+} sListForeachJob;
+
+/* Moves 'cur' forward by 'n' elements, skipping whole chunks if unrolled. */
+static void list_cursorSkip(sListCursor* cur, size_t n)
+{
+    if (!cur->list->unrolled) {
+        while (n-- > 0 && cur->node) {
+            cur->node = cur->node->next;
+        }
+        return;
+    }
+    while (n > 0 && cur->chunk) {
+        size_t avail = cur->chunk->end - cur->pos;
+        if (n < avail) {
+            cur->pos += n;
+            return;
+        }
+        n -= avail;
+        cur->chunk = cur->chunk->next;
+        cur->pos = cur->chunk ? cur->chunk->begin : 0;
+    }
+}
+
+/* Takes ranges of 'job' and runs 'foreach' on them until none is left. */
+static void list_foreachRanges(void* arg)
+{
+    sListForeachJob* job = (sListForeachJob*) arg;
+    void* data;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->ranges) {
+            return;
+        }
+        sListCursor cur = job->starts[i];
+        for (size_t n = 0; n < job->grain && list_cursorNext(&cur, &data); n++) {
+            if (__atomic_load_n(&job->stop, __ATOMIC_RELAXED)) {
+                return;
+            }
+            if (!job->foreach(data, job->param)) {
+                __atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+    }
 }
 
+
+/**
+ * Like list_foreach(), but cuts the list into ranges of 'grain' elements
+ * which are handed out to the workers of 'executor' and the calling thread.
+ * A 'grain' of 0 picks one giving each thread a few ranges. Without an
+ * executor, or for short lists, runs like list_foreach().
+ */
+int list_foreachParallel(sList* list, foreachFunc foreach, void* param,
+        sListExecutor* executor, size_t grain)
+{
+    sListForeachJob job;
+
+    if (!list || !foreach || list_isLockFree(list)) {
+        return -1;
+    }
+    unsigned threads = list_executorThreads(executor) + 1;
+    if (list->shards || threads == 1) {
+        /* list_foreach() records the walk itself. */
+        return list_foreach(list, foreach, param);
+    }
+    LIST_OP(list, LIST_OP_ITERATE);
+
+    list_lockShared(list);
+    size_t size = list->size;
+    if (grain == 0) {
+        grain = size / (threads * 4);
+        if (grain < LIST_FOREACH_MIN_GRAIN) {
+            grain = LIST_FOREACH_MIN_GRAIN;
+        }
+    }
+    job.foreach = foreach;
+    job.param = param;
+    job.grain = grain;
+    job.ranges = (size + grain - 1) / grain;
+    job.next = 0;
+    job.stop = 0;
+    job.starts = job.ranges > 1 ?
+            (sListCursor*) malloc(job.ranges * sizeof(sListCursor)) : NULL;
+    if (!job.starts) {
+        /* A single range, or out of memory: run on this thread only. */
+        list_unlock(list);
+        return list_foreach(list, foreach, param);
+    }
+    list_cursorInit(&job.starts[0], list);
+    for (size_t i = 1; i < job.ranges; i++) {
+        job.starts[i] = job.starts[i - 1];
+        list_cursorSkip(&job.starts[i], grain);
+    }
+    size_t helpers = job.ranges - 1 < threads - 1 ? job.ranges - 1 : threads - 1;
+    list_executorRun(executor, list_foreachRanges, &job, (unsigned) helpers);
+    list_unlock(list);
+
+    free(job.starts);
+    return job.stop ? -1 : 0;
+}
@@ -0,0 +1,211 @@
+
+/*-----------------------------------------------------------------------
+ * Epoch-based reclamation for sList, enabled with sListAttr::epochReclaim.
+ *
+ * Readers announce themselves by storing the list's current epoch in a
+ * reader slot and clear the slot when they are done. Writers, holding the
+ * list lock, unlink nodes as usual but don't hand them back to the pool
+ * right away: the node is retired, stamped with the epoch at which it was
+ * unlinked, and the epoch is advanced. A retired node is only reused once
+ * every reader slot is either empty or holds a later epoch, since such
+ * readers started after the node was unlinked and can't reach it.
+ *
+ * A retired node keeps its data and next pointer, so a reader standing on it
+ * when it is unlinked can still read it and continue its walk. Retired nodes
+ * are queued in a ring of (node, epoch) records which only grows, so steady
+ * state removal doesn't allocate.
+ *
+ * The reader announcement and the writer's scan of the slots are both
+ * followed by a full fence, so either the writer sees the reader or the
+ * reader sees the list without the node.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+/* Max number of concurrent readers of one list. */
+#define EPOCH_READERS       128
+/* Retired nodes collected before trying to reclaim them. */
+#define EPOCH_BATCH         64
+#define EPOCH_CACHE_LINE    64
+
+typedef struct {
+    alignas(EPOCH_CACHE_LINE) uint64_t epoch;   /* 0 if the slot is free. */
+} sListEpochSlot;
+
+typedef struct {
+    sListNode* node;
+    uint64_t epoch;             /* Epoch at which 'node' was unlinked. */
+} sListRetired;
+
+struct sListEpochT {
+    alignas(EPOCH_CACHE_LINE) uint64_t epoch;   /* Current epoch, >= 1. */
+    sListRetired* retired;      /* Ring of retired nodes, oldest first. */
+    size_t capacity;            /* Size of 'retired', a power of two. */
+    size_t first;               /* Index of the oldest record. */
+    size_t count;               /* Number of records. */
+    sListEpochSlot slots[EPOCH_READERS];
+};
+
+/* Returns the oldest epoch a reader of 'e' may still be in, or 0 if none. */
+static uint64_t epoch_oldestReader(sListEpoch* e)
+{
+    uint64_t oldest = 0;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < EPOCH_READERS; i++) {
+        uint64_t epoch = __atomic_load_n(&e->slots[i].epoch, __ATOMIC_ACQUIRE);
+        if (epoch && (!oldest || epoch < oldest)) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+/*
+ * Returns retired nodes which no reader can see any longer to the pool.
+ * Called with the list locked.
+ */
+static void epoch_reclaim(sList* l, int all)
+{
+    sListEpoch* e = l->epoch;
+    uint64_t oldest = all ? 0 : epoch_oldestReader(e);
+
+    while (e->count > 0) {
+        sListRetired* rec = &e->retired[e->first];
+        if (oldest && rec->epoch >= oldest) {
+            break;
+        }
+        list_poolPut(l->pool, rec->node);
+        e->first = (e->first + 1) & (e->capacity - 1);
+        e->count--;
+    }
+}
+
+static int epoch_grow(sListEpoch* e)
+{
+    size_t capacity = e->capacity ? e->capacity * 2 : EPOCH_BATCH;
+    sListRetired* retired = (sListRetired*) malloc(capacity * sizeof(sListRetired));
+    if (!retired) {
+        return -1;
+    }
+    for (size_t i = 0; i < e->count; i++) {
+        retired[i] = e->retired[(e->first + i) & (e->capacity - 1)];
+    }
+    free(e->retired);
+    e->retired = retired;
+    e->capacity = capacity;
+    e->first = 0;
+    return 0;
+}
+
+
+int list_epochInit(sList* l)
+{
+    void* mem;
+    if (posix_memalign(&mem, EPOCH_CACHE_LINE, sizeof(sListEpoch)) != 0) {
+        return -1;
+    }
+    memset(mem, 0, sizeof(sListEpoch));
+    l->epoch = (sListEpoch*) mem;
+    l->epoch->epoch = 1;
+    return 0;
+}
+
+/* Reclaims all retired nodes; no reader may use the list any longer. */
+void list_epochDestroy(sList* l)
+{
+    epoch_reclaim(l, 1);
+    free(l->epoch->retired);
+    free(l->epoch);
+    l->epoch = NULL;
+}
+
+/*
+ * Retires 'node', which has just been unlinked from 'l', instead of putting
+ * it back in the pool. If the retired ring can't grow, waits for the readers
+ * to leave instead. Called with the list locked.
+ */
+void list_epochRetire(sList* l, sListNode* node)
+{
+    sListEpoch* e = l->epoch;
+    uint64_t epoch = __atomic_load_n(&e->epoch, __ATOMIC_RELAXED);
+
+    if (e->count == e->capacity) {
+        epoch_reclaim(l, 0);
+        while (e->count == e->capacity && epoch_grow(e) != 0) {
+            sched_yield();
+            epoch_reclaim(l, 0);
+        }
+    }
+    sListRetired* rec = &e->retired[(e->first + e->count) & (e->capacity - 1)];
+    rec->node = node;
+    rec->epoch = epoch;
+    e->count++;
+    __atomic_store_n(&e->epoch, epoch + 1, __ATOMIC_RELEASE);
+
+    if (e->count % EPOCH_BATCH == 0) {
+        epoch_reclaim(l, 0);
+    }
+}
+
+/* Returns the number of nodes waiting to be reclaimed. */
+size_t list_epochPending(sList* l)
+{
+    return l->epoch->count;
+}
+
+
+/**
+ * Starts a lock-free read of 'l', see the comment about sListAttr::epochReclaim.
+ * Returns 0 on success, -1 on failure or if all reader slots are in use.
+ */
+int list_epochEnter(sList* l, sListEpochGuard* guard)
+{
+    if (!l || !guard || !l->epoch) {
+        return -1;
+    }
+    sListEpoch* e = l->epoch;
+    unsigned start = (unsigned) ((uintptr_t) pthread_self() >> 6) % EPOCH_READERS;
+
+    for (unsigned n = 0; n < EPOCH_READERS; n++) {
+        unsigned i = (start + n) % EPOCH_READERS;
+        uint64_t expected = 0;
+        uint64_t epoch = __atomic_load_n(&e->epoch, __ATOMIC_ACQUIRE);
+        if (__atomic_compare_exchange_n(&e->slots[i].epoch, &expected, epoch,
+                    false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            guard->list = l;
+            guard->slot = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/** Ends a read started with list_epochEnter(). */
+void list_epochExit(sListEpochGuard* guard)
+{
+    __atomic_store_n(&guard->list->epoch->slots[guard->slot].epoch, 0,
+            __ATOMIC_RELEASE);
+    guard->list = NULL;
+}
+
+
+/** Returns the first node of the guarded list, or NULL if it is empty. */
+sListNode* list_epochFirst(sListEpochGuard* guard)
+{
+    return __atomic_load_n(&guard->list->head, __ATOMIC_ACQUIRE);
+}
+
+
+/** Returns the node after 'node' in the guarded list, or NULL. */
+sListNode* list_epochNext(sListEpochGuard* guard, sListNode* node)
+{
+    (void) guard;
+    return __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,143 @@
+
+/*-----------------------------------------------------------------------
+ * Worker pool for list_foreachParallel(), see sListExecutor.
+ *
+ * The workers block in list_popFrontWait() on a LIST_THREADSAFE queue of
+ * batches. A batch is one function to run on several workers at once; it is
+ * pushed once per worker wanted, and the submitting thread runs the
+ * function too and then waits until every copy has returned, so a batch can
+ * live on the submitter's stack. Since the submitter always takes part, a
+ * batch completes even if every worker is busy with other batches.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+struct sListExecutorT {
+    sList* queue;               /* Batches waiting for a worker. */
+    pthread_t* threads;
+    unsigned count;             /* Number of worker threads. */
+};
+
+typedef struct {
+    void (*fn)(void*);
+    void* arg;
+    unsigned pending;           /* Copies queued or running. */
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+} sListBatch;
+
+static void* executor_worker(void* arg)
+{
+    sListExecutor* ex = (sListExecutor*) arg;
+    sListBatch* batch;
+
+    while ((batch = (sListBatch*) list_popFrontWait(ex->queue, -1)) != NULL) {
+        batch->fn(batch->arg);
+        pthread_mutex_lock(&batch->mutex);
+        if (--batch->pending == 0) {
+            pthread_cond_signal(&batch->done);
+        }
+        pthread_mutex_unlock(&batch->mutex);
+    }
+    return NULL;
+}
+
+
+/**
+ * Creates a pool of 'threads' worker threads, 0 meaning one per online CPU.
+ * Returns NULL on failure.
+ */
+sListExecutor* list_executorCreate(unsigned threads)
+{
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned) cpus : 1;
+    }
+    sListExecutor* ex = (sListExecutor*) calloc(1, sizeof(sListExecutor));
+    if (!ex) {
+        return NULL;
+    }
+    ex->queue = list_create(NULL);
+    ex->threads = (pthread_t*) calloc(threads, sizeof(pthread_t));
+    if (!ex->queue || !ex->threads) {
+        list_destroy(ex->queue);
+        free(ex->threads);
+        free(ex);
+        return NULL;
+    }
+    for (ex->count = 0; ex->count < threads; ex->count++) {
+        if (pthread_create(&ex->threads[ex->count], NULL, executor_worker, ex) != 0) {
+            list_executorDestroy(ex);
+            return NULL;
+        }
+    }
+    return ex;
+}
+
+
+/**
+ * Stops and joins the workers of 'ex' and frees it. No call may be using the
+ * executor any longer. Returns 0 on success, -1 on failure.
+ */
+int list_executorDestroy(sListExecutor* ex)
+{
+    if (!ex) {
+        return -1;
+    }
+    list_close(ex->queue);
+    for (unsigned i = 0; i < ex->count; i++) {
+        pthread_join(ex->threads[i], NULL);
+    }
+    list_destroy(ex->queue);
+    free(ex->threads);
+    free(ex);
+    return 0;
+}
+
+
+/** Returns the number of worker threads of 'ex', or 0 if 'ex' is NULL. */
+unsigned list_executorThreads(sListExecutor* ex)
+{
+    return ex ? ex->count : 0;
+}
+
+
+/*
+ * Runs fn(arg) on up to 'helpers' workers of 'ex' and on the calling thread
+ * at the same time, and returns once all of them have returned.
+ */
+void list_executorRun(sListExecutor* ex, void (*fn)(void*), void* arg,
+        unsigned helpers)
+{
+    sListBatch batch;
+
+    batch.fn = fn;
+    batch.arg = arg;
+    batch.pending = 0;
+    pthread_mutex_init(&batch.mutex, NULL);
+    pthread_cond_init(&batch.done, NULL);
+
+    if (helpers > ex->count) {
+        helpers = ex->count;
+    }
+    pthread_mutex_lock(&batch.mutex);
+    for (unsigned i = 0; i < helpers; i++) {
+        if (list_pushBack(ex->queue, &batch) != 0) {
+            break;
+        }
+        batch.pending++;
+    }
+    pthread_mutex_unlock(&batch.mutex);
+
+    fn(arg);
+
+    pthread_mutex_lock(&batch.mutex);
+    while (batch.pending > 0) {
+        pthread_cond_wait(&batch.done, &batch.mutex);
+    }
+    pthread_mutex_unlock(&batch.mutex);
+    pthread_cond_destroy(&batch.done);
+    pthread_mutex_destroy(&batch.mutex);
+}
@@ -0,0 +1,235 @@
+
+/*-----------------------------------------------------------------------
+ * Pointer-keyed hash index for sList, enabled with sListAttr::hashIndex.
+ *
+ * Open addressing with linear probing and backward-shift deletion, so no
+ * tombstones pile up. Each slot maps an element pointer to the first node in
+ * list order carrying it, together with the number of nodes carrying it.
+ * Pushing the same pointer several times is allowed; keeping track of which
+ * of them comes first then costs a walk over the list, but only for those
+ * duplicated pointers.
+ *
+ * The table is kept at most half full and only grows, so a list which has
+ * reached its steady-state size doesn't allocate. All functions are called
+ * with the list locked.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define INDEX_MIN_CAPACITY  16
+
+typedef struct {
+    void* key;          /* Element pointer, NULL if the slot is free. */
+    sListNode* first;   /* First node in list order carrying 'key'. */
+    size_t count;       /* Number of nodes carrying 'key'. */
+} sListIndexSlot;
+
+struct sListIndexT {
+    sListIndexSlot* slots;
+    size_t capacity;    /* Power of two. */
+    size_t used;        /* Number of occupied slots. */
+    size_t nullCount;   /* Number of nodes carrying NULL, which isn't hashed. */
+    sListNode* nullFirst;
+};
+
+static inline size_t index_hash(const void* key, size_t capacity)
+{
+    uint64_t h = (uint64_t) (uintptr_t) key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t) h & (capacity - 1);
+}
+
+/* Returns the slot holding 'key', or the free slot where it would go. */
+static sListIndexSlot* index_lookup(sListIndex* index, const void* key)
+{
+    size_t i = index_hash(key, index->capacity);
+    for (;;) {
+        sListIndexSlot* slot = &index->slots[i];
+        if (slot->key == key || slot->key == NULL) {
+            return slot;
+        }
+        i = (i + 1) & (index->capacity - 1);
+    }
+}
+
+static int index_resize(sListIndex* index, size_t capacity)
+{
+    sListIndexSlot* old = index->slots;
+    size_t oldCapacity = index->capacity;
+
+    index->slots = (sListIndexSlot*) calloc(capacity, sizeof(sListIndexSlot));
+    if (!index->slots) {
+        index->slots = old;
+        return -1;
+    }
+    index->capacity = capacity;
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i].key) {
+            *index_lookup(index, old[i].key) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/* Returns the first node after 'node' carrying 'data', or NULL. */
+static sListNode* index_nextWith(sListNode* node, void* data)
+{
+    for (node = node->next; node; node = node->next) {
+        if (node->data == data) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* Returns 1 if the linked node 'node' comes before 'other' in list 'l'. */
+static int index_precedes(sList* l, sListNode* node, sListNode* other)
+{
+    if (node == l->head) {
+        return 1;
+    }
+    if (node == l->tail) {
+        return 0;
+    }
+    return index_nextWith(node, other->data) == other ? 1 : 0;
+}
+
+
+int list_indexInit(sList* l)
+{
+    sListIndex* index = (sListIndex*) calloc(1, sizeof(sListIndex));
+    if (!index) {
+        return -1;
+    }
+    if (index_resize(index, INDEX_MIN_CAPACITY) != 0) {
+        free(index);
+        return -1;
+    }
+    l->index = index;
+    return 0;
+}
+
+void list_indexDestroy(sList* l)
+{
+    free(l->index->slots);
+    free(l->index);
+    l->index = NULL;
+}
+
+/*
+ * Makes room for 'count' more distinct elements, so that the following
+ * list_indexInsert() calls can't fail.
+ */
+int list_indexReserve(sList* l, size_t count)
+{
+    sListIndex* index = l->index;
+    size_t capacity = index->capacity;
+
+    while ((index->used + count) * 2 > capacity) {
+        capacity *= 2;
+    }
+    return capacity == index->capacity ? 0 : index_resize(index, capacity);
+}
+
+/* Adds 'node', which has just been linked into 'l', to the index. */
+int list_indexInsert(sList* l, sListNode* node)
+{
+    sListIndex* index = l->index;
+
+    if (!node->data) {
+        if (!index->nullCount++ || index_precedes(l, node, index->nullFirst)) {
+            index->nullFirst = node;
+        }
+        return 0;
+    }
+    if ((index->used + 1) * 2 > index->capacity &&
+            index_resize(index, index->capacity * 2) != 0) {
+        return -1;
+    }
+    sListIndexSlot* slot = index_lookup(index, node->data);
+    if (!slot->key) {
+        slot->key = node->data;
+        slot->first = node;
+        slot->count = 1;
+        index->used++;
+    } else {
+        if (index_precedes(l, node, slot->first)) {
+            slot->first = node;
+        }
+        slot->count++;
+    }
+    return 0;
+}
+
+/* Removes 'node', which is about to be unlinked from 'l', from the index. */
+void list_indexRemove(sList* l, sListNode* node)
+{
+    sListIndex* index = l->index;
+
+    if (!node->data) {
+        if (--index->nullCount && index->nullFirst == node) {
+            index->nullFirst = index_nextWith(node, NULL);
+        }
+        return;
+    }
+    sListIndexSlot* slot = index_lookup(index, node->data);
+    if (--slot->count) {
+        if (slot->first == node) {
+            slot->first = index_nextWith(node, node->data);
+        }
+        return;
+    }
+
+    /* Backward-shift deletion: pull later entries of the probe run back. */
+    size_t mask = index->capacity - 1;
+    size_t hole = (size_t) (slot - index->slots);
+    size_t i = hole;
+    for (;;) {
+        i = (i + 1) & mask;
+        sListIndexSlot* cur = &index->slots[i];
+        if (!cur->key) {
+            break;
+        }
+        size_t home = index_hash(cur->key, index->capacity);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->slots[hole] = *cur;
+            hole = i;
+        }
+    }
+    index->slots[hole].key = NULL;
+    index->slots[hole].first = NULL;
+    index->slots[hole].count = 0;
+    index->used--;
+}
+
+/* Returns the first node of 'l' carrying 'data', or NULL. */
+sListNode* list_indexFind(sList* l, void* data)
+{
+    sListIndex* index = l->index;
+
+    if (!data) {
+        return index->nullCount ? index->nullFirst : NULL;
+    }
+    sListIndexSlot* slot = index_lookup(index, data);
+    return slot->key ? slot->first : NULL;
+}
+
+/* Forgets all elements, keeping the table allocated. */
+void list_indexClear(sList* l)
+{
+    sListIndex* index = l->index;
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        index->slots[i].key = NULL;
+        index->slots[i].first = NULL;
+        index->slots[i].count = 0;
+    }
+    index->used = 0;
+    index->nullCount = 0;
+    index->nullFirst = NULL;
+}
@@ -0,0 +1,315 @@
+
+/*-----------------------------------------------------------------------
+ * Instrumentation of sList, compiled in with -DLIST_INSTRUMENT.
+ *
+ * Every list gets an sListInstr when it is created, linked into a
+ * process-wide registry until the list is destroyed. Counters are updated
+ * with relaxed atomics, as several threads may run operations on the same
+ * list at once (readers of RW lists, lock-free queues).
+ *
+ * Lock waits are only timed when the lock isn't free: the lock is tried
+ * first, and the clock is only read twice when that fails. Hold times are
+ * measured for exclusive holders only; the start of the hold is kept in the
+ * sListInstr, which is safe as only one thread can hold the lock exclusive.
+ *
+ * Without LIST_INSTRUMENT only stubs are built, and the hooks in u_list.cc
+ * compile to nothing.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef LIST_INSTRUMENT
+
+#include <stdlib.h>
+#include <time.h>
+
+struct sListInstrT {
+    struct sListInstrT* prev;   /* Registry links. */
+    struct sListInstrT* next;
+    sList* list;
+    char name[LIST_NAME_MAX];
+    uint64_t lockedAt;          /* Start of the exclusive hold, or 0. */
+    sListOpStats stats;
+};
+
+static const char* const instr_opNames[LIST_OP_COUNT] = {
+    "push", "pop", "peek", "find", "remove", "iterate", "other",
+};
+
+static pthread_mutex_t instr_registryMutex = PTHREAD_MUTEX_INITIALIZER;
+static sListInstr* instr_registry;
+
+static inline void instr_add(uint64_t* counter, uint64_t n)
+{
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+static inline void instr_max(uint64_t* max, uint64_t value)
+{
+    uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > cur && !__atomic_compare_exchange_n(max, &cur, value, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Histogram bucket of 'ns': bucket i holds [2^i, 2^(i+1)) ns. */
+static inline unsigned instr_bucket(uint64_t ns)
+{
+    unsigned bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    return bucket < LIST_LATENCY_BUCKETS ? bucket : LIST_LATENCY_BUCKETS - 1;
+}
+
+
+uint64_t list_instrNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+int list_instrInit(sList* l)
+{
+    sListInstr* instr = (sListInstr*) calloc(1, sizeof(sListInstr));
+    if (!instr) {
+        return -1;
+    }
+    instr->list = l;
+    l->instr = instr;
+
+    pthread_mutex_lock(&instr_registryMutex);
+    instr->next = instr_registry;
+    if (instr_registry) {
+        instr_registry->prev = instr;
+    }
+    instr_registry = instr;
+    pthread_mutex_unlock(&instr_registryMutex);
+    return 0;
+}
+
+void list_instrDestroy(sList* l)
+{
+    sListInstr* instr = l->instr;
+
+    pthread_mutex_lock(&instr_registryMutex);
+    if (instr->prev) {
+        instr->prev->next = instr->next;
+    } else {
+        instr_registry = instr->next;
+    }
+    if (instr->next) {
+        instr->next->prev = instr->prev;
+    }
+    pthread_mutex_unlock(&instr_registryMutex);
+    free(instr);
+    l->instr = NULL;
+}
+
+/*
+ * Takes the lock of 'l', exclusive unless 'shared' is set, and records how
+ * long it took.
+ */
+void list_instrLock(sList* l, int shared)
+{
+    sListInstr* instr = l->instr;
+    int busy;
+
+    if (l->isThreadsafe == LIST_THREADSAFE) {
+        busy = pthread_mutex_trylock(&l->mutex) != 0;
+    } else if (shared) {
+        busy = pthread_rwlock_tryrdlock(&l->rwlock) != 0;
+    } else {
+        busy = pthread_rwlock_trywrlock(&l->rwlock) != 0;
+    }
+    uint64_t now = list_instrNow();
+    if (busy) {
+        if (l->isThreadsafe == LIST_THREADSAFE) {
+            pthread_mutex_lock(&l->mutex);
+        } else if (shared) {
+            pthread_rwlock_rdlock(&l->rwlock);
+        } else {
+            pthread_rwlock_wrlock(&l->rwlock);
+        }
+        uint64_t waited = list_instrNow() - now;
+        now += waited;
+        instr_add(&instr->stats.lockContended, 1);
+        instr_add(&instr->stats.lockWaitNs, waited);
+        instr_max(&instr->stats.lockWaitMaxNs, waited);
+    }
+    instr_add(&instr->stats.lockAcquired, 1);
+    if (!shared || l->isThreadsafe == LIST_THREADSAFE) {
+        instr->lockedAt = now;
+    }
+}
+
+/* Records the end of an exclusive hold of the lock of 'l'. */
+void list_instrHoldEnd(sList* l)
+{
+    sListInstr* instr = l->instr;
+
+    if (instr->lockedAt) {
+        uint64_t held = list_instrNow() - instr->lockedAt;
+        instr->lockedAt = 0;
+        instr_add(&instr->stats.lockHoldNs, held);
+        instr_max(&instr->stats.lockHoldMaxNs, held);
+    }
+}
+
+/* Records the start of an exclusive hold, after a condition variable wait. */
+void list_instrHoldStart(sList* l)
+{
+    l->instr->lockedAt = list_instrNow();
+}
+
+/* Records an operation of type 'op' which started at 'start'. */
+void list_instrOp(sList* l, eListOp op, uint64_t start)
+{
+    sListStatsOp* stats = &l->instr->stats.ops[op];
+    uint64_t ns = list_instrNow() - start;
+
+    instr_add(&stats->count, 1);
+    instr_add(&stats->totalNs, ns);
+    instr_add(&stats->latency[instr_bucket(ns)], 1);
+}
+
+/* Records the size of 'l' after elements were added. Called with 'l' locked. */
+void list_instrSize(sList* l)
+{
+    instr_max(&l->instr->stats.maxSize, l->size);
+}
+
+
+/** Names 'l' in the registry dump. Returns 0 on success, -1 on failure. */
+int list_setName(sList* l, const char* name)
+{
+    if (!l || !name || !l->instr) {
+        return -1;
+    }
+    pthread_mutex_lock(&instr_registryMutex);
+    strncpy(l->instr->name, name, LIST_NAME_MAX - 1);
+    pthread_mutex_unlock(&instr_registryMutex);
+    return 0;
+}
+
+/** Copies the instrumentation counters of 'l' to 'stats'. */
+int list_getStats(sList* l, sListOpStats* stats)
+{
+    if (!l || !stats || !l->instr) {
+        return -1;
+    }
+    const uint64_t* src = (const uint64_t*) &l->instr->stats;
+    uint64_t* dst = (uint64_t*) stats;
+    for (size_t i = 0; i < sizeof(sListOpStats) / sizeof(uint64_t); i++) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/* Upper bound of the bucket holding the 'pct' percentile of 'op'. */
+static uint64_t instr_percentile(const sListStatsOp* op, unsigned pct)
+{
+    uint64_t rank = (op->count * pct + 99) / 100;
+    uint64_t seen = 0;
+
+    if (op->count == 0) {
+        return 0;
+    }
+    for (unsigned i = 0; i < LIST_LATENCY_BUCKETS; i++) {
+        seen += op->latency[i];
+        if (seen >= rank) {
+            return 2ULL << i;
+        }
+    }
+    return 0;
+}
+
+static void instr_printName(FILE* out, const char* name)
+{
+    fputc('"', out);
+    for (const char* c = name; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char) *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Writes the counters of every live list to 'out' as one JSON object.
+ * Returns 0 on success, -1 on failure.
+ */
+int list_dumpStatsJson(FILE* out)
+{
+    sListOpStats stats;
+
+    if (!out) {
+        return -1;
+    }
+    pthread_mutex_lock(&instr_registryMutex);
+    fprintf(out, "{\"lists\":[");
+    for (sListInstr* instr = instr_registry; instr; instr = instr->next) {
+        list_getStats(instr->list, &stats);
+        fprintf(out, "%s{\"name\":", instr == instr_registry ? "" : ",");
+        instr_printName(out, instr->name);
+        fprintf(out, ",\"address\":\"%p\",\"threadAlt\":%d,\"maxSize\":%llu,",
+                (void*) instr->list, (int) instr->list->isThreadsafe,
+                (unsigned long long) stats.maxSize);
+        fprintf(out, "\"lock\":{\"acquired\":%llu,\"contended\":%llu,"
+                "\"waitNs\":%llu,\"waitMaxNs\":%llu,\"holdNs\":%llu,"
+                "\"holdMaxNs\":%llu},\"ops\":{",
+                (unsigned long long) stats.lockAcquired,
+                (unsigned long long) stats.lockContended,
+                (unsigned long long) stats.lockWaitNs,
+                (unsigned long long) stats.lockWaitMaxNs,
+                (unsigned long long) stats.lockHoldNs,
+                (unsigned long long) stats.lockHoldMaxNs);
+        for (int op = 0; op < LIST_OP_COUNT; op++) {
+            const sListStatsOp* s = &stats.ops[op];
+            fprintf(out, "%s\"%s\":{\"count\":%llu,\"totalNs\":%llu,"
+                    "\"p50Ns\":%llu,\"p99Ns\":%llu,\"histogram\":[",
+                    op ? "," : "", instr_opNames[op],
+                    (unsigned long long) s->count,
+                    (unsigned long long) s->totalNs,
+                    (unsigned long long) instr_percentile(s, 50),
+                    (unsigned long long) instr_percentile(s, 99));
+            for (int i = 0; i < LIST_LATENCY_BUCKETS; i++) {
+                fprintf(out, "%s%llu", i ? "," : "",
+                        (unsigned long long) s->latency[i]);
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "}}");
+    }
+    fprintf(out, "]}\n");
+    pthread_mutex_unlock(&instr_registryMutex);
+    return ferror(out) ? -1 : 0;
+}
+
+#else /* LIST_INSTRUMENT */
+
+int list_setName(sList* l, const char* name)
+{
+    (void) l;
+    (void) name;
+    return -1;
+}
+
+int list_getStats(sList* l, sListOpStats* stats)
+{
+    (void) l;
+    (void) stats;
+    return -1;
+}
+
+int list_dumpStatsJson(FILE* out)
+{
+    (void) out;
+    return -1;
+}
+
+#endif /* LIST_INSTRUMENT */
@@ -0,0 +1,189 @@
+#ifndef LIST_INTERNAL_H_
+#define LIST_INTERNAL_H_
+
+/*-----------------------------------------------------------------------
+ * Declarations shared between the translation units implementing sList.
+ * Not part of the public interface, see u_list.h for that.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list.h"
+#include <stdint.h>
+
+/* Nodes per slab when no slab size is given. */
+#define LIST_DEFAULT_SLAB_SIZE  64
+
+/* A slab of nodes. The nodes follow the header in the same allocation. */
+typedef struct sListSlabT {
+    struct sListSlabT* next;  /* Next slab owned by the same pool. */
+    size_t count;             /* Number of nodes in this slab. */
+} sListSlab;
+
+/* Elements per chunk of an unrolled list, fills four cache lines. */
+#define LIST_CHUNK_ITEMS        29
+
+struct sListChunkT {
+    struct sListChunkT* prev;
+    struct sListChunkT* next;
+    uint32_t begin;             /* First used item. */
+    uint32_t end;               /* One past the last used item. */
+    void* items[LIST_CHUNK_ITEMS];
+};
+
+static inline int list_isLockFree(const sList* l)
+{
+    return l->isThreadsafe == LIST_LOCKFREE_MPSC ||
+           l->isThreadsafe == LIST_LOCKFREE_MPMC;
+}
+
+/*
+ * Lock-free queue backend, u_list_lockfree.cc. Used instead of head/tail and
+ * the node pool by lists created as LIST_LOCKFREE_MPSC or LIST_LOCKFREE_MPMC.
+ */
+int list_lockfreeInit(sList* l, size_t slabSize);
+void list_lockfreeDestroy(sList* l);
+int list_lockfreePushBack(sList* l, void* data);
+int list_lockfreePushBackN(sList* l, void** items, size_t n);
+void* list_lockfreePopFront(sList* l);
+void* list_lockfreePeekFront(sList* l);
+void list_lockfreeStats(sList* l, sListStats* stats);
+
+/*
+ * Hash index, u_list_hash.cc. Kept in sync by the node link/unlink helpers
+ * of lists created with sListAttr::hashIndex.
+ */
+int list_indexInit(sList* l);
+void list_indexDestroy(sList* l);
+int list_indexReserve(sList* l, size_t count);
+int list_indexInsert(sList* l, sListNode* node);
+void list_indexRemove(sList* l, sListNode* node);
+sListNode* list_indexFind(sList* l, void* data);
+void list_indexClear(sList* l);
+
+/*
+ * Takes a node from, or returns one to, 'pool', u_list.cc. Called with the
+ * owning list locked.
+ */
+sListNode* list_poolGet(sListPool* pool);
+void list_poolPut(sListPool* pool, sListNode* node);
+
+/*
+ * Epoch-based reclamation, u_list_epoch.cc. list_unlinkNode() hands nodes to
+ * list_epochRetire() instead of the pool on lists with sListAttr::epochReclaim.
+ */
+int list_epochInit(sList* l);
+void list_epochDestroy(sList* l);
+void list_epochRetire(sList* l, sListNode* node);
+size_t list_epochPending(sList* l);
+
+/*
+ * Sharded lists, u_list_sharded.cc. The sub-lists are ordinary lists, so the
+ * sharded functions are called without holding any lock.
+ */
+int list_shardedInit(sList* l, const sListAttr* attr);
+void list_shardedDestroy(sList* l);
+int list_shardedPush(sList* l, void* data, int front);
+int list_shardedPushBackN(sList* l, void** items, size_t n);
+void* list_shardedPop(sList* l, int back);
+size_t list_shardedPopFrontN(sList* l, void** out, size_t max);
+void list_shardedClear(sList* l);
+int list_shardedFind(sList* l, void* el, int (*cmpFunc)(void* a, void* b),
+        int remove, void** found);
+int list_shardedForeach(sList* l, foreachFunc foreach, void* param);
+size_t list_shardedSize(sList* l);
+void list_shardedClose(sList* l);
+void list_shardedStats(sList* l, sListStats* stats);
+
+/*
+ * NUMA placement of pool slabs, u_list_numa.cc. list_numaNodes() returns the
+ * number of NUMA nodes, 1 when NUMA isn't available or the build lacks
+ * LIST_NUMA. list_numaBind() applies 'policy' to the untouched, page aligned
+ * range mem[0..len).
+ */
+int list_numaNodes(void);
+int list_numaBind(void* mem, size_t len, eListNumaPolicy policy, int node);
+
+/*
+ * Sorting, u_list_sort.cc. Lists shorter than LIST_SORT_PARALLEL_MIN are
+ * always sorted by the calling thread alone.
+ */
+#define LIST_SORT_PARALLEL_MIN  16384
+#define LIST_SORT_MAX_THREADS   64
+int list_sortLocked(sList* l, int (*cmpFunc)(void* a, void* b), unsigned threads);
+
+/*
+ * Worker pool, u_list_executor.cc. list_foreachParallel() gives each thread
+ * at least LIST_FOREACH_MIN_GRAIN elements at a time unless told otherwise.
+ */
+#define LIST_FOREACH_MIN_GRAIN  64
+void list_executorRun(sListExecutor* ex, void (*fn)(void*), void* arg,
+        unsigned helpers);
+
+/*
+ * Instrumentation, u_list_instr.cc. The LIST_OP() and LIST_INSTR_*() hooks
+ * compile to nothing unless LIST_INSTRUMENT is defined.
+ */
+#ifdef LIST_INSTRUMENT
+uint64_t list_instrNow(void);
+int list_instrInit(sList* l);
+void list_instrDestroy(sList* l);
+void list_instrLock(sList* l, int shared);
+void list_instrHoldEnd(sList* l);
+void list_instrHoldStart(sList* l);
+void list_instrOp(sList* l, eListOp op, uint64_t start);
+void list_instrSize(sList* l);
+
+/* Times the public call it is declared in, from there to the return. */
+class sListOpTimer {
+public:
+    sListOpTimer(sList* l, eListOp op) : l_(l), op_(op), start_(0)
+    {
+        if (l_->instr) {
+            start_ = list_instrNow();
+        }
+    }
+    ~sListOpTimer()
+    {
+        if (l_->instr) {
+            list_instrOp(l_, op_, start_);
+        }
+    }
+
+private:
+    sList* l_;
+    eListOp op_;
+    uint64_t start_;
+};
+
+#define LIST_OP(l, op)              sListOpTimer listOpTimer_((l), (op))
+#define LIST_INSTR_SIZE(l)          do { if ((l)->instr) list_instrSize(l); } while (0)
+#else
+#define LIST_OP(l, op)              do { } while (0)
+#define LIST_INSTR_SIZE(l)          do { } while (0)
+#endif
+
+/*
+ * Unrolled storage, u_list_unrolled.cc. Used instead of head/tail and the
+ * node pool by lists created with LIST_STORAGE_UNROLLED.
+ */
+int list_unrolledInit(sList* l);
+void list_unrolledDestroy(sList* l);
+int list_unrolledPushBack(sList* l, void* data);
+int list_unrolledPushFront(sList* l, void* data);
+void* list_unrolledPopFront(sList* l);
+void* list_unrolledPopBack(sList* l);
+void* list_unrolledPeekFront(sList* l);
+void* list_unrolledPeekBack(sList* l);
+void list_unrolledClear(sList* l);
+int list_unrolledFind(sList* l, void* el, int (*cmpFunc)(void* a, void* b),
+        int remove, void** found);
+int list_unrolledForeach(sList* l, foreachFunc foreach, void* param);
+void list_unrolledCat(sList* dest, sList* src);
+void list_unrolledStats(sList* l, sListStats* stats);
+int list_unrolledInsertSorted(sList* l, void* data,
+        int (*cmpFunc)(void* a, void* b));
+void list_unrolledCopyOut(sList* l, void** items);
+void list_unrolledCopyIn(sList* l, void* const* items);
+void list_unrolledCursorInit(sListCursor* cur);
+size_t list_unrolledCursorNextBlock(sListCursor* cur, void* const** items);
+
+#endif /* LIST_INTERNAL_H_ */
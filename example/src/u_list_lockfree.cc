@@ -0,0 +1,360 @@
+
+/*-----------------------------------------------------------------------
+ * Lock-free queue backend for sList (LIST_LOCKFREE_MPSC/LIST_LOCKFREE_MPMC).
+ *
+ * Both modes keep a dummy node at the head of the queue, so that producers
+ * only ever touch the tail and consumers only the head.
+ *
+ * MPSC: producers swap themselves in as the new tail with one atomic exchange
+ * and then link the previous tail to their node. The single consumer follows
+ * head->next and never needs a CAS.
+ *
+ * MPMC: Michael & Scott's queue. Head, tail and the node next pointers are
+ * tagged with a modification counter in the upper 16 bits (user space
+ * pointers fit in 48 bits), which protects the CAS operations against ABA
+ * when a node is recycled while another thread still looks at it.
+ *
+ * Nodes come from a private free-list, a Treiber stack with a tagged top,
+ * linked through the node prev pointer (unused by the queue). Slabs are only
+ * freed when the list is destroyed, so a node read by a thread which lost a
+ * race is always valid memory.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LF_PTR_BITS     48
+#define LF_PTR_MASK     ((((uint64_t) 1) << LF_PTR_BITS) - 1)
+#define LF_CACHE_LINE   64
+
+struct sListLockFreeT {
+    alignas(LF_CACHE_LINE) uint64_t head;  /* Tagged dummy node, consumers. */
+    alignas(LF_CACHE_LINE) uint64_t tail;  /* Tagged last node, producers. */
+    alignas(LF_CACHE_LINE) uint64_t freeTop; /* Tagged top of the free-list. */
+    sListSlab* slabs;                      /* All slabs, pushed atomically. */
+    size_t slabSize;                       /* Nodes allocated per slab. */
+    size_t total;                          /* Nodes owned by the list. */
+    size_t inUse;                          /* Nodes not on the free-list. */
+    size_t highWater;                      /* Max value 'inUse' has had. */
+};
+
+static inline sListNode* lf_ptr(uint64_t v)
+{
+    return (sListNode*) (uintptr_t) (v & LF_PTR_MASK);
+}
+
+static inline uint64_t lf_tag(uint64_t v)
+{
+    return v >> LF_PTR_BITS;
+}
+
+static inline uint64_t lf_pack(sListNode* p, uint64_t tag)
+{
+    return (uint64_t) (uintptr_t) p | (tag << LF_PTR_BITS);
+}
+
+static inline int lf_cas(uint64_t* p, uint64_t* expected, uint64_t desired)
+{
+    return __atomic_compare_exchange_n(p, expected, desired, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* The MPMC next pointers carry a tag too, stored in the pointer field. */
+static inline uint64_t lf_loadNext(sListNode* node)
+{
+    return (uint64_t) (uintptr_t) __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+}
+
+static inline int lf_casNext(sListNode* node, uint64_t* expected, uint64_t desired)
+{
+    sListNode* exp = (sListNode*) (uintptr_t) *expected;
+    int ok = __atomic_compare_exchange_n(&node->next, &exp,
+            (sListNode*) (uintptr_t) desired, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    *expected = (uint64_t) (uintptr_t) exp;
+    return ok;
+}
+
+/* Pushes the chain first..last, linked through prev, onto the free-list. */
+static void lf_freePush(sListLockFree* lf, sListNode* first, sListNode* last)
+{
+    uint64_t top = __atomic_load_n(&lf->freeTop, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&last->prev, lf_ptr(top), __ATOMIC_RELAXED);
+    } while (!lf_cas(&lf->freeTop, &top, lf_pack(first, lf_tag(top) + 1)));
+}
+
+static int lf_grow(sListLockFree* lf)
+{
+    sListSlab* slab = (sListSlab*) malloc(sizeof(sListSlab) +
+            lf->slabSize * sizeof(sListNode));
+    if (!slab) {
+        return -1;
+    }
+    slab->count = lf->slabSize;
+
+    sListNode* nodes = (sListNode*) (slab + 1);
+    for (size_t i = 0; i < slab->count; i++) {
+        nodes[i].data = NULL;
+        nodes[i].next = NULL;
+        nodes[i].prev = i + 1 < slab->count ? &nodes[i + 1] : NULL;
+    }
+
+    slab->next = __atomic_load_n(&lf->slabs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&lf->slabs, &slab->next, slab, false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    __atomic_add_fetch(&lf->total, slab->count, __ATOMIC_RELAXED);
+    lf_freePush(lf, &nodes[0], &nodes[slab->count - 1]);
+    return 0;
+}
+
+static sListNode* lf_alloc(sListLockFree* lf)
+{
+    uint64_t top = __atomic_load_n(&lf->freeTop, __ATOMIC_ACQUIRE);
+    sListNode* node;
+
+    for (;;) {
+        node = lf_ptr(top);
+        if (!node) {
+            if (lf_grow(lf) != 0) {
+                return NULL;
+            }
+            top = __atomic_load_n(&lf->freeTop, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        sListNode* next = __atomic_load_n(&node->prev, __ATOMIC_RELAXED);
+        if (lf_cas(&lf->freeTop, &top, lf_pack(next, lf_tag(top) + 1))) {
+            break;
+        }
+    }
+
+    size_t inUse = __atomic_add_fetch(&lf->inUse, 1, __ATOMIC_RELAXED);
+    size_t high = __atomic_load_n(&lf->highWater, __ATOMIC_RELAXED);
+    while (inUse > high && !__atomic_compare_exchange_n(&lf->highWater, &high,
+                inUse, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return node;
+}
+
+static void lf_free(sListLockFree* lf, sListNode* node)
+{
+    __atomic_sub_fetch(&lf->inUse, 1, __ATOMIC_RELAXED);
+    lf_freePush(lf, node, node);
+}
+
+
+int list_lockfreeInit(sList* l, size_t slabSize)
+{
+    void* mem;
+    if (posix_memalign(&mem, LF_CACHE_LINE, sizeof(sListLockFree)) != 0) {
+        return -1;
+    }
+    sListLockFree* lf = (sListLockFree*) mem;
+    memset(lf, 0, sizeof(sListLockFree));
+    lf->slabSize = slabSize ? slabSize : LIST_DEFAULT_SLAB_SIZE;
+
+    sListNode* dummy = lf_alloc(lf);
+    if (!dummy) {
+        free(lf);
+        return -1;
+    }
+    dummy->next = NULL;
+    lf->head = lf->tail = lf_pack(dummy, 0);
+    l->lockfree = lf;
+    return 0;
+}
+
+/* Not thread-safe, no other thread may use the list any longer. */
+void list_lockfreeDestroy(sList* l)
+{
+    sListLockFree* lf = l->lockfree;
+    void* data;
+
+    while ((data = list_lockfreePopFront(l)) != NULL) {
+        if (l->destroyFunc) {
+            l->destroyFunc(data);
+        }
+    }
+    sListSlab* slab = lf->slabs;
+    while (slab) {
+        sListSlab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    free(lf);
+    l->lockfree = NULL;
+}
+
+/* Fails for NULL, which list_lockfreePopFront() uses to mean empty. */
+int list_lockfreePushBack(sList* l, void* data)
+{
+    sListLockFree* lf = l->lockfree;
+    if (!data) {
+        return -1;
+    }
+    sListNode* node = lf_alloc(lf);
+    if (!node) {
+        return -1;
+    }
+    __atomic_store_n(&node->data, data, __ATOMIC_RELAXED);
+
+    /*
+     * Counted before the node is published: the release of the link orders
+     * this before the decrement of whoever pops it, so the size never wraps.
+     */
+    __atomic_add_fetch(&l->size, 1, __ATOMIC_RELAXED);
+    if (l->isThreadsafe == LIST_LOCKFREE_MPSC) {
+        __atomic_store_n(&node->next, (sListNode*) NULL, __ATOMIC_RELAXED);
+        uint64_t prev = __atomic_exchange_n(&lf->tail, lf_pack(node, 0),
+                __ATOMIC_ACQ_REL);
+        __atomic_store_n(&lf_ptr(prev)->next, node, __ATOMIC_RELEASE);
+    } else {
+        uint64_t next = lf_loadNext(node);
+        __atomic_store_n(&node->next,
+                (sListNode*) (uintptr_t) lf_pack(NULL, lf_tag(next)),
+                __ATOMIC_RELAXED);
+        uint64_t tail;
+        for (;;) {
+            tail = __atomic_load_n(&lf->tail, __ATOMIC_ACQUIRE);
+            next = lf_loadNext(lf_ptr(tail));
+            if (tail != __atomic_load_n(&lf->tail, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            if (!lf_ptr(next)) {
+                if (lf_casNext(lf_ptr(tail), &next,
+                            lf_pack(node, lf_tag(next) + 1))) {
+                    break;
+                }
+            } else {
+                /* Tail is lagging behind, help the other producer. */
+                lf_cas(&lf->tail, &tail, lf_pack(lf_ptr(next), lf_tag(tail) + 1));
+            }
+        }
+        lf_cas(&lf->tail, &tail, lf_pack(node, lf_tag(tail) + 1));
+    }
+    return 0;
+}
+
+/*
+ * MPSC lists link the nodes into a chain first and enqueue it with a single
+ * exchange. On MPMC lists the elements are pushed one at a time.
+ */
+int list_lockfreePushBackN(sList* l, void** items, size_t n)
+{
+    sListLockFree* lf = l->lockfree;
+
+    for (size_t i = 0; i < n; i++) {
+        if (!items[i]) {
+            return -1;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (l->isThreadsafe != LIST_LOCKFREE_MPSC) {
+        for (size_t i = 0; i < n; i++) {
+            if (list_lockfreePushBack(l, items[i]) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    sListNode* first = NULL;
+    sListNode* last = NULL;
+    for (size_t i = 0; i < n; i++) {
+        sListNode* node = lf_alloc(lf);
+        if (!node) {
+            while (first) {
+                sListNode* next = first->next;
+                lf_free(lf, first);
+                first = next;
+            }
+            return -1;
+        }
+        node->data = items[i];
+        node->next = NULL;
+        if (last) {
+            last->next = node;
+        } else {
+            first = node;
+        }
+        last = node;
+    }
+    __atomic_add_fetch(&l->size, n, __ATOMIC_RELAXED);
+    uint64_t prev = __atomic_exchange_n(&lf->tail, lf_pack(last, 0),
+            __ATOMIC_ACQ_REL);
+    __atomic_store_n(&lf_ptr(prev)->next, first, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void* list_lockfreePopFront(sList* l)
+{
+    sListLockFree* lf = l->lockfree;
+    sListNode* dummy;
+    void* data;
+
+    if (l->isThreadsafe == LIST_LOCKFREE_MPSC) {
+        dummy = lf_ptr(lf->head);
+        sListNode* next = __atomic_load_n(&dummy->next, __ATOMIC_ACQUIRE);
+        if (!next) {
+            return NULL;
+        }
+        data = next->data;
+        lf->head = lf_pack(next, 0);
+    } else {
+        for (;;) {
+            uint64_t head = __atomic_load_n(&lf->head, __ATOMIC_ACQUIRE);
+            uint64_t tail = __atomic_load_n(&lf->tail, __ATOMIC_ACQUIRE);
+            uint64_t next = lf_loadNext(lf_ptr(head));
+            if (head != __atomic_load_n(&lf->head, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            if (lf_ptr(head) == lf_ptr(tail)) {
+                if (!lf_ptr(next)) {
+                    return NULL;
+                }
+                lf_cas(&lf->tail, &tail, lf_pack(lf_ptr(next), lf_tag(tail) + 1));
+                continue;
+            }
+            data = __atomic_load_n(&lf_ptr(next)->data, __ATOMIC_RELAXED);
+            if (lf_cas(&lf->head, &head, lf_pack(lf_ptr(next), lf_tag(head) + 1))) {
+                dummy = lf_ptr(head);
+                break;
+            }
+        }
+    }
+    __atomic_sub_fetch(&l->size, 1, __ATOMIC_RELAXED);
+    lf_free(lf, dummy);
+    return data;
+}
+
+/* Only meaningful for MPSC lists, and only when called by the consumer. */
+void* list_lockfreePeekFront(sList* l)
+{
+    sListLockFree* lf = l->lockfree;
+    if (l->isThreadsafe != LIST_LOCKFREE_MPSC) {
+        return NULL;
+    }
+    sListNode* next = __atomic_load_n(&lf_ptr(lf->head)->next, __ATOMIC_ACQUIRE);
+    return next ? next->data : NULL;
+}
+
+void list_lockfreeStats(sList* l, sListStats* stats)
+{
+    sListLockFree* lf = l->lockfree;
+
+    stats->size = __atomic_load_n(&l->size, __ATOMIC_RELAXED);
+    stats->poolSize = __atomic_load_n(&lf->total, __ATOMIC_RELAXED);
+    stats->poolFree = stats->poolSize - __atomic_load_n(&lf->inUse, __ATOMIC_RELAXED);
+    stats->poolHighWater = __atomic_load_n(&lf->highWater, __ATOMIC_RELAXED);
+    stats->poolSlabs = 0;
+    stats->retired = 0;
+    for (sListSlab* slab = __atomic_load_n(&lf->slabs, __ATOMIC_ACQUIRE); slab;
+            slab = slab->next) {
+        stats->poolSlabs++;
+    }
+}
@@ -0,0 +1,77 @@
+
+/*-----------------------------------------------------------------------
+ * NUMA placement of node pool slabs, see eListNumaPolicy. Built against
+ * libnuma with -DLIST_NUMA; otherwise, and on hosts with a single node,
+ * there is nothing to place and every policy is first-touch.
+ *
+ * Slabs are allocated page aligned and bound with mbind() before the pool
+ * writes to them, so their pages are faulted in on the chosen node(s).
+ * MPOL_MF_MOVE also migrates pages which were already resident, in case
+ * the allocator hands out memory it touched before.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+
+#ifdef LIST_NUMA
+
+#include <numa.h>
+#include <numaif.h>
+
+/* Number of nodes, looked up on first use; 0 until then. */
+static int numa_nodeCount;
+
+int list_numaNodes(void)
+{
+    int count = __atomic_load_n(&numa_nodeCount, __ATOMIC_RELAXED);
+
+    if (count == 0) {
+        count = numa_available() < 0 ? 1 : numa_max_node() + 1;
+        __atomic_store_n(&numa_nodeCount, count, __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+int list_numaBind(void* mem, size_t len, eListNumaPolicy policy, int node)
+{
+    struct bitmask* nodes;
+    int mode;
+
+    if (list_numaNodes() < 2 || policy == LIST_NUMA_FIRST_TOUCH) {
+        return 0;
+    }
+    if (policy == LIST_NUMA_NODE) {
+        nodes = numa_allocate_nodemask();
+        if (!nodes) {
+            return -1;
+        }
+        numa_bitmask_setbit(nodes, (unsigned) node);
+        mode = MPOL_PREFERRED;
+    } else {
+        nodes = numa_all_nodes_ptr;
+        mode = MPOL_INTERLEAVE;
+    }
+    long ret = mbind(mem, len, mode, nodes->maskp, nodes->size + 1,
+            MPOL_MF_MOVE);
+    if (nodes != numa_all_nodes_ptr) {
+        numa_bitmask_free(nodes);
+    }
+    return ret == 0 ? 0 : -1;
+}
+
+#else /* LIST_NUMA */
+
+int list_numaNodes(void)
+{
+    return 1;
+}
+
+int list_numaBind(void* mem, size_t len, eListNumaPolicy policy, int node)
+{
+    (void) mem;
+    (void) len;
+    (void) policy;
+    (void) node;
+    return 0;
+}
+
+#endif /* LIST_NUMA */
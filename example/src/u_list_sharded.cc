@@ -0,0 +1,283 @@
+
+/*-----------------------------------------------------------------------
+ * Sharded lists, enabled with sListAttr::shards.
+ *
+ * The list is split into a number of ordinary locked sub-lists, each on its
+ * own cache line. Every thread is given a home shard the first time it uses
+ * a sharded list, round-robin, and pushes only to it, so producers running
+ * on different cores don't share a lock. Pops try the home shard first and
+ * otherwise steal from the others, starting with the next shard so that
+ * idle consumers spread out over the victims.
+ *
+ * Each shard keeps an element count next to its sub-list, updated with
+ * atomics after every push and pop. It lets pops skip empty shards without
+ * taking their locks, and list_size() add up the counts without locking.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SHARD_CACHE_LINE    64
+/* Upper limit for sListAttr::shards. */
+#define SHARD_MAX           1024
+
+typedef struct {
+    alignas(SHARD_CACHE_LINE) sList* list;
+    ssize_t count;              /* Elements in 'list', may lag behind. */
+} sListShard;
+
+struct sListShardsT {
+    sListShard* shards;
+    unsigned count;
+    int sharedPool;             /* 1 if all shards use one shared pool. */
+};
+
+/* Source of home shards, and the home shard of the calling thread plus 1. */
+static unsigned shard_nextHome;
+static __thread unsigned shard_home;
+
+static inline unsigned shard_homeIndex(sListShards* s)
+{
+    unsigned home = shard_home;
+    while (home == 0) {
+        home = __atomic_add_fetch(&shard_nextHome, 1, __ATOMIC_RELAXED);
+        shard_home = home;
+    }
+    return (home - 1) % s->count;
+}
+
+static inline void shard_add(sListShard* shard, ssize_t n)
+{
+    __atomic_add_fetch(&shard->count, n, __ATOMIC_RELAXED);
+}
+
+static inline int shard_isEmpty(sListShard* shard)
+{
+    return __atomic_load_n(&shard->count, __ATOMIC_RELAXED) <= 0;
+}
+
+
+int list_shardedInit(sList* l, const sListAttr* attr)
+{
+    sListAttr subAttr = *attr;
+    void* mem;
+
+    if (attr->shards > SHARD_MAX || (attr->threadAlt != LIST_THREADSAFE &&
+                attr->threadAlt != LIST_THREADSAFE_RW)) {
+        return -1;
+    }
+    sListShards* s = (sListShards*) calloc(1, sizeof(sListShards));
+    if (!s) {
+        return -1;
+    }
+    if (posix_memalign(&mem, SHARD_CACHE_LINE,
+                attr->shards * sizeof(sListShard)) != 0) {
+        free(s);
+        return -1;
+    }
+    memset(mem, 0, attr->shards * sizeof(sListShard));
+    s->shards = (sListShard*) mem;
+    s->sharedPool = attr->pool != NULL;
+    l->shards = s;
+
+    subAttr.shards = 0;
+    subAttr.epochReclaim = 0;
+    for (s->count = 0; s->count < attr->shards; s->count++) {
+        sList* sub = list_createAttr(l->destroyFunc, &subAttr);
+        if (!sub) {
+            list_shardedDestroy(l);
+            return -1;
+        }
+        s->shards[s->count].list = sub;
+    }
+    return 0;
+}
+
+/* Destroys all shards, calling destroyFunc on the remaining elements. */
+void list_shardedDestroy(sList* l)
+{
+    sListShards* s = l->shards;
+
+    for (unsigned i = 0; i < s->count; i++) {
+        list_destroy(s->shards[i].list);
+    }
+    free(s->shards);
+    free(s);
+    l->shards = NULL;
+}
+
+/*
+ * Pushes 'data' to the front or back of the calling thread's home shard.
+ * Fails for NULL, which list_shardedPop() uses to mean empty.
+ */
+int list_shardedPush(sList* l, void* data, int front)
+{
+    if (!data) {
+        return -1;
+    }
+    sListShard* shard = &l->shards->shards[shard_homeIndex(l->shards)];
+    int ret = front ? list_pushFront(shard->list, data)
+                    : list_pushBack(shard->list, data);
+    if (ret == 0) {
+        shard_add(shard, 1);
+    }
+    return ret;
+}
+
+int list_shardedPushBackN(sList* l, void** items, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (!items[i]) {
+            return -1;
+        }
+    }
+    sListShard* shard = &l->shards->shards[shard_homeIndex(l->shards)];
+    int ret = list_pushBackN(shard->list, items, n);
+    if (ret == 0) {
+        shard_add(shard, (ssize_t) n);
+    }
+    return ret;
+}
+
+/*
+ * Pops an element from the front or back of the home shard, or failing that
+ * from the first other non-empty shard. Returns NULL if all shards are empty.
+ */
+void* list_shardedPop(sList* l, int back)
+{
+    sListShards* s = l->shards;
+    unsigned home = shard_homeIndex(s);
+
+    for (unsigned n = 0; n < s->count; n++) {
+        sListShard* shard = &s->shards[(home + n) % s->count];
+        if (shard_isEmpty(shard)) {
+            continue;
+        }
+        void* data = back ? list_popBack(shard->list)
+                          : list_popFront(shard->list);
+        if (data) {
+            shard_add(shard, -1);
+            return data;
+        }
+    }
+    return NULL;
+}
+
+size_t list_shardedPopFrontN(sList* l, void** out, size_t max)
+{
+    sListShards* s = l->shards;
+    unsigned home = shard_homeIndex(s);
+    size_t total = 0;
+
+    for (unsigned n = 0; n < s->count && total < max; n++) {
+        sListShard* shard = &s->shards[(home + n) % s->count];
+        if (shard_isEmpty(shard)) {
+            continue;
+        }
+        size_t got = list_popFrontN(shard->list, out + total, max - total);
+        shard_add(shard, -(ssize_t) got);
+        total += got;
+    }
+    return total;
+}
+
+void list_shardedClear(sList* l)
+{
+    sListShards* s = l->shards;
+    void* items[64];
+    size_t n;
+
+    for (unsigned i = 0; i < s->count; i++) {
+        sListShard* shard = &s->shards[i];
+        while ((n = list_popFrontN(shard->list, items, 64)) > 0) {
+            shard_add(shard, -(ssize_t) n);
+            for (size_t j = 0; l->destroyFunc && j < n; j++) {
+                l->destroyFunc(items[j]);
+            }
+        }
+    }
+}
+
+/*
+ * Looks for 'el' in every shard, like list_find() with a 'cmpFunc', or by
+ * pointer like list_exists() without. If 'remove' is set the element is also
+ * removed. Returns 1 if an element was found, 0 otherwise.
+ */
+int list_shardedFind(sList* l, void* el, int (*cmpFunc)(void* a, void* b),
+        int remove, void** found)
+{
+    sListShards* s = l->shards;
+
+    for (unsigned i = 0; i < s->count; i++) {
+        sListShard* shard = &s->shards[i];
+        if (remove) {
+            if (list_remove(shard->list, el) == 0) {
+                shard_add(shard, -1);
+                return 1;
+            }
+        } else if (cmpFunc) {
+            void* data = list_find(shard->list, el, cmpFunc);
+            if (data) {
+                *found = data;
+                return 1;
+            }
+        } else if (list_exists(shard->list, el)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int list_shardedForeach(sList* l, foreachFunc foreach, void* param)
+{
+    sListShards* s = l->shards;
+
+    for (unsigned i = 0; i < s->count; i++) {
+        if (list_foreach(s->shards[i].list, foreach, param) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Sum of the shard counts; only approximate while other threads modify 'l'. */
+size_t list_shardedSize(sList* l)
+{
+    sListShards* s = l->shards;
+    ssize_t size = 0;
+
+    for (unsigned i = 0; i < s->count; i++) {
+        size += __atomic_load_n(&s->shards[i].count, __ATOMIC_RELAXED);
+    }
+    return size > 0 ? (size_t) size : 0;
+}
+
+void list_shardedClose(sList* l)
+{
+    sListShards* s = l->shards;
+
+    for (unsigned i = 0; i < s->count; i++) {
+        list_close(s->shards[i].list);
+    }
+}
+
+/* Adds up the stats of all shards; a shared pool is only counted once. */
+void list_shardedStats(sList* l, sListStats* stats)
+{
+    sListShards* s = l->shards;
+    sListStats sub;
+
+    memset(stats, 0, sizeof(sListStats));
+    for (unsigned i = 0; i < s->count; i++) {
+        list_stats(s->shards[i].list, &sub);
+        stats->size += sub.size;
+        stats->retired += sub.retired;
+        if (i == 0 || !s->sharedPool) {
+            stats->poolSize += sub.poolSize;
+            stats->poolFree += sub.poolFree;
+            stats->poolHighWater += sub.poolHighWater;
+            stats->poolSlabs += sub.poolSlabs;
+        }
+    }
+}
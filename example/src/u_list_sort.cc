@@ -0,0 +1,365 @@
+
+/*-----------------------------------------------------------------------
+ * Sorting for sList, list_sort() and list_sortParallel().
+ *
+ * Linked lists are sorted in place on their nodes, with the bottom-up scheme
+ * of merging runs of 1, 2, 4, ... nodes kept in a small array of bins, so no
+ * memory is allocated and every merge takes from the older run on ties,
+ * which makes the sort stable. The bins only use the next pointers; prev
+ * pointers, head and tail are rebuilt in one pass at the end.
+ *
+ * Unrolled lists, and linked lists sorted in parallel, are copied into an
+ * array of element or node pointers which is merge sorted and written back.
+ * Lists with epoch readers are sorted through the array too, but written
+ * back into new nodes: readers may be walking the old chain, whose next
+ * pointers must not change under them.
+ * In parallel mode the array is cut into one run per thread, the runs are
+ * sorted in parallel, and then merged pairwise, in parallel too, until one
+ * run is left.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Runs up to 2^SORT_BINS nodes long, plenty for any list in memory. */
+#define SORT_BINS           64
+/* Runs this short are sorted by insertion. */
+#define SORT_INSERTION_MAX  16
+
+typedef int (*sortCmpFunc)(void* a, void* b);
+
+/* Merges the runs 'a' and 'b', linked through next; 'a' wins ties. */
+static sListNode* sort_mergeRuns(sListNode* a, sListNode* b, sortCmpFunc cmp)
+{
+    sListNode head;
+    sListNode* tail = &head;
+
+    while (a && b) {
+        if (cmp(a->data, b->data) <= 0) {
+            tail->next = a;
+            a = a->next;
+        } else {
+            tail->next = b;
+            b = b->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = a ? a : b;
+    return head.next;
+}
+
+/*
+ * Rebuilds prev pointers, head and tail of 'l' from the chain 'first',
+ * linked through next. Called with 'l' locked.
+ */
+static void sort_relinkChain(sList* l, sListNode* first)
+{
+    sListNode* prev = NULL;
+
+    for (sListNode* cur = first; cur; cur = cur->next) {
+        cur->prev = prev;
+        prev = cur;
+    }
+    l->head = first;
+    l->tail = prev;
+}
+
+/* Sorts the nodes of 'l' in place, without allocating. */
+static void sort_nodes(sList* l, sortCmpFunc cmp)
+{
+    sListNode* bins[SORT_BINS] = { NULL };
+    sListNode* cur = l->head;
+    int used = 0;
+
+    while (cur) {
+        sListNode* run = cur;
+        cur = cur->next;
+        run->next = NULL;
+        int i;
+        for (i = 0; i < SORT_BINS - 1 && bins[i]; i++) {
+            run = sort_mergeRuns(bins[i], run, cmp);
+            bins[i] = NULL;
+        }
+        bins[i] = bins[i] ? sort_mergeRuns(bins[i], run, cmp) : run;
+        if (i >= used) {
+            used = i + 1;
+        }
+    }
+
+    sListNode* sorted = NULL;
+    for (int i = 0; i < used; i++) {
+        if (bins[i]) {
+            sorted = sorted ? sort_mergeRuns(bins[i], sorted, cmp) : bins[i];
+        }
+    }
+    sort_relinkChain(l, sorted);
+}
+
+/*
+ * Links the 'n' nodes of 'l' in the order of 'nodes'. Called with 'l' locked,
+ * and only on lists without epoch readers.
+ */
+static void sort_relinkArray(sList* l, sListNode** nodes, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        nodes[i]->prev = i > 0 ? nodes[i - 1] : NULL;
+        nodes[i]->next = i + 1 < n ? nodes[i + 1] : NULL;
+    }
+    l->head = n ? nodes[0] : NULL;
+    l->tail = n ? nodes[n - 1] : NULL;
+}
+
+/*
+ * Replaces the 'n' nodes of 'l', which has epoch readers, with new nodes
+ * carrying the same elements in the order of 'nodes'. The new chain is
+ * built off the list and published with one release store of head, so
+ * readers see either the old chain or the new one, both complete; the old
+ * nodes are retired. Returns 0 on success, -1 if out of memory, leaving
+ * 'l' unchanged. Called with 'l' locked.
+ */
+static int sort_replaceNodes(sList* l, sListNode** nodes, size_t n)
+{
+    sListNode* first = NULL;
+    sListNode* last = NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        sListNode* node = list_poolGet(l->pool);
+        if (!node) {
+            while (first) {
+                sListNode* next = first->next;
+                list_poolPut(l->pool, first);
+                first = next;
+            }
+            return -1;
+        }
+        node->data = nodes[i]->data;
+        node->next = NULL;
+        node->prev = last;
+        if (last) {
+            last->next = node;
+        } else {
+            first = node;
+        }
+        last = node;
+    }
+    __atomic_store_n(&l->head, first, __ATOMIC_RELEASE);
+    l->tail = last;
+    for (size_t i = 0; i < n; i++) {
+        list_epochRetire(l, nodes[i]);
+    }
+
+    /* The index points at the old nodes; the table has room for them all. */
+    if (l->index) {
+        list_indexClear(l);
+        for (sListNode* cur = first; cur; cur = cur->next) {
+            list_indexInsert(l, cur);
+        }
+    }
+    return 0;
+}
+
+/* Key of an array entry, the element itself or the data of a node. */
+static inline void* sort_key(void* entry, int byNode)
+{
+    return byNode ? ((sListNode*) entry)->data : entry;
+}
+
+/* Merges the sorted runs a[0..na) and b[0..nb) into 'out'; 'a' wins ties. */
+static void sort_mergeArrays(void** a, size_t na, void** b, size_t nb,
+        void** out, sortCmpFunc cmp, int byNode)
+{
+    size_t i = 0, j = 0, k = 0;
+
+    while (i < na && j < nb) {
+        if (cmp(sort_key(a[i], byNode), sort_key(b[j], byNode)) <= 0) {
+            out[k++] = a[i++];
+        } else {
+            out[k++] = b[j++];
+        }
+    }
+    memcpy(&out[k], &a[i], (na - i) * sizeof(void*));
+    k += na - i;
+    memcpy(&out[k], &b[j], (nb - j) * sizeof(void*));
+}
+
+/* Stable merge sort of items[0..n), using tmp[0..n) as scratch space. */
+static void sort_array(void** items, size_t n, void** tmp, sortCmpFunc cmp,
+        int byNode)
+{
+    if (n <= SORT_INSERTION_MAX) {
+        for (size_t i = 1; i < n; i++) {
+            void* item = items[i];
+            void* key = sort_key(item, byNode);
+            size_t j = i;
+            while (j > 0 && cmp(sort_key(items[j - 1], byNode), key) > 0) {
+                items[j] = items[j - 1];
+                j--;
+            }
+            items[j] = item;
+        }
+        return;
+    }
+    size_t mid = n / 2;
+    sort_array(items, mid, tmp, cmp, byNode);
+    sort_array(items + mid, n - mid, tmp + mid, cmp, byNode);
+    if (cmp(sort_key(items[mid - 1], byNode), sort_key(items[mid], byNode)) <= 0) {
+        return;
+    }
+    sort_mergeArrays(items, mid, items + mid, n - mid, tmp, cmp, byNode);
+    memcpy(items, tmp, n * sizeof(void*));
+}
+
+/* One run to sort, or two neighbouring runs to merge, of a parallel sort. */
+typedef struct {
+    void** src;
+    void** dst;                 /* Scratch space when sorting. */
+    size_t lo;
+    size_t mid;                 /* Start of the second run when merging. */
+    size_t hi;
+    int merge;
+    sortCmpFunc cmp;
+    int byNode;
+} sSortTask;
+
+static void* sort_task(void* arg)
+{
+    sSortTask* t = (sSortTask*) arg;
+
+    if (t->merge) {
+        sort_mergeArrays(t->src + t->lo, t->mid - t->lo, t->src + t->mid,
+                t->hi - t->mid, t->dst + t->lo, t->cmp, t->byNode);
+    } else {
+        sort_array(t->src + t->lo, t->hi - t->lo, t->dst + t->lo, t->cmp,
+                t->byNode);
+    }
+    return NULL;
+}
+
+/*
+ * Runs 'count' tasks, all but the first on threads of their own. Tasks whose
+ * thread can't be started are run by the calling thread.
+ */
+static void sort_runTasks(sSortTask* tasks, unsigned count)
+{
+    pthread_t threads[LIST_SORT_MAX_THREADS];
+    int started[LIST_SORT_MAX_THREADS];
+
+    for (unsigned i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, sort_task, &tasks[i]) == 0;
+        if (!started[i]) {
+            sort_task(&tasks[i]);
+        }
+    }
+    sort_task(&tasks[0]);
+    for (unsigned i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/*
+ * Sorts items[0..n) with up to 'threads' threads. Returns 0 on success, -1
+ * if out of memory.
+ */
+static int sort_parallel(void** items, size_t n, sortCmpFunc cmp,
+        unsigned threads, int byNode)
+{
+    sSortTask tasks[LIST_SORT_MAX_THREADS];
+    void** tmp = (void**) malloc((n ? n : 1) * sizeof(void*));
+
+    if (!tmp) {
+        return -1;
+    }
+    if (threads > LIST_SORT_MAX_THREADS) {
+        threads = LIST_SORT_MAX_THREADS;
+    }
+    if (threads < 2 || n < LIST_SORT_PARALLEL_MIN) {
+        sort_array(items, n, tmp, cmp, byNode);
+        free(tmp);
+        return 0;
+    }
+
+    /* Sort one run per thread, then merge neighbouring runs in rounds. */
+    size_t bounds[LIST_SORT_MAX_THREADS + 1];
+    unsigned runs = threads;
+    for (unsigned i = 0; i <= runs; i++) {
+        bounds[i] = n * i / runs;
+    }
+    for (unsigned i = 0; i < runs; i++) {
+        sSortTask t = { items, tmp, bounds[i], 0, bounds[i + 1], 0, cmp, byNode };
+        tasks[i] = t;
+    }
+    sort_runTasks(tasks, runs);
+
+    void** src = items;
+    void** dst = tmp;
+    while (runs > 1) {
+        unsigned merged = 0;
+        for (unsigned i = 0; i < runs; i += 2) {
+            size_t hi = i + 1 < runs ? bounds[i + 2] : bounds[i + 1];
+            size_t mid = i + 1 < runs ? bounds[i + 1] : hi;
+            sSortTask t = { src, dst, bounds[i], mid, hi, 1, cmp, byNode };
+            tasks[merged] = t;
+            bounds[merged++] = bounds[i];
+        }
+        bounds[merged] = n;
+        sort_runTasks(tasks, merged);
+        runs = merged;
+        void** swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != items) {
+        memcpy(items, src, n * sizeof(void*));
+    }
+    free(tmp);
+    return 0;
+}
+
+
+/*
+ * Sorts 'l' with up to 'threads' threads. Linked lists sorted by a single
+ * thread are sorted in place; lists with epoch readers are sorted through an
+ * array and get new nodes, so that readers never see a half merged chain.
+ * Returns 0 on success, -1 if out of memory. Called with 'l' locked.
+ */
+int list_sortLocked(sList* l, sortCmpFunc cmp, unsigned threads)
+{
+    size_t n = l->size;
+
+    if (n < 2) {
+        return 0;
+    }
+    if (!l->unrolled && !l->epoch && (threads < 2 || n < LIST_SORT_PARALLEL_MIN)) {
+        sort_nodes(l, cmp);
+        return 0;
+    }
+    void** items = (void**) malloc(n * sizeof(void*));
+    if (!items) {
+        return -1;
+    }
+    int ret;
+    if (l->unrolled) {
+        list_unrolledCopyOut(l, items);
+        ret = sort_parallel(items, n, cmp, threads, 0);
+        if (ret == 0) {
+            list_unrolledCopyIn(l, items);
+        }
+    } else {
+        size_t i = 0;
+        for (sListNode* cur = l->head; cur; cur = cur->next) {
+            items[i++] = cur;
+        }
+        ret = sort_parallel(items, n, cmp, threads, 1);
+        if (ret == 0 && l->epoch) {
+            ret = sort_replaceNodes(l, (sListNode**) items, n);
+        } else if (ret == 0) {
+            sort_relinkArray(l, (sListNode**) items, n);
+        }
+    }
+    free(items);
+    return ret;
+}
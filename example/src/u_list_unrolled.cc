@@ -0,0 +1,409 @@
+
+/*-----------------------------------------------------------------------
+ * Unrolled storage backend for sList (LIST_STORAGE_UNROLLED).
+ *
+ * Elements are kept in chunks holding an array of up to LIST_CHUNK_ITEMS
+ * element pointers, used in the range [begin, end). Pushing at the back fills
+ * the tail chunk upwards and pushing at the front fills the head chunk
+ * downwards, so a list used as a queue or a stack never moves elements.
+ * Removing from the middle closes the gap inside its chunk and merges the
+ * chunk with its successor once both fit in one.
+ *
+ * Emptied chunks are kept on a spare list and reused, like the nodes of the
+ * linked storage. All functions are called with the list locked.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct sListUnrolledT {
+    sListChunk* head;       /* First chunk, NULL if the list is empty. */
+    sListChunk* tail;       /* Last chunk. */
+    sListChunk* spare;      /* Unused chunks, linked through next. */
+    size_t total;           /* Chunks allocated, in use or spare. */
+    size_t inUse;           /* Chunks linked into the list. */
+    size_t highWater;       /* Max value 'inUse' has had. */
+};
+
+static sListChunk* chunk_get(sListUnrolled* u)
+{
+    sListChunk* chunk = u->spare;
+    if (chunk) {
+        u->spare = chunk->next;
+    } else {
+        chunk = (sListChunk*) malloc(sizeof(sListChunk));
+        if (!chunk) {
+            return NULL;
+        }
+        u->total++;
+    }
+    if (++u->inUse > u->highWater) {
+        u->highWater = u->inUse;
+    }
+    return chunk;
+}
+
+static void chunk_unlink(sListUnrolled* u, sListChunk* chunk)
+{
+    if (chunk->prev) {
+        chunk->prev->next = chunk->next;
+    } else {
+        u->head = chunk->next;
+    }
+    if (chunk->next) {
+        chunk->next->prev = chunk->prev;
+    } else {
+        u->tail = chunk->prev;
+    }
+    chunk->next = u->spare;
+    u->spare = chunk;
+    u->inUse--;
+}
+
+/* Removes item 'i' of 'chunk', closing the gap and merging chunks. */
+static void chunk_removeAt(sList* l, sListChunk* chunk, uint32_t i)
+{
+    sListUnrolled* u = l->unrolled;
+
+    memmove(&chunk->items[i], &chunk->items[i + 1],
+            (chunk->end - i - 1) * sizeof(void*));
+    chunk->end--;
+    l->size--;
+
+    if (chunk->begin == chunk->end) {
+        chunk_unlink(u, chunk);
+        return;
+    }
+    sListChunk* next = chunk->next;
+    uint32_t count = chunk->end - chunk->begin;
+    uint32_t nextCount = next ? next->end - next->begin : 0;
+    if (next && count + nextCount <= LIST_CHUNK_ITEMS / 2) {
+        memmove(&chunk->items[0], &chunk->items[chunk->begin],
+                count * sizeof(void*));
+        memcpy(&chunk->items[count], &next->items[next->begin],
+                nextCount * sizeof(void*));
+        chunk->begin = 0;
+        chunk->end = count + nextCount;
+        chunk_unlink(u, next);
+    }
+}
+
+
+int list_unrolledInit(sList* l)
+{
+    l->unrolled = (sListUnrolled*) calloc(1, sizeof(sListUnrolled));
+    return l->unrolled ? 0 : -1;
+}
+
+void list_unrolledDestroy(sList* l)
+{
+    sListUnrolled* u = l->unrolled;
+
+    list_unrolledClear(l);
+    while (u->spare) {
+        sListChunk* next = u->spare->next;
+        free(u->spare);
+        u->spare = next;
+    }
+    free(u);
+    l->unrolled = NULL;
+}
+
+int list_unrolledPushBack(sList* l, void* data)
+{
+    sListUnrolled* u = l->unrolled;
+    sListChunk* chunk = u->tail;
+
+    if (!chunk || chunk->end == LIST_CHUNK_ITEMS) {
+        chunk = chunk_get(u);
+        if (!chunk) {
+            return -1;
+        }
+        chunk->begin = chunk->end = 0;
+        chunk->next = NULL;
+        chunk->prev = u->tail;
+        if (u->tail) {
+            u->tail->next = chunk;
+        } else {
+            u->head = chunk;
+        }
+        u->tail = chunk;
+    }
+    chunk->items[chunk->end++] = data;
+    l->size++;
+    return 0;
+}
+
+int list_unrolledPushFront(sList* l, void* data)
+{
+    sListUnrolled* u = l->unrolled;
+    sListChunk* chunk = u->head;
+
+    if (!chunk || chunk->begin == 0) {
+        chunk = chunk_get(u);
+        if (!chunk) {
+            return -1;
+        }
+        chunk->begin = chunk->end = LIST_CHUNK_ITEMS;
+        chunk->prev = NULL;
+        chunk->next = u->head;
+        if (u->head) {
+            u->head->prev = chunk;
+        } else {
+            u->tail = chunk;
+        }
+        u->head = chunk;
+    }
+    chunk->items[--chunk->begin] = data;
+    l->size++;
+    return 0;
+}
+
+void* list_unrolledPopFront(sList* l)
+{
+    sListChunk* chunk = l->unrolled->head;
+    if (!chunk) {
+        return NULL;
+    }
+    void* data = chunk->items[chunk->begin++];
+    l->size--;
+    if (chunk->begin == chunk->end) {
+        chunk_unlink(l->unrolled, chunk);
+    }
+    return data;
+}
+
+void* list_unrolledPopBack(sList* l)
+{
+    sListChunk* chunk = l->unrolled->tail;
+    if (!chunk) {
+        return NULL;
+    }
+    void* data = chunk->items[--chunk->end];
+    l->size--;
+    if (chunk->begin == chunk->end) {
+        chunk_unlink(l->unrolled, chunk);
+    }
+    return data;
+}
+
+void* list_unrolledPeekFront(sList* l)
+{
+    sListChunk* chunk = l->unrolled->head;
+    return chunk ? chunk->items[chunk->begin] : NULL;
+}
+
+void* list_unrolledPeekBack(sList* l)
+{
+    sListChunk* chunk = l->unrolled->tail;
+    return chunk ? chunk->items[chunk->end - 1] : NULL;
+}
+
+void list_unrolledClear(sList* l)
+{
+    sListUnrolled* u = l->unrolled;
+
+    while (u->head) {
+        sListChunk* chunk = u->head;
+        if (l->destroyFunc) {
+            for (uint32_t i = chunk->begin; i < chunk->end; i++) {
+                l->destroyFunc(chunk->items[i]);
+            }
+        }
+        chunk_unlink(u, chunk);
+    }
+    l->size = 0;
+}
+
+/*
+ * Returns the first element for which 'cmpFunc' returns 0, or with 'cmpFunc'
+ * NULL, the first element equal to 'el'. If 'remove' is set the element is
+ * also removed. Returns 1 if an element was found, 0 otherwise.
+ */
+int list_unrolledFind(sList* l, void* el, int (*cmpFunc)(void* a, void* b),
+        int remove, void** found)
+{
+    for (sListChunk* chunk = l->unrolled->head; chunk; chunk = chunk->next) {
+        if (chunk->next) {
+            __builtin_prefetch(chunk->next);
+        }
+        for (uint32_t i = chunk->begin; i < chunk->end; i++) {
+            void* data = chunk->items[i];
+            if (cmpFunc ? cmpFunc(data, el) == 0 : data == el) {
+                if (found) {
+                    *found = data;
+                }
+                if (remove) {
+                    chunk_removeAt(l, chunk, i);
+                }
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int list_unrolledForeach(sList* l, foreachFunc foreach, void* param)
+{
+    for (sListChunk* chunk = l->unrolled->head; chunk; chunk = chunk->next) {
+        if (chunk->next) {
+            __builtin_prefetch(chunk->next);
+        }
+        for (uint32_t i = chunk->begin; i < chunk->end; i++) {
+            if (!foreach(chunk->items[i], param)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Moves all chunks of 'src' to the end of 'dest', leaving 'src' empty. */
+void list_unrolledCat(sList* dest, sList* src)
+{
+    sListUnrolled* d = dest->unrolled;
+    sListUnrolled* s = src->unrolled;
+
+    if (s->head) {
+        s->head->prev = d->tail;
+        if (d->tail) {
+            d->tail->next = s->head;
+        } else {
+            d->head = s->head;
+        }
+        d->tail = s->tail;
+        d->inUse += s->inUse;
+        d->total += s->inUse;
+        if (d->inUse > d->highWater) {
+            d->highWater = d->inUse;
+        }
+        dest->size += src->size;
+    }
+    s->total -= s->inUse;
+    s->inUse = 0;
+    s->head = s->tail = NULL;
+    src->size = 0;
+}
+
+/*
+ * Inserts 'data' after the last element not greater than it according to
+ * 'cmpFunc'. A full chunk is split in two to make room. Returns 0 on
+ * success, -1 on failure.
+ */
+int list_unrolledInsertSorted(sList* l, void* data,
+        int (*cmpFunc)(void* a, void* b))
+{
+    sListUnrolled* u = l->unrolled;
+    sListChunk* chunk;
+    uint32_t i = 0;
+
+    for (chunk = u->head; chunk; chunk = chunk->next) {
+        if (cmpFunc(chunk->items[chunk->end - 1], data) > 0) {
+            for (i = chunk->begin; cmpFunc(chunk->items[i], data) <= 0; i++) {
+            }
+            break;
+        }
+    }
+    if (!chunk) {
+        return list_unrolledPushBack(l, data);
+    }
+    if (i == chunk->begin && chunk->begin > 0) {
+        chunk->items[--chunk->begin] = data;
+        l->size++;
+        return 0;
+    }
+    if (chunk->end - chunk->begin == LIST_CHUNK_ITEMS) {
+        /* Full, move the upper half to a new chunk after this one. */
+        sListChunk* next = chunk_get(u);
+        if (!next) {
+            return -1;
+        }
+        uint32_t half = LIST_CHUNK_ITEMS / 2;
+        memcpy(&next->items[0], &chunk->items[half],
+                (LIST_CHUNK_ITEMS - half) * sizeof(void*));
+        next->begin = 0;
+        next->end = LIST_CHUNK_ITEMS - half;
+        chunk->end = half;
+        next->prev = chunk;
+        next->next = chunk->next;
+        if (chunk->next) {
+            chunk->next->prev = next;
+        } else {
+            u->tail = next;
+        }
+        chunk->next = next;
+        if (i >= half) {
+            chunk = next;
+            i -= half;
+        }
+    }
+    if (chunk->end == LIST_CHUNK_ITEMS) {
+        /* Room at the front only, shift the items before 'i' down. */
+        memmove(&chunk->items[chunk->begin - 1], &chunk->items[chunk->begin],
+                (i - chunk->begin) * sizeof(void*));
+        chunk->begin--;
+        i--;
+    } else {
+        memmove(&chunk->items[i + 1], &chunk->items[i],
+                (chunk->end - i) * sizeof(void*));
+        chunk->end++;
+    }
+    chunk->items[i] = data;
+    l->size++;
+    return 0;
+}
+
+/* Copies all elements of 'l', in order, to 'items'. */
+void list_unrolledCopyOut(sList* l, void** items)
+{
+    for (sListChunk* chunk = l->unrolled->head; chunk; chunk = chunk->next) {
+        uint32_t count = chunk->end - chunk->begin;
+        memcpy(items, &chunk->items[chunk->begin], count * sizeof(void*));
+        items += count;
+    }
+}
+
+/* Overwrites the elements of 'l', in order, with those in 'items'. */
+void list_unrolledCopyIn(sList* l, void* const* items)
+{
+    for (sListChunk* chunk = l->unrolled->head; chunk; chunk = chunk->next) {
+        uint32_t count = chunk->end - chunk->begin;
+        memcpy(&chunk->items[chunk->begin], items, count * sizeof(void*));
+        items += count;
+    }
+}
+
+void list_unrolledStats(sList* l, sListStats* stats)
+{
+    sListUnrolled* u = l->unrolled;
+
+    stats->size = l->size;
+    stats->poolSize = u->total;
+    stats->poolFree = u->total - u->inUse;
+    stats->poolHighWater = u->highWater;
+    stats->poolSlabs = u->total;
+    stats->retired = 0;
+}
+
+void list_unrolledCursorInit(sListCursor* cur)
+{
+    cur->chunk = cur->list->unrolled->head;
+    cur->pos = cur->chunk ? cur->chunk->begin : 0;
+}
+
+size_t list_unrolledCursorNextBlock(sListCursor* cur, void* const** items)
+{
+    sListChunk* chunk = cur->chunk;
+    if (!chunk) {
+        return 0;
+    }
+    if (chunk->next) {
+        __builtin_prefetch(chunk->next);
+    }
+    *items = &chunk->items[cur->pos];
+    size_t count = chunk->end - cur->pos;
+    cur->chunk = chunk->next;
+    cur->pos = cur->chunk ? cur->chunk->begin : 0;
+    return count;
+}
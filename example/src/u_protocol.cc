@@ -0,0 +1,109 @@
+/*-----------------------------------------------------------------------
+ * Parsing of FILE_FEED_RESPONSE, and reading and writing of the extended
+ * info shared by the responses, see u_protocol.h.
+ *-----------------------------------------------------------------------*/
+
+#include "u_protocol_internal.h"
+#include <string.h>
+
+/*
+ * Steps 'it' over one extended info entry, filling in 'info'. Returns 1,
+ * 0 at the end, or -1 if the entry runs past the end.
+ */
+static inline int32_t protocol_extInfoStep(sExtInfoIter* it, sExtInfo* info)
+{
+    size_t left = (size_t) (it->end - it->pos);
+
+    if (left == 0) {
+        return 0;
+    }
+    if (left < EXTENDED_INFO_HEADER_SIZE) {
+        return -1;
+    }
+    info->id = it->pos[0];
+    info->size = protocol_getLong(it->pos + 1);
+    if (info->size > left - EXTENDED_INFO_HEADER_SIZE) {
+        return -1;
+    }
+    info->data = it->pos + EXTENDED_INFO_HEADER_SIZE;
+    it->pos = info->data + info->size;
+    return 1;
+}
+
+
+/**
+ * Parses a FILE_FEED_RESPONSE payload into 'out', handing out pointers into
+ * the payload. Returns 0 on success, -1 on failure.
+ */
+int32_t protocol_parseFileFeedResponse(uint8_t* payload, int32_t size,
+        sFileFeedResponse* out)
+{
+    if (!payload || !out || size < FILE_FEED_HEADER_SIZE) {
+        return -1;
+    }
+    const uint8_t* p = payload + FILE_FEED_CRID_SIZE;
+    out->crid = payload;
+    out->sliceId = protocol_getShort(p);
+    out->offset = protocol_getLong(p + 2);
+    out->chunkSize = protocol_getLong(p + 6);
+    if (out->chunkSize > (uint32_t) (size - FILE_FEED_HEADER_SIZE)) {
+        return -1;
+    }
+    out->chunkData = payload + FILE_FEED_HEADER_SIZE;
+    out->extInfo.pos = out->chunkData + out->chunkSize;
+    out->extInfo.end = payload + size;
+
+    /* Check the tail now, so iterating over it later can't fail. */
+    return protocol_checkExtInfo(out->extInfo.pos, out->extInfo.end);
+}
+
+
+/**
+ * Reads the next extended info entry of 'it' into 'info'. Returns 1 if
+ * there was one, 0 at the end, -1 if malformed.
+ */
+int32_t protocol_extInfoNext(sExtInfoIter* it, sExtInfo* info)
+{
+    if (!it || !info) {
+        return -1;
+    }
+    return protocol_extInfoStep(it, info);
+}
+
+
+
+/**
+ * Writes an extended info entry to 'buf' of 'cap' bytes. Returns the number
+ * of bytes written, -1 if it doesn't fit.
+ */
+int32_t protocol_putExtInfo(uint8_t* buf, int32_t cap, uint8_t id,
+        const void* data, uint32_t size)
+{
+    if (!buf || cap < EXTENDED_INFO_HEADER_SIZE ||
+            size > (uint32_t) (cap - EXTENDED_INFO_HEADER_SIZE) ||
+            (size > 0 && !data)) {
+        return -1;
+    }
+    buf[0] = id;
+    protocol_putLong(buf + 1, size);
+    if (size > 0) {
+        memcpy(buf + EXTENDED_INFO_HEADER_SIZE, data, size);
+    }
+    return (int32_t) (EXTENDED_INFO_HEADER_SIZE + size);
+}
+
+
+/* Checks that the extended info from 'pos' fills the bytes up to 'end'. */
+int32_t protocol_checkExtInfo(const uint8_t* pos, const uint8_t* end)
+{
+    sExtInfoIter it;
+    sExtInfo info;
+    int32_t ret;
+
+    it.pos = pos;
+    it.end = end;
+    do {
+        ret = protocol_extInfoStep(&it, &info);
+    } while (ret > 0);
+    return ret;
+}
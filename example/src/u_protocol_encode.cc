@@ -0,0 +1,116 @@
+/*-----------------------------------------------------------------------
+ * Encoding of FILE_FEED_REQUEST into pooled buffers, see sFileFeedEncoder.
+ *
+ * The preallocated buffers sit in one block, FILE_FEED_BUFFER_STRIDE bytes
+ * apart, and the free ones are queued in an sRing, so taking and giving
+ * back a buffer is lock-free. The crid is copied into every buffer
+ * when the encoder is created; a buffer keeps it while it is in use, so
+ * encoding only writes the ten bytes after it. Buffers allocated when the
+ * block is used up are not pooled, and are told apart by their address.
+ *-----------------------------------------------------------------------*/
+
+#include "u_protocol_internal.h"
+#include <string.h>
+
+/* Buffers don't share cache lines. */
+#define FILE_FEED_BUFFER_STRIDE \
+    ((FILE_FEED_REQUEST_SIZE + 63) / 64 * 64)
+
+/* Returns 1 if 'buf' is one of the preallocated buffers of 'enc'. */
+static inline int protocol_pooled(sFileFeedEncoder* enc, const uint8_t* buf)
+{
+    return buf >= enc->buffers &&
+            buf < enc->buffers + enc->count * FILE_FEED_BUFFER_STRIDE;
+}
+
+
+/**
+ * Creates an encoder for the requests of 'transport' with 'buffers'
+ * preallocated buffers. Returns NULL on failure.
+ */
+sFileFeedEncoder* protocol_encoderCreate(const sTransport* transport,
+        size_t buffers, eRingThreadAlt threadAlt)
+{
+    if (!transport || !transport->crid_p || buffers == 0) {
+        return NULL;
+    }
+    sFileFeedEncoder* enc = (sFileFeedEncoder*) calloc(1,
+            sizeof(sFileFeedEncoder));
+    if (!enc) {
+        return NULL;
+    }
+    memcpy(enc->crid, transport->crid_p, FILE_FEED_CRID_SIZE);
+    enc->count = buffers;
+    enc->buffers = (uint8_t*) malloc(buffers * FILE_FEED_BUFFER_STRIDE);
+    enc->free = ring_create(buffers, NULL, threadAlt);
+    if (!enc->buffers || !enc->free) {
+        protocol_encoderDestroy(enc);
+        return NULL;
+    }
+    for (size_t i = 0; i < buffers; i++) {
+        uint8_t* buf = enc->buffers + i * FILE_FEED_BUFFER_STRIDE;
+        memcpy(buf, enc->crid, FILE_FEED_CRID_SIZE);
+        ring_push(enc->free, buf);
+    }
+    return enc;
+}
+
+
+/**
+ * Frees up memory taken up by 'enc'. Returns 0 on success, -1 on failure.
+ */
+int32_t protocol_encoderDestroy(sFileFeedEncoder* enc)
+{
+    if (!enc) {
+        return -1;
+    }
+    if (enc->free) {
+        ring_destroy(enc->free);
+    }
+    free(enc->buffers);
+    free(enc);
+    return 0;
+}
+
+
+/**
+ * Encodes a FILE_FEED_REQUEST into a buffer from the pool of 'enc' and
+ * returns it, NULL on failure.
+ */
+uint8_t* protocol_encodeFileFeedRequest(sFileFeedEncoder* enc,
+        uint16_t sliceId, uint32_t offset, uint32_t chunkSize)
+{
+    if (!enc) {
+        return NULL;
+    }
+    uint8_t* buf = (uint8_t*) ring_pop(enc->free);
+    if (!buf) {
+        buf = (uint8_t*) malloc(FILE_FEED_REQUEST_SIZE);
+        if (!buf) {
+            return NULL;
+        }
+        memcpy(buf, enc->crid, FILE_FEED_CRID_SIZE);
+    }
+    uint8_t* p = buf + FILE_FEED_CRID_SIZE;
+    protocol_putShort(p, sliceId);
+    protocol_putLong(p + 2, offset);
+    protocol_putLong(p + 6, chunkSize);
+    return buf;
+}
+
+
+/**
+ * Gives 'buf' back to 'enc'. Returns 0 on success, -1 on failure.
+ */
+int32_t protocol_encoderRelease(sFileFeedEncoder* enc, uint8_t* buf)
+{
+    if (!enc || !buf) {
+        return -1;
+    }
+    if (!protocol_pooled(enc, buf)) {
+        free(buf);
+        return 0;
+    }
+    /* The ring holds all pooled buffers, so it can't be full. */
+    return ring_push(enc->free, buf) == 0 ? 0 : -1;
+}
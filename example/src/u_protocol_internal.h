@@ -0,0 +1,58 @@
+#ifndef PROTOCOL_INTERNAL_H_
+#define PROTOCOL_INTERNAL_H_
+
+/*-----------------------------------------------------------------------
+ * Declarations shared between the translation units implementing the
+ * protocol messages. Not part of the public interface, see u_protocol.h.
+ *
+ * Numbers are read and written byte by byte, so fields at odd offsets in
+ * a payload are fine on any target; the compiler turns the shifts into a
+ * load or store and a byte swap.
+ *-----------------------------------------------------------------------*/
+
+#include "u_protocol.h"
+
+static inline uint16_t protocol_getShort(const uint8_t* p)
+{
+    return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t protocol_getLong(const uint8_t* p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+            ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline void protocol_putShort(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t) (v >> 8);
+    p[1] = (uint8_t) v;
+}
+
+static inline void protocol_putLong(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+/*
+ * Returns the multi-range version to use with a peer offering 'version'
+ * and 'maxRanges', 0 if the offer can't be used.
+ */
+static inline int32_t protocol_multiVersion(uint8_t version, uint16_t maxRanges)
+{
+    if (version == 0 || maxRanges == 0) {
+        return 0;
+    }
+    return version < FILE_FEED_MULTI_VERSION ? version : FILE_FEED_MULTI_VERSION;
+}
+
+/*
+ * Checks that the extended info entries from 'pos' fill exactly the bytes
+ * up to 'end'. Returns 0 if they do, -1 otherwise.
+ */
+int32_t protocol_checkExtInfo(const uint8_t* pos, const uint8_t* end);
+
+#endif /* PROTOCOL_INTERNAL_H_ */
@@ -0,0 +1,273 @@
+/*-----------------------------------------------------------------------
+ * Multi-range FILE_FEED messages and their negotiation, see u_protocol.h.
+ *
+ * Like protocol_parseFileFeedResponse(), the parsers check every length up
+ * front and hand out pointers into the payload, so walking the ranges,
+ * chunks and extended info of a parsed message can't fail.
+ *-----------------------------------------------------------------------*/
+
+#include "u_protocol_internal.h"
+#include <string.h>
+
+#define FILE_FEED_MULTI_OFFER_SIZE  (1 + 2)
+
+/* Returns 1 if this node speaks multi-range 'version'. */
+static inline int protocol_multiVersionKnown(uint8_t version)
+{
+    return version > 0 && version <= FILE_FEED_MULTI_VERSION;
+}
+
+/* Reads the header shared by both messages. Returns 0, or -1 if invalid. */
+static int32_t protocol_multiHeader(const uint8_t* payload, int32_t size,
+        uint8_t* version, const uint8_t** crid, uint16_t* sliceId,
+        uint16_t* count)
+{
+    if (!payload || size < FILE_FEED_MULTI_HEADER_SIZE) {
+        return -1;
+    }
+    *version = payload[0];
+    if (!protocol_multiVersionKnown(*version)) {
+        return -1;
+    }
+    *crid = payload + 1;
+    *sliceId = protocol_getShort(payload + 1 + FILE_FEED_CRID_SIZE);
+    *count = protocol_getShort(payload + 3 + FILE_FEED_CRID_SIZE);
+    return 0;
+}
+
+static void protocol_putMultiHeader(uint8_t* buf, uint8_t version,
+        const uint8_t* crid, uint16_t sliceId, uint16_t count)
+{
+    buf[0] = version;
+    memcpy(buf + 1, crid, FILE_FEED_CRID_SIZE);
+    protocol_putShort(buf + 1 + FILE_FEED_CRID_SIZE, sliceId);
+    protocol_putShort(buf + 3 + FILE_FEED_CRID_SIZE, count);
+}
+
+
+/**
+ * Returns the multi-range version to use if 'info' is a usable offer, and
+ * stores the peer's range limit in 'maxRanges'. Returns 0 otherwise.
+ */
+int32_t protocol_multiRangeAccept(const sExtInfo* info, uint16_t* maxRanges)
+{
+    if (!info || !maxRanges || info->id != FILE_FEED_EXTENDED_INFO_MULTI_RANGE ||
+            info->size < FILE_FEED_MULTI_OFFER_SIZE) {
+        return 0;
+    }
+    /* Later versions may add to the offer, so a longer one is fine. */
+    uint16_t ranges = protocol_getShort(info->data + 1);
+    int32_t version = protocol_multiVersion(info->data[0], ranges);
+    if (version > 0) {
+        *maxRanges = ranges;
+    }
+    return version;
+}
+
+
+/**
+ * Writes the multi-range offer of this node to 'buf'. Returns the number of
+ * bytes written, -1 if they don't fit.
+ */
+int32_t protocol_putMultiRangeOffer(uint8_t* buf, int32_t cap,
+        uint16_t maxRanges)
+{
+    uint8_t offer[FILE_FEED_MULTI_OFFER_SIZE];
+
+    if (maxRanges == 0) {
+        return -1;
+    }
+    offer[0] = FILE_FEED_MULTI_VERSION;
+    protocol_putShort(offer + 1, maxRanges);
+    return protocol_putExtInfo(buf, cap, FILE_FEED_EXTENDED_INFO_MULTI_RANGE,
+            offer, sizeof(offer));
+}
+
+
+/**
+ * Encodes a FILE_FEED_MULTI_REQUEST of the negotiated 'version' into 'buf'.
+ * Returns the size of the payload, -1 on failure.
+ */
+int32_t protocol_encodeFileFeedMultiRequest(uint8_t* buf, int32_t cap,
+        uint8_t version, const uint8_t* crid, uint16_t sliceId,
+        const sFileFeedRange* ranges, uint16_t count)
+{
+    int32_t size = FILE_FEED_MULTI_REQUEST_SIZE(count);
+
+    if (!buf || !crid || (count > 0 && !ranges) || size > cap ||
+            size > MAX_PAYLOAD_SIZE || !protocol_multiVersionKnown(version)) {
+        return -1;
+    }
+    protocol_putMultiHeader(buf, version, crid, sliceId, count);
+    uint8_t* p = buf + FILE_FEED_MULTI_HEADER_SIZE;
+    for (uint16_t i = 0; i < count; i++, p += FILE_FEED_RANGE_SIZE) {
+        protocol_putLong(p, ranges[i].offset);
+        protocol_putLong(p + 4, ranges[i].size);
+    }
+    return size;
+}
+
+
+/**
+ * Parses a FILE_FEED_MULTI_REQUEST payload into 'out'. Returns 0 on
+ * success, -1 on failure.
+ */
+int32_t protocol_parseFileFeedMultiRequest(uint8_t* payload, int32_t size,
+        sFileFeedMultiRequest* out)
+{
+    if (!out || protocol_multiHeader(payload, size, &out->version, &out->crid,
+                &out->sliceId, &out->rangeCount) != 0) {
+        return -1;
+    }
+    if (size != FILE_FEED_MULTI_REQUEST_SIZE(out->rangeCount)) {
+        return -1;
+    }
+    out->ranges = payload + FILE_FEED_MULTI_HEADER_SIZE;
+    return 0;
+}
+
+
+/**
+ * Reads range 'index' of 'req' into 'range'. Returns 0 on success, -1 on
+ * failure.
+ */
+int32_t protocol_multiRequestRange(const sFileFeedMultiRequest* req,
+        uint16_t index, sFileFeedRange* range)
+{
+    if (!req || !range || index >= req->rangeCount) {
+        return -1;
+    }
+    const uint8_t* p = req->ranges + (size_t) index * FILE_FEED_RANGE_SIZE;
+    range->offset = protocol_getLong(p);
+    range->size = protocol_getLong(p + 4);
+    return 0;
+}
+
+
+/**
+ * Starts a FILE_FEED_MULTI_RESPONSE of the request's 'version' in 'buf'.
+ * Returns 0 on success, -1 on failure.
+ */
+int32_t protocol_multiResponseInit(sFileFeedMultiBuilder* b, uint8_t* buf,
+        int32_t cap, uint8_t version, const uint8_t* crid, uint16_t sliceId)
+{
+    if (!b || !buf || !crid || cap < FILE_FEED_MULTI_HEADER_SIZE ||
+            !protocol_multiVersionKnown(version)) {
+        return -1;
+    }
+    b->buf = buf;
+    b->cap = cap < MAX_PAYLOAD_SIZE ? cap : MAX_PAYLOAD_SIZE;
+    b->size = FILE_FEED_MULTI_HEADER_SIZE;
+    b->chunkCount = 0;
+    b->hasExtInfo = 0;
+    protocol_putMultiHeader(buf, version, crid, sliceId, 0);
+    return 0;
+}
+
+
+/** Returns the most bytes of data the next chunk can have. */
+uint32_t protocol_multiResponseRoom(const sFileFeedMultiBuilder* b)
+{
+    if (!b || b->hasExtInfo || b->chunkCount == UINT16_MAX ||
+            b->cap - b->size <= FILE_FEED_RANGE_SIZE) {
+        return 0;
+    }
+    return (uint32_t) (b->cap - b->size - FILE_FEED_RANGE_SIZE);
+}
+
+
+/**
+ * Adds a chunk to the response and returns where its data goes, NULL if
+ * it doesn't fit.
+ */
+uint8_t* protocol_multiResponseAddChunk(sFileFeedMultiBuilder* b,
+        uint32_t offset, uint32_t size)
+{
+    if (!b || b->hasExtInfo || b->chunkCount == UINT16_MAX ||
+            b->cap - b->size < FILE_FEED_RANGE_SIZE ||
+            size > (uint32_t) (b->cap - b->size - FILE_FEED_RANGE_SIZE)) {
+        return NULL;
+    }
+    uint8_t* p = b->buf + b->size;
+    protocol_putLong(p, offset);
+    protocol_putLong(p + 4, size);
+    b->size += FILE_FEED_RANGE_SIZE + (int32_t) size;
+    b->chunkCount++;
+    protocol_putShort(b->buf + 3 + FILE_FEED_CRID_SIZE, b->chunkCount);
+    return p + FILE_FEED_RANGE_SIZE;
+}
+
+
+/**
+ * Appends an extended info entry to the response. Returns 0 on success, -1
+ * on failure.
+ */
+int32_t protocol_multiResponseAddExtInfo(sFileFeedMultiBuilder* b,
+        uint8_t id, const void* data, uint32_t size)
+{
+    if (!b) {
+        return -1;
+    }
+    int32_t n = protocol_putExtInfo(b->buf + b->size, b->cap - b->size, id,
+            data, size);
+    if (n < 0) {
+        return -1;
+    }
+    b->size += n;
+    b->hasExtInfo = 1;
+    return 0;
+}
+
+
+/**
+ * Parses a FILE_FEED_MULTI_RESPONSE payload into 'out'. Returns 0 on
+ * success, -1 on failure.
+ */
+int32_t protocol_parseFileFeedMultiResponse(uint8_t* payload, int32_t size,
+        sFileFeedMultiResponse* out)
+{
+    if (!out || protocol_multiHeader(payload, size, &out->version, &out->crid,
+                &out->sliceId, &out->chunkCount) != 0) {
+        return -1;
+    }
+    uint8_t* p = payload + FILE_FEED_MULTI_HEADER_SIZE;
+    uint8_t* end = payload + size;
+
+    out->chunks.pos = p;
+    out->chunks.left = out->chunkCount;
+    for (uint16_t i = 0; i < out->chunkCount; i++) {
+        if (end - p < FILE_FEED_RANGE_SIZE) {
+            return -1;
+        }
+        uint32_t chunkSize = protocol_getLong(p + 4);
+        p += FILE_FEED_RANGE_SIZE;
+        if (chunkSize > (size_t) (end - p)) {
+            return -1;
+        }
+        p += chunkSize;
+    }
+    out->extInfo.pos = p;
+    out->extInfo.end = end;
+    return protocol_checkExtInfo(p, end);
+}
+
+
+/**
+ * Reads the next chunk of 'it' into 'chunk'. Returns 1 if there was one, 0
+ * at the end.
+ */
+int32_t protocol_chunkNext(sFileFeedChunkIter* it, sFileFeedChunk* chunk)
+{
+    if (!it || !chunk) {
+        return -1;
+    }
+    if (it->left == 0) {
+        return 0;
+    }
+    chunk->offset = protocol_getLong(it->pos);
+    chunk->size = protocol_getLong(it->pos + 4);
+    chunk->data = it->pos + FILE_FEED_RANGE_SIZE;
+    it->pos = chunk->data + chunk->size;
+    it->left--;
+    return 1;
+}
@@ -0,0 +1,130 @@
+/*-----------------------------------------------------------------------
+ * Per-connection negotiation of the FILE_FEED parameters, see
+ * sFileFeedPeer in u_protocol.h, and scanning of the extended info of a
+ * response. Both dispatch through the registry in u_extinfo.hpp.
+ *-----------------------------------------------------------------------*/
+
+#include "u_protocol_internal.h"
+#include "u_extinfo.hpp"
+
+static inline uint32_t protocol_min(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+/* Applies the negotiation entries of a response to 'peer', if set. */
+struct PeerHandler : vn::ExtInfoHandler {
+    explicit PeerHandler(sFileFeedPeer* p) : peer(p) {}
+
+    void onMultiRange(uint8_t version, uint16_t maxRanges)
+    {
+        int32_t use = protocol_multiVersion(version, maxRanges);
+        if (peer && use > 0) {
+            peer->multiVersion = use;
+            peer->maxRanges = maxRanges;
+        }
+    }
+
+    void onMaxChunkSize(uint32_t offer)
+    {
+        /* A peer may also ask for smaller chunks than the default. */
+        if (peer && offer > 0) {
+            peer->maxChunkSize = protocol_min(offer, peer->localMaxChunkSize);
+        }
+    }
+
+    sFileFeedPeer* peer;
+};
+
+/* Collects the scheduler's signals, negotiating on the way. */
+struct SignalsHandler : PeerHandler {
+    SignalsHandler(sExtInfoSignals* s, sFileFeedPeer* p) :
+        PeerHandler(p), signals(s) {}
+
+    void onNodeBusy(uint32_t data)
+    {
+        signals->nodeBusy = 1;
+        signals->busyData = data;
+    }
+
+    void onNoSliceAvailable() { signals->noSliceAvailable = 1; }
+    void onUnknown(const sExtInfo&) { signals->unknown++; }
+    void onMalformed(const sExtInfo&) { signals->malformed++; }
+
+    sExtInfoSignals* signals;
+};
+
+
+/**
+ * Initializes 'peer' for a new connection with the requester's limit
+ * 'localMaxChunkSize'.
+ */
+void protocol_peerInit(sFileFeedPeer* peer, uint32_t localMaxChunkSize)
+{
+    if (!peer) {
+        return;
+    }
+    peer->localMaxChunkSize = protocol_min(localMaxChunkSize,
+            MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+    peer->maxChunkSize = protocol_min(peer->localMaxChunkSize,
+            MAX_FILE_FEED_CHUNK_SIZE);
+    peer->multiVersion = 0;
+    peer->maxRanges = 0;
+}
+
+
+/**
+ * Updates 'peer' from the extended info entry 'info'. Returns 1 if it was
+ * a negotiation entry, 0 otherwise.
+ */
+int32_t protocol_peerLearn(sFileFeedPeer* peer, const sExtInfo* info)
+{
+    if (!peer || !info) {
+        return 0;
+    }
+    if (info->id != FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE &&
+            info->id != FILE_FEED_EXTENDED_INFO_MULTI_RANGE) {
+        return 0;
+    }
+    PeerHandler h(peer);
+    vn::extInfoDispatch(h, *info);
+    return 1;
+}
+
+
+/**
+ * Writes the max chunk size entry of a server to 'buf'. Returns the number
+ * of bytes written, -1 on failure.
+ */
+int32_t protocol_putMaxChunkOffer(uint8_t* buf, int32_t cap,
+        uint32_t maxChunkSize)
+{
+    uint8_t offer[4];
+
+    if (maxChunkSize == 0 || maxChunkSize > MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE) {
+        return -1;
+    }
+    protocol_putLong(offer, maxChunkSize);
+    return protocol_putExtInfo(buf, cap, FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE,
+            offer, sizeof(offer));
+}
+
+
+/**
+ * Scans the extended info from 'it' on into 'signals', updating 'peer'
+ * unless NULL. Returns 0 on success, -1 if the entries are malformed.
+ */
+int32_t protocol_scanExtInfo(sExtInfoIter it, sExtInfoSignals* signals,
+        sFileFeedPeer* peer)
+{
+    if (!signals) {
+        return -1;
+    }
+    signals->nodeBusy = 0;
+    signals->busyData = 0;
+    signals->noSliceAvailable = 0;
+    signals->unknown = 0;
+    signals->malformed = 0;
+    SignalsHandler h(signals, peer);
+    return vn::extInfoScan(it, h);
+}
@@ -0,0 +1,247 @@
+
+/*-----------------------------------------------------------------------
+ * RING_SPSC: the producer owns 'tail' and the consumer owns 'head'. Each side
+ * keeps a cached copy of the other side's index and only reloads it when the
+ * ring looks full or empty, so in steady state the two threads don't touch
+ * each other's cache lines.
+ *
+ * RING_MPMC: Dmitry Vyukov's bounded queue. Every slot carries a sequence
+ * number telling whether it is ready to be written (seq == pos) or read
+ * (seq == pos + 1) for a given position. Producers and consumers claim a
+ * position with a CAS on 'tail' and 'head' respectively.
+ *-----------------------------------------------------------------------*/
+
+#include "u_ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define RING_CACHE_LINE 64
+
+typedef struct {
+    size_t seq;                 /* Position the slot is ready for (MPMC). */
+    void* data;
+} sRingSlot;
+
+struct sRingT {
+    alignas(RING_CACHE_LINE) size_t head;   /* Next position to pop. */
+    size_t tailCache;                       /* Consumer's view of tail. */
+    alignas(RING_CACHE_LINE) size_t tail;   /* Next position to push. */
+    size_t headCache;                       /* Producer's view of head. */
+    alignas(RING_CACHE_LINE) size_t mask;   /* Capacity - 1. */
+    eRingThreadAlt threadAlt;
+    void (*destroyFunc)(void*);
+    sRingSlot* slots;
+};
+
+
+/**
+ * Creates a new empty ring holding at least 'capacity' elements; the
+ * capacity is rounded up to a power of two. On failure returns NULL.
+ */
+sRing* ring_create(size_t capacity, void (*destroyFunc)(void*),
+        eRingThreadAlt threadAlt)
+{
+    size_t size = 2;
+    void* mem;
+
+    if (capacity == 0 || capacity > SIZE_MAX / 2 / sizeof(sRingSlot)) {
+        return NULL;
+    }
+    while (size < capacity) {
+        size <<= 1;
+    }
+    if (posix_memalign(&mem, RING_CACHE_LINE, sizeof(sRing)) != 0) {
+        return NULL;
+    }
+    sRing* r = (sRing*) mem;
+    memset(r, 0, sizeof(sRing));
+    if (posix_memalign(&mem, RING_CACHE_LINE, size * sizeof(sRingSlot)) != 0) {
+        free(r);
+        return NULL;
+    }
+    r->slots = (sRingSlot*) mem;
+    r->mask = size - 1;
+    r->threadAlt = threadAlt;
+    r->destroyFunc = destroyFunc;
+    for (size_t i = 0; i < size; i++) {
+        r->slots[i].seq = i;
+        r->slots[i].data = NULL;
+    }
+    return r;
+}
+
+
+/**
+ * Frees up memory taken up by 'r', calling its destroyFunc on all remaining
+ * elements. Returns 0 on success, -1 on failure.
+ */
+int ring_destroy(sRing* r)
+{
+    if (!r) {
+        return -1;
+    }
+    ring_clear(r);
+    free(r->slots);
+    free(r);
+    return 0;
+}
+
+
+/**
+ * Adds a new element to the end of the ring. Returns 0 on success, RING_FULL
+ * if the ring is full, -1 on failure.
+ */
+int ring_push(sRing* r, void* data)
+{
+    if (!r) {
+        return -1;
+    }
+
+    if (r->threadAlt == RING_SPSC) {
+        size_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        if (tail - r->headCache > r->mask) {
+            r->headCache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+            if (tail - r->headCache > r->mask) {
+                return RING_FULL;
+            }
+        }
+        r->slots[tail & r->mask].data = data;
+        __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    sRingSlot* slot;
+    for (;;) {
+        slot = &r->slots[pos & r->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, true,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return RING_FULL;
+        } else {
+            pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&slot->data, data, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+/**
+ * Removes the front element from 'r' and returns it. Returns NULL if the ring
+ * is empty, or if 'r' is NULL.
+ */
+void* ring_pop(sRing* r)
+{
+    void* data;
+
+    if (!r) {
+        return NULL;
+    }
+
+    if (r->threadAlt == RING_SPSC) {
+        size_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        if (head == r->tailCache) {
+            r->tailCache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+            if (head == r->tailCache) {
+                return NULL;
+            }
+        }
+        data = r->slots[head & r->mask].data;
+        __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+        return data;
+    }
+
+    size_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    sRingSlot* slot;
+    for (;;) {
+        slot = &r->slots[pos & r->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1, true,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+    data = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+    return data;
+}
+
+
+/**
+ * Retrieves the front element without removing it from the ring. On an MPMC
+ * ring another consumer may remove the element at any time.
+ */
+void* ring_peek(sRing* r)
+{
+    if (!r) {
+        return NULL;
+    }
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    sRingSlot* slot = &r->slots[head & r->mask];
+
+    if (r->threadAlt == RING_SPSC) {
+        if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        return slot->data;
+    }
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1) {
+        return NULL;
+    }
+    return __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Removes all elements from 'r', cleaning them up with the ring's
+ * destroyFunc. Returns 0 on success, -1 on failure.
+ */
+int ring_clear(sRing* r)
+{
+    void* data;
+
+    if (!r) {
+        return -1;
+    }
+    while (ring_size(r) > 0) {
+        data = ring_pop(r);
+        if (data && r->destroyFunc) {
+            r->destroyFunc(data);
+        }
+    }
+    return 0;
+}
+
+
+/** Returns the number of elements in the ring, or 0 if 'r' is NULL. */
+size_t ring_size(sRing* r)
+{
+    if (!r) {
+        return 0;
+    }
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    return tail > head ? tail - head : 0;
+}
+
+
+/** Returns the capacity of the ring, or 0 if 'r' is NULL. */
+size_t ring_capacity(sRing* r)
+{
+    return r ? r->mask + 1 : 0;
+}
@@ -0,0 +1,275 @@
+/*-----------------------------------------------------------------------
+ * Fuzz target for the FILE_FEED_RESPONSE and multi-range parsers.
+ *
+ * LLVMFuzzerTestOneInput() is the libFuzzer entry point; built with
+ * -fsanitize=fuzzer and -DPROTOCOL_LIBFUZZER it is driven by libFuzzer.
+ * Otherwise this file has its own driver, run by ctest under ASan and
+ * UBSan:
+ *
+ *   fuzz_protocol [seed] [iterations]
+ *
+ * which mutates well-formed single and multi-range responses (bit flips,
+ * truncation, overwritten length fields, random tails) and feeds them to
+ * all parsers. One input in eight is left intact and must be accepted. Every input is
+ * copied into a buffer of exactly its size, so any read past the payload is
+ * caught. When a parser accepts an input, all spans it hands out must lie
+ * inside the payload, and the chunks and extended info must add up to the
+ * payload size.
+ *-----------------------------------------------------------------------*/
+
+#include "u_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZ_MAX_INPUT      (MAX_PAYLOAD_SIZE + 64)
+
+static void fuzz_fail(const char* what)
+{
+    fprintf(stderr, "fuzz_protocol: %s\n", what);
+    abort();
+}
+
+static int fuzz_inside(const uint8_t* p, size_t len, const uint8_t* payload,
+        size_t size)
+{
+    return p >= payload && p <= payload + size &&
+            len <= (size_t) (payload + size - p);
+}
+
+/* Walks the extended info of a parsed message, returns its size. */
+static size_t fuzz_extInfo(sExtInfoIter* it, const uint8_t* payload,
+        size_t size)
+{
+    sExtInfo info;
+    size_t tail = 0;
+    int32_t ret;
+
+    while ((ret = protocol_extInfoNext(it, &info)) > 0) {
+        if (!fuzz_inside(info.data, info.size, payload, size)) {
+            fuzz_fail("extended info outside the payload");
+        }
+        tail += EXTENDED_INFO_HEADER_SIZE + info.size;
+    }
+    if (ret != 0) {
+        fuzz_fail("iterator of a parsed message failed");
+    }
+    return tail;
+}
+
+static void fuzz_single(uint8_t* payload, size_t size)
+{
+    sFileFeedResponse r;
+
+    if (protocol_parseFileFeedResponse(payload, (int32_t) size, &r) != 0) {
+        return;
+    }
+    if (!fuzz_inside(r.crid, FILE_FEED_CRID_SIZE, payload, size) ||
+            !fuzz_inside(r.chunkData, r.chunkSize, payload, size)) {
+        fuzz_fail("span outside the payload");
+    }
+    size_t tail = fuzz_extInfo(&r.extInfo, payload, size);
+    if (FILE_FEED_HEADER_SIZE + r.chunkSize + tail != size) {
+        fuzz_fail("fields don't add up to the payload size");
+    }
+}
+
+static void fuzz_multi(uint8_t* payload, size_t size)
+{
+    sFileFeedMultiResponse r;
+    sFileFeedMultiRequest req;
+    sFileFeedChunk chunk;
+    sFileFeedRange range;
+
+    if (protocol_parseFileFeedMultiResponse(payload, (int32_t) size, &r) == 0) {
+        size_t total = FILE_FEED_MULTI_HEADER_SIZE;
+        uint16_t chunks = 0;
+        while (protocol_chunkNext(&r.chunks, &chunk) > 0) {
+            if (!fuzz_inside(chunk.data, chunk.size, payload, size)) {
+                fuzz_fail("chunk outside the payload");
+            }
+            total += FILE_FEED_RANGE_SIZE + chunk.size;
+            chunks++;
+        }
+        total += fuzz_extInfo(&r.extInfo, payload, size);
+        if (chunks != r.chunkCount || total != size) {
+            fuzz_fail("chunks don't add up to the payload size");
+        }
+    }
+    if (protocol_parseFileFeedMultiRequest(payload, (int32_t) size, &req) == 0) {
+        for (uint16_t i = 0; i < req.rangeCount; i++) {
+            if (protocol_multiRequestRange(&req, i, &range) != 0) {
+                fuzz_fail("range of a parsed request missing");
+            }
+        }
+        if (FILE_FEED_MULTI_REQUEST_SIZE((size_t) req.rangeCount) != size) {
+            fuzz_fail("ranges don't add up to the payload size");
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* input, size_t size)
+{
+    uint8_t* payload = (uint8_t*) malloc(size ? size : 1);
+
+    if (!payload) {
+        return 0;
+    }
+    memcpy(payload, input, size);
+    if (size <= FUZZ_MAX_INPUT) {
+        fuzz_single(payload, size);
+        fuzz_multi(payload, size);
+    }
+    free(payload);
+    return 0;
+}
+
+#ifndef PROTOCOL_LIBFUZZER
+
+static uint64_t fuzz_rng;
+
+static uint32_t fuzz_rand(void)
+{
+    fuzz_rng ^= fuzz_rng << 13;
+    fuzz_rng ^= fuzz_rng >> 7;
+    fuzz_rng ^= fuzz_rng << 17;
+    return (uint32_t) (fuzz_rng >> 16);
+}
+
+static size_t fuzz_putLong(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+    return 4;
+}
+
+static uint8_t fuzz_cridChar(void)
+{
+    return (uint8_t) "0123456789abcdefghijklmnopqrstuvwxyz"[fuzz_rand() % 36];
+}
+
+/* Writes a well-formed FILE_FEED_RESPONSE into 'buf', returns its size. */
+static size_t fuzz_valid(uint8_t* buf)
+{
+    uint32_t chunkSize = fuzz_rand() % 4 == 0 ? 0 : fuzz_rand() % 2048;
+    unsigned entries = fuzz_rand() % 4;
+    size_t n = 0;
+
+    for (; n < FILE_FEED_CRID_SIZE; n++) {
+        buf[n] = fuzz_cridChar();
+    }
+    buf[n++] = (uint8_t) (fuzz_rand() >> 8);
+    buf[n++] = (uint8_t) fuzz_rand();
+    n += fuzz_putLong(buf + n, fuzz_rand());
+    n += fuzz_putLong(buf + n, chunkSize);
+    for (uint32_t i = 0; i < chunkSize; i++) {
+        buf[n++] = (uint8_t) fuzz_rand();
+    }
+    for (unsigned e = 0; e < entries; e++) {
+        uint32_t dataSize = fuzz_rand() % 3 == 0 ? 0 : fuzz_rand() % 16;
+        buf[n++] = (uint8_t) fuzz_rand();
+        n += fuzz_putLong(buf + n, dataSize);
+        for (uint32_t i = 0; i < dataSize; i++) {
+            buf[n++] = (uint8_t) fuzz_rand();
+        }
+    }
+    return n;
+}
+
+/* Writes a well-formed FILE_FEED_MULTI_RESPONSE, returns its size. */
+static size_t fuzz_validMulti(uint8_t* buf)
+{
+    uint8_t crid[FILE_FEED_CRID_SIZE];
+    uint8_t data[16];
+    sFileFeedMultiBuilder b;
+
+    for (size_t i = 0; i < FILE_FEED_CRID_SIZE; i++) {
+        crid[i] = fuzz_cridChar();
+    }
+    protocol_multiResponseInit(&b, buf, MAX_PAYLOAD_SIZE,
+            FILE_FEED_MULTI_VERSION, crid, (uint16_t) fuzz_rand());
+    for (unsigned c = fuzz_rand() % 5; c > 0; c--) {
+        uint32_t size = fuzz_rand() % 4 == 0 ? 0 : fuzz_rand() % 1024;
+        uint8_t* p = protocol_multiResponseAddChunk(&b, fuzz_rand(), size);
+        for (uint32_t i = 0; i < size; i++) {
+            p[i] = (uint8_t) fuzz_rand();
+        }
+    }
+    for (unsigned e = fuzz_rand() % 3; e > 0; e--) {
+        uint32_t size = fuzz_rand() % sizeof(data);
+        for (uint32_t i = 0; i < size; i++) {
+            data[i] = (uint8_t) fuzz_rand();
+        }
+        protocol_multiResponseAddExtInfo(&b, (uint8_t) fuzz_rand(), data, size);
+    }
+    return (size_t) b.size;
+}
+
+/* Damages the input in 'buf' in a random way, returns its new size. */
+static size_t fuzz_mutate(uint8_t* buf, size_t n)
+{
+    switch (fuzz_rand() % 5) {
+    case 0:
+        /* Flip a few bits. */
+        for (unsigned i = fuzz_rand() % 4 + 1; i > 0 && n > 0; i--) {
+            buf[fuzz_rand() % n] ^= (uint8_t) (1 << (fuzz_rand() % 8));
+        }
+        return n;
+    case 1:
+        /* Truncate. */
+        return n > 0 ? fuzz_rand() % n : 0;
+    case 2:
+        /* Overwrite a length, the chunk size or anything after it. */
+        if (n >= FILE_FEED_HEADER_SIZE) {
+            size_t at = FILE_FEED_HEADER_SIZE - 4 +
+                    fuzz_rand() % (n - FILE_FEED_HEADER_SIZE + 1);
+            if (at + 4 <= n) {
+                uint32_t v = fuzz_rand() % 2 ? fuzz_rand() : 0xffffffffu -
+                        fuzz_rand() % 8;
+                fuzz_putLong(buf + at, v);
+            }
+        }
+        return n;
+    case 3:
+        /* Append garbage. */
+        for (unsigned i = fuzz_rand() % 8; i > 0 && n < FUZZ_MAX_INPUT; i--) {
+            buf[n++] = (uint8_t) fuzz_rand();
+        }
+        return n;
+    default:
+        return n;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    uint64_t seed = argc > 1 ? strtoull(argv[1], NULL, 0) : 1;
+    unsigned long iterations = argc > 2 ? strtoul(argv[2], NULL, 0) : 100000;
+    static uint8_t buf[FUZZ_MAX_INPUT];
+
+    fuzz_rng = seed * 2654435761ULL + 88172645463325252ULL;
+    for (unsigned long i = 0; i < iterations; i++) {
+        int multi = fuzz_rand() % 2;
+        size_t n = multi ? fuzz_validMulti(buf) : fuzz_valid(buf);
+        if (i % 8 == 0) {
+            sFileFeedMultiResponse mr;
+            sFileFeedResponse r;
+            if (multi ? protocol_parseFileFeedMultiResponse(buf, (int32_t) n,
+                        &mr) != 0 :
+                    protocol_parseFileFeedResponse(buf, (int32_t) n, &r) != 0) {
+                fuzz_fail("well-formed response rejected");
+            }
+        } else {
+            n = fuzz_mutate(buf, n);
+        }
+        LLVMFuzzerTestOneInput(buf, n);
+    }
+    printf("fuzz_protocol: %lu inputs, seed %llu\n", iterations,
+            (unsigned long long) seed);
+    return 0;
+}
+
+#endif /* PROTOCOL_LIBFUZZER */
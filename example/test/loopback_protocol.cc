@@ -0,0 +1,414 @@
+/*-----------------------------------------------------------------------
+ * Local loopback test of the FILE_FEED messages, run by ctest under ASan
+ * and UBSan.
+ *
+ *   loopback_protocol
+ *
+ * A requester downloads a 4 MB slice from a server in the same process,
+ * one request at a time as over a framework connection. Every payload is
+ * copied into a buffer of exactly its size before the other side parses
+ * it, so reads past the end are caught. Each combination of old and new
+ * requester and server is run: only new ones on both sides may switch to
+ * the multi-range messages and chunks above MAX_FILE_FEED_CHUNK_SIZE, and
+ * then need fewer round trips, with both messages in the negotiated
+ * version. The slice must arrive intact either way. At the end, malformed
+ * multi-range messages and versions this node doesn't speak are checked to
+ * be rejected, and a response tail with every kind of extended info to be
+ * reported in one scan.
+ *-----------------------------------------------------------------------*/
+
+#include "u_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOOP_SLICE_SIZE     (4 << 20)
+#define LOOP_MAX_RANGES     16
+#define LOOP_SLICE_ID       42
+
+typedef struct {
+    int multi;                  /* 1 if it serves multi-range requests and
+                                   negotiates the chunk size. */
+    const uint8_t* slice;
+} sLoopServer;
+
+typedef struct {
+    int multi;                  /* 1 if it knows the multi-range messages
+                                   and the chunk size negotiation. */
+    sFileFeedPeer peer;
+    sFileFeedEncoder* enc;
+    uint8_t* slice;
+    uint32_t next;              /* Bytes of the slice received so far. */
+    unsigned roundTrips;
+} sLoopRequester;
+
+static uint8_t loop_crid[FILE_FEED_CRID_SIZE];
+
+static void loop_fail(const char* what)
+{
+    fprintf(stderr, "loopback_protocol: %s\n", what);
+    exit(1);
+}
+
+static uint32_t loop_getLong(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+static void loop_putLong(uint8_t* p, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+/* The network: the receiver gets a copy of exactly 'size' bytes. */
+static uint8_t* loop_send(const uint8_t* payload, int32_t size)
+{
+    uint8_t* copy = (uint8_t*) malloc(size);
+    if (!copy) {
+        loop_fail("out of memory");
+    }
+    memcpy(copy, payload, size);
+    return copy;
+}
+
+/*
+ * Answers the request of 'type' in 'payload' into 'out', which has room for
+ * MAX_PAYLOAD_SIZE bytes. Returns the size and type of the response.
+ */
+static int32_t loop_serve(sLoopServer* s, uint16_t type, uint8_t* payload,
+        int32_t size, uint8_t* out, uint16_t* outType)
+{
+    if (type == FILE_FEED_REQUEST) {
+        uint16_t sliceId;
+        if (size != FILE_FEED_REQUEST_SIZE ||
+                memcmp(payload, loop_crid, FILE_FEED_CRID_SIZE) != 0) {
+            loop_fail("bad FILE_FEED_REQUEST");
+        }
+        memcpy(&sliceId, payload + FILE_FEED_CRID_SIZE, 2);
+        uint32_t offset = loop_getLong(payload + FILE_FEED_CRID_SIZE + 2);
+        uint32_t chunkSize = loop_getLong(payload + FILE_FEED_CRID_SIZE + 6);
+        uint32_t maxChunkSize = s->multi ? MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE :
+                MAX_FILE_FEED_CHUNK_SIZE;
+        if (offset > LOOP_SLICE_SIZE || chunkSize > LOOP_SLICE_SIZE - offset ||
+                chunkSize > maxChunkSize) {
+            loop_fail("FILE_FEED_REQUEST out of range");
+        }
+        memcpy(out, payload, FILE_FEED_REQUEST_SIZE);
+        memcpy(out + FILE_FEED_REQUEST_SIZE, s->slice + offset, chunkSize);
+        int32_t n = FILE_FEED_REQUEST_SIZE + chunkSize;
+        if (s->multi) {
+            n += protocol_putMultiRangeOffer(out + n, MAX_PAYLOAD_SIZE - n,
+                    LOOP_MAX_RANGES);
+            n += protocol_putMaxChunkOffer(out + n, MAX_PAYLOAD_SIZE - n,
+                    MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+        }
+        *outType = FILE_FEED_RESPONSE;
+        return n;
+    }
+    if (type != FILE_FEED_MULTI_REQUEST || !s->multi) {
+        loop_fail("request the server doesn't know");
+    }
+
+    sFileFeedMultiRequest req;
+    sFileFeedMultiBuilder b;
+    sFileFeedRange range;
+    if (protocol_parseFileFeedMultiRequest(payload, size, &req) != 0 ||
+            req.rangeCount > LOOP_MAX_RANGES ||
+            memcmp(req.crid, loop_crid, FILE_FEED_CRID_SIZE) != 0) {
+        loop_fail("bad FILE_FEED_MULTI_REQUEST");
+    }
+    if (protocol_multiResponseInit(&b, out, MAX_PAYLOAD_SIZE, req.version,
+                req.crid, req.sliceId) != 0) {
+        loop_fail("can't answer in the version of the request");
+    }
+    for (uint16_t i = 0; i < req.rangeCount; i++) {
+        protocol_multiRequestRange(&req, i, &range);
+        if (range.offset > LOOP_SLICE_SIZE ||
+                range.size > LOOP_SLICE_SIZE - range.offset) {
+            loop_fail("range out of the slice");
+        }
+        uint32_t n = protocol_multiResponseRoom(&b);
+        if (n == 0) {
+            break;
+        }
+        if (n > range.size) {
+            n = range.size;
+        }
+        uint8_t* data = protocol_multiResponseAddChunk(&b, range.offset, n);
+        if (!data) {
+            loop_fail("chunk within the room doesn't fit");
+        }
+        memcpy(data, s->slice + range.offset, n);
+    }
+    *outType = FILE_FEED_MULTI_RESPONSE;
+    return b.size;
+}
+
+static void loop_store(sLoopRequester* r, uint32_t offset, const uint8_t* data,
+        uint32_t size)
+{
+    if (offset != r->next || size > LOOP_SLICE_SIZE - offset) {
+        loop_fail("chunk out of order");
+    }
+    memcpy(r->slice + offset, data, size);
+    r->next += size;
+}
+
+static void loop_onResponse(sLoopRequester* r, uint16_t type,
+        uint8_t* payload, int32_t size)
+{
+    if (type == FILE_FEED_RESPONSE) {
+        sFileFeedResponse resp;
+        sExtInfoSignals signals;
+        /* An old requester doesn't negotiate, it only skips the offers. */
+        if (protocol_parseFileFeedResponse(payload, size, &resp) != 0 ||
+                protocol_scanExtInfo(resp.extInfo, &signals,
+                    r->multi ? &r->peer : NULL) != 0) {
+            loop_fail("bad FILE_FEED_RESPONSE");
+        }
+        if (signals.nodeBusy || signals.noSliceAvailable || signals.malformed) {
+            loop_fail("unexpected extended info");
+        }
+        loop_store(r, resp.offset, resp.chunkData, resp.chunkSize);
+        return;
+    }
+
+    sFileFeedMultiResponse resp;
+    sFileFeedChunk chunk;
+    if (type != FILE_FEED_MULTI_RESPONSE ||
+            protocol_parseFileFeedMultiResponse(payload, size, &resp) != 0 ||
+            resp.chunkCount == 0) {
+        loop_fail("bad FILE_FEED_MULTI_RESPONSE");
+    }
+    if (resp.version != r->peer.multiVersion) {
+        loop_fail("multi response not in the negotiated version");
+    }
+    while (protocol_chunkNext(&resp.chunks, &chunk) > 0) {
+        loop_store(r, chunk.offset, chunk.data, chunk.size);
+    }
+}
+
+/* Sends the next request of 'r' into 'buf', returns its size and type. */
+static int32_t loop_request(sLoopRequester* r, uint8_t* buf, uint16_t* type)
+{
+    uint32_t left = LOOP_SLICE_SIZE - r->next;
+
+    if (r->peer.multiVersion == 0) {
+        uint32_t chunkSize = left < r->peer.maxChunkSize ? left :
+                r->peer.maxChunkSize;
+        uint8_t* req = protocol_encodeFileFeedRequest(r->enc, LOOP_SLICE_ID,
+                r->next, chunkSize);
+        memcpy(buf, req, FILE_FEED_REQUEST_SIZE);
+        protocol_encoderRelease(r->enc, req);
+        *type = FILE_FEED_REQUEST;
+        return FILE_FEED_REQUEST_SIZE;
+    }
+
+    sFileFeedRange ranges[LOOP_MAX_RANGES];
+    uint16_t count = 0;
+    for (uint32_t offset = r->next; offset < LOOP_SLICE_SIZE &&
+            count < r->peer.maxRanges && count < LOOP_MAX_RANGES; count++) {
+        ranges[count].offset = offset;
+        ranges[count].size = LOOP_SLICE_SIZE - offset < r->peer.maxChunkSize ?
+                LOOP_SLICE_SIZE - offset : r->peer.maxChunkSize;
+        offset += ranges[count].size;
+    }
+    *type = FILE_FEED_MULTI_REQUEST;
+    return protocol_encodeFileFeedMultiRequest(buf, MAX_PAYLOAD_SIZE,
+            (uint8_t) r->peer.multiVersion, loop_crid, LOOP_SLICE_ID, ranges,
+            count);
+}
+
+/* Downloads the slice, returns the number of round trips it took. */
+static unsigned loop_download(int newRequester, int newServer,
+        const uint8_t* slice)
+{
+    static uint8_t requestBuf[MAX_PAYLOAD_SIZE];
+    static uint8_t responseBuf[MAX_PAYLOAD_SIZE];
+    sLoopServer s = { newServer, slice };
+    sLoopRequester r;
+    sTransport transport;
+
+    memset(&r, 0, sizeof(r));
+    r.multi = newRequester;
+    protocol_peerInit(&r.peer, MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+    r.slice = (uint8_t*) calloc(1, LOOP_SLICE_SIZE);
+    transport.crid_p = loop_crid;
+    r.enc = protocol_encoderCreate(&transport, 1, RING_SPSC);
+    if (!r.slice || !r.enc) {
+        loop_fail("out of memory");
+    }
+    while (r.next < LOOP_SLICE_SIZE) {
+        uint16_t type;
+        int32_t size = loop_request(&r, requestBuf, &type);
+        if (size < 0) {
+            loop_fail("encoding the request failed");
+        }
+        uint8_t* payload = loop_send(requestBuf, size);
+        size = loop_serve(&s, type, payload, size, responseBuf, &type);
+        free(payload);
+        payload = loop_send(responseBuf, size);
+        loop_onResponse(&r, type, payload, size);
+        free(payload);
+        r.roundTrips++;
+    }
+    if (memcmp(r.slice, slice, LOOP_SLICE_SIZE) != 0) {
+        loop_fail("slice corrupted");
+    }
+    int both = newRequester && newServer;
+    if (r.peer.multiVersion != (both ? FILE_FEED_MULTI_VERSION : 0) ||
+            r.peer.maxChunkSize != (both ? MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE :
+                MAX_FILE_FEED_CHUNK_SIZE)) {
+        loop_fail("negotiated the wrong parameters");
+    }
+    protocol_encoderDestroy(r.enc);
+    free(r.slice);
+    return r.roundTrips;
+}
+
+/* Malformed and unknown multi-range messages must be turned down. */
+static void loop_malformed(void)
+{
+    static uint8_t buf[MAX_PAYLOAD_SIZE];
+    sFileFeedRange range = { 0, 100 };
+    sFileFeedMultiRequest req;
+    sFileFeedMultiResponse resp;
+    sFileFeedMultiBuilder b;
+    sExtInfo info;
+    uint16_t maxRanges = 0;
+
+    /* Only versions this node speaks are encoded. */
+    if (protocol_encodeFileFeedMultiRequest(buf, sizeof(buf), 0, loop_crid,
+                1, &range, 1) >= 0 ||
+            protocol_encodeFileFeedMultiRequest(buf, sizeof(buf),
+                FILE_FEED_MULTI_VERSION + 1, loop_crid, 1, &range, 1) >= 0 ||
+            protocol_multiResponseInit(&b, buf, sizeof(buf), 0, loop_crid,
+                1) == 0 ||
+            protocol_multiResponseInit(&b, buf, sizeof(buf),
+                FILE_FEED_MULTI_VERSION + 1, loop_crid, 1) == 0) {
+        loop_fail("encoded a multi-range version this node doesn't speak");
+    }
+
+    int32_t size = protocol_encodeFileFeedMultiRequest(buf, sizeof(buf),
+            FILE_FEED_MULTI_VERSION, loop_crid, 1, &range, 1);
+    if (protocol_parseFileFeedMultiRequest(buf, size, &req) != 0 ||
+            req.version != FILE_FEED_MULTI_VERSION ||
+            protocol_parseFileFeedMultiRequest(buf, size - 1, &req) == 0) {
+        loop_fail("multi request length check");
+    }
+    buf[0] = FILE_FEED_MULTI_VERSION + 1;
+    if (protocol_parseFileFeedMultiRequest(buf, size, &req) == 0) {
+        loop_fail("accepted a multi request of an unknown version");
+    }
+
+    protocol_multiResponseInit(&b, buf, sizeof(buf), FILE_FEED_MULTI_VERSION,
+            loop_crid, 1);
+    memset(protocol_multiResponseAddChunk(&b, 0, 100), 7, 100);
+    protocol_multiResponseAddExtInfo(&b, 1, "\0\0\0\1", 4);
+    if (protocol_multiResponseAddChunk(&b, 100, 1) != NULL) {
+        loop_fail("added a chunk after extended info");
+    }
+    if (protocol_parseFileFeedMultiResponse(buf, b.size, &resp) != 0 ||
+            resp.version != FILE_FEED_MULTI_VERSION) {
+        loop_fail("rejected a well-formed multi response");
+    }
+    /* Cut right after the chunk it is a valid response without the entry. */
+    int32_t chunkEnd = FILE_FEED_MULTI_HEADER_SIZE + FILE_FEED_RANGE_SIZE + 100;
+    for (int32_t n = 0; n < b.size; n++) {
+        if (n != chunkEnd &&
+                protocol_parseFileFeedMultiResponse(buf, n, &resp) == 0) {
+            loop_fail("accepted a truncated multi response");
+        }
+    }
+    loop_putLong(buf + FILE_FEED_MULTI_HEADER_SIZE + 4, 101);
+    if (protocol_parseFileFeedMultiResponse(buf, b.size, &resp) == 0) {
+        loop_fail("accepted a chunk running into the extended info");
+    }
+
+    /* Offers from later versions are taken at our version. */
+    uint8_t offer[4] = { FILE_FEED_MULTI_VERSION + 1, 0, 3, 0xff };
+    info.id = FILE_FEED_EXTENDED_INFO_MULTI_RANGE;
+    info.size = sizeof(offer);
+    info.data = offer;
+    if (protocol_multiRangeAccept(&info, &maxRanges) !=
+            FILE_FEED_MULTI_VERSION || maxRanges != 3) {
+        loop_fail("later offer not accepted");
+    }
+    offer[0] = 0;
+    info.id = 128;
+    if (protocol_multiRangeAccept(&info, &maxRanges) != 0) {
+        loop_fail("accepted something which isn't an offer");
+    }
+}
+
+/* One scan of a response tail must report everything in it. */
+static void loop_signals(void)
+{
+    static const uint8_t busy[4] = { 0, 0, 0, 3 };
+    uint8_t tail[128];
+    int32_t n = 0;
+    sExtInfoSignals signals;
+    sFileFeedPeer peer;
+    sExtInfoIter it;
+
+    n += protocol_putExtInfo(tail + n, sizeof(tail) - n, 7, "abc", 3);
+    n += protocol_putExtInfo(tail + n, sizeof(tail) - n,
+            PULL_PROT_EXTENDED_INFO_NODE_BUSY, busy, sizeof(busy));
+    n += protocol_putExtInfo(tail + n, sizeof(tail) - n,
+            FILE_FEED_EXTENDED_INFO_NO_SLICE_AVAILABLE, NULL, 0);
+    n += protocol_putExtInfo(tail + n, sizeof(tail) - n,
+            FILE_FEED_EXTENDED_INFO_MAX_CHUNK_SIZE, busy, 2);
+    n += protocol_putMaxChunkOffer(tail + n, sizeof(tail) - n, 60000);
+    n += protocol_putExtInfo(tail + n, sizeof(tail) - n, 255, NULL, 0);
+
+    protocol_peerInit(&peer, MAX_FILE_FEED_NEGOTIATED_CHUNK_SIZE);
+    it.pos = tail;
+    it.end = tail + n;
+    if (protocol_scanExtInfo(it, &signals, &peer) != 0 ||
+            !signals.nodeBusy || signals.busyData != 3 ||
+            !signals.noSliceAvailable || signals.unknown != 2 ||
+            signals.malformed != 1 || peer.maxChunkSize != 60000) {
+        loop_fail("extended info signals");
+    }
+    it.end = tail + n - 1;
+    if (protocol_scanExtInfo(it, &signals, NULL) == 0) {
+        loop_fail("scanned a truncated tail");
+    }
+}
+
+
+int main(void)
+{
+    uint8_t* slice = (uint8_t*) malloc(LOOP_SLICE_SIZE);
+    uint64_t rng = 88172645463325252ULL;
+
+    if (!slice) {
+        return 1;
+    }
+    memset(loop_crid, 'a', sizeof(loop_crid));
+    for (size_t i = 0; i < LOOP_SLICE_SIZE; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        slice[i] = (uint8_t) rng;
+    }
+    unsigned single = (LOOP_SLICE_SIZE + MAX_FILE_FEED_CHUNK_SIZE - 1) /
+            MAX_FILE_FEED_CHUNK_SIZE;
+    for (int requester = 0; requester < 2; requester++) {
+        for (int server = 0; server < 2; server++) {
+            unsigned trips = loop_download(requester, server, slice);
+            printf("loopback_protocol: %s requester, %s server: %u round trips\n",
+                    requester ? "new" : "old", server ? "new" : "old", trips);
+            if ((requester && server) ? trips >= single : trips != single) {
+                loop_fail("unexpected number of round trips");
+            }
+        }
+    }
+    loop_malformed();
+    loop_signals();
+    free(slice);
+    return 0;
+}
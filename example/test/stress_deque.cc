@@ -0,0 +1,152 @@
+/*-----------------------------------------------------------------------
+ * Concurrent stress test of sDeque, built and run under ThreadSanitizer by
+ * the stress_list target.
+ *
+ *   stress_deque [seed] [items]
+ *
+ * One owner thread pushes 'items' elements in random bursts and pops some
+ * of them back, while the thief threads keep stealing. The deque starts
+ * with room for two elements so that it grows while thieves read it. The
+ * last elements are left for deque_clear(), which hands them to the
+ * destroyFunc with thieves still stealing. Every element counts how often
+ * it was taken; at the end each one must have been taken exactly once.
+ *-----------------------------------------------------------------------*/
+
+#include "u_deque.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#define STRESS_THIEVES      3
+#define STRESS_BURST        16
+
+typedef struct {
+    long value;
+    int taken;                  /* Times popped, stolen or cleared. */
+} sItem;
+
+typedef struct {
+    sDeque* deque;
+    sItem* items;
+    size_t count;
+    unsigned seed;
+    size_t popped, stolen, cleared;
+    int stop;                   /* Set when the owner is done. */
+    int failed;
+} sStress;
+
+static sStress* stress_current;  /* For the destroyFunc. */
+
+static void stress_take(sStress* s, sItem* item, size_t* counter,
+        const char* by)
+{
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+    if (__atomic_add_fetch(&item->taken, 1, __ATOMIC_RELAXED) != 1) {
+        fprintf(stderr, "item %ld taken again by %s\n", item->value, by);
+        __atomic_store_n(&s->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void stress_destroy(void* data)
+{
+    stress_take(stress_current, (sItem*) data, &stress_current->cleared,
+            "deque_clear()");
+}
+
+static void* stress_thief(void* arg)
+{
+    sStress* s = (sStress*) arg;
+
+    for (;;) {
+        int stop = __atomic_load_n(&s->stop, __ATOMIC_ACQUIRE);
+        sItem* item = (sItem*) deque_steal(s->deque);
+        if (item) {
+            stress_take(s, item, &s->stolen, "deque_steal()");
+        } else if (stop) {
+            return NULL;
+        }
+    }
+}
+
+/* Pushes and pops on the owner's end; leaves a tail for deque_clear(). */
+static void stress_owner(sStress* s)
+{
+    uint64_t rng = s->seed * 2654435761u + 1;
+    size_t pushed = 0;
+
+    while (pushed < s->count) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        unsigned burst = 1 + (unsigned) (rng >> 8) % STRESS_BURST;
+        if (rng & 3) {
+            for (unsigned i = 0; i < burst && pushed < s->count; i++) {
+                if (deque_push(s->deque, &s->items[pushed++]) != 0) {
+                    fprintf(stderr, "deque_push() failed\n");
+                    __atomic_store_n(&s->failed, 1, __ATOMIC_RELAXED);
+                    return;
+                }
+            }
+        } else if (pushed < s->count - s->count / 16) {
+            for (unsigned i = 0; i < burst; i++) {
+                sItem* item = (sItem*) deque_pop(s->deque);
+                if (item) {
+                    stress_take(s, item, &s->popped, "deque_pop()");
+                }
+            }
+        }
+    }
+    if (deque_clear(s->deque) != 0 || deque_size(s->deque) != 0) {
+        fprintf(stderr, "deque_clear() left elements\n");
+        __atomic_store_n(&s->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t thieves[STRESS_THIEVES];
+    sStress s;
+
+    s.seed = argc > 1 ? (unsigned) strtoul(argv[1], NULL, 0) :
+            (unsigned) time(NULL);
+    s.count = argc > 2 ? (size_t) strtoul(argv[2], NULL, 0) : 1000000;
+    s.popped = s.stolen = s.cleared = 0;
+    s.stop = 0;
+    s.failed = 0;
+    printf("seed %u, %zu items, %d thieves\n", s.seed, s.count,
+            STRESS_THIEVES);
+
+    s.items = (sItem*) calloc(s.count ? s.count : 1, sizeof(sItem));
+    s.deque = deque_create(2, stress_destroy);
+    if (!s.items || !s.deque) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < s.count; i++) {
+        s.items[i].value = (long) i;
+    }
+    stress_current = &s;
+
+    for (int i = 0; i < STRESS_THIEVES; i++) {
+        pthread_create(&thieves[i], NULL, stress_thief, &s);
+    }
+    stress_owner(&s);
+    __atomic_store_n(&s.stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < STRESS_THIEVES; i++) {
+        pthread_join(thieves[i], NULL);
+    }
+
+    for (size_t i = 0; i < s.count; i++) {
+        if (s.items[i].taken != 1) {
+            fprintf(stderr, "item %zu taken %d times\n", i, s.items[i].taken);
+            s.failed = 1;
+        }
+    }
+    deque_destroy(s.deque);
+    free(s.items);
+    printf("%-16s %s (%zu popped, %zu stolen, %zu cleared)\n", "deque",
+            s.failed ? "FAILED" : "ok", s.popped, s.stolen, s.cleared);
+    return s.failed;
+}
@@ -0,0 +1,876 @@
+/*-----------------------------------------------------------------------
+ * Randomized concurrent stress test of sList, built and run under
+ * ThreadSanitizer and AddressSanitizer by the stress_list target.
+ *
+ *   stress_list_<sanitizer> [seed] [rounds]
+ *
+ * For every list configuration, worker threads run a random mix of the
+ * calls that configuration supports on two lists at once. The elements are
+ * tokens which are always in exactly one place: in one of the lists, or in
+ * the hand of the thread which pushed or popped them last. Each token has a
+ * flag set while it is in a list; pushing a token which is already in a
+ * list, or getting a token out of a list which isn't, is a failure. At the
+ * end the lists are emptied and every token must be accounted for.
+ *
+ * Tokens are also handed over to the shared lists through temporary lists
+ * with list_cat() and list_splice(). In the pool_hash configuration all
+ * lists share one pool, so those calls relink nodes under the hash index.
+ *
+ * Epoch configurations also run readers which walk the lists without the
+ * lock and read every element they see, which the sanitizers check for use
+ * after free while the workers pop and push around them.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define STRESS_THREADS      4
+#define STRESS_READERS      2
+#define STRESS_TOKENS       256         /* Per thread. */
+#define STRESS_BATCH        8
+
+typedef struct {
+    long value;
+    int inList;                 /* 1 while in one of the lists. */
+} sToken;
+
+typedef struct {
+    const char* name;
+    eListThreadAlt threadAlt;
+    eListStorage storage;
+    int hashIndex;
+    int epochReclaim;
+    unsigned shards;
+    int sharedPool;             /* All lists of the run share one pool. */
+} sStressConfig;
+
+static const sStressConfig stress_configs[] = {
+    { "threadsafe",     LIST_THREADSAFE,    LIST_STORAGE_LINKED,   0, 0, 0, 0 },
+    { "rw",             LIST_THREADSAFE_RW, LIST_STORAGE_LINKED,   0, 0, 0, 0 },
+    { "hash",           LIST_THREADSAFE,    LIST_STORAGE_LINKED,   1, 0, 0, 0 },
+    { "pool_hash",      LIST_THREADSAFE,    LIST_STORAGE_LINKED,   1, 0, 0, 1 },
+    { "unrolled",       LIST_THREADSAFE,    LIST_STORAGE_UNROLLED, 0, 0, 0, 0 },
+    { "epoch",          LIST_THREADSAFE,    LIST_STORAGE_LINKED,   0, 1, 0, 0 },
+    { "epoch_hash_rw",  LIST_THREADSAFE_RW, LIST_STORAGE_LINKED,   1, 1, 0, 0 },
+    { "sharded",        LIST_THREADSAFE,    LIST_STORAGE_LINKED,   0, 0, 4, 0 },
+    { "lockfree_mpsc",  LIST_LOCKFREE_MPSC, LIST_STORAGE_LINKED,   0, 0, 0, 0 },
+    { "lockfree_mpmc",  LIST_LOCKFREE_MPMC, LIST_STORAGE_LINKED,   0, 0, 0, 0 },
+};
+
+typedef struct {
+    const sStressConfig* config;
+    sList* lists[2];
+    sListPool* pool;            /* Shared by all lists, or NULL. */
+    sListExecutor* executor;
+    sToken* tokens;             /* STRESS_THREADS * STRESS_TOKENS. */
+    unsigned rounds;
+    unsigned seed;
+    int stop;                   /* Set when the workers are done. */
+    int failed;
+} sStress;
+
+typedef struct {
+    sStress* s;
+    unsigned id;
+    uint64_t rng;
+    sToken* hand[STRESS_THREADS * STRESS_TOKENS];
+    size_t held;
+} sStressWorker;
+
+static void stress_fail(sStress* s, const char* what, const sToken* t)
+{
+    fprintf(stderr, "%s: %s (token %ld)\n", s->config->name, what,
+            t ? t->value : -1L);
+    __atomic_store_n(&s->failed, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t stress_rand(sStressWorker* w)
+{
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return w->rng;
+}
+
+/* Marks 't' as being in a list, before pushing it. */
+static void stress_toList(sStress* s, sToken* t)
+{
+    if (__atomic_exchange_n(&t->inList, 1, __ATOMIC_RELAXED) != 0) {
+        stress_fail(s, "token pushed while in a list", t);
+    }
+}
+
+/* Takes 't', just returned by a list, into the hand of 'w'. */
+static void stress_fromList(sStressWorker* w, sToken* t)
+{
+    if (__atomic_exchange_n(&t->inList, 0, __ATOMIC_RELAXED) != 1) {
+        stress_fail(w->s, "token returned while not in a list", t);
+    }
+    w->hand[w->held++] = t;
+}
+
+static int stress_cmp(void* a, void* b)
+{
+    long x = ((sToken*) a)->value;
+    long y = ((sToken*) b)->value;
+    return x < y ? -1 : x > y;
+}
+
+static int32_t stress_visit(void* element, void* param)
+{
+    sToken* t = (sToken*) element;
+    if (t->value < 0) {
+        __atomic_add_fetch((long*) param, 1, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+static int stress_isLockFree(const sStressConfig* c)
+{
+    return c->threadAlt == LIST_LOCKFREE_MPSC || c->threadAlt == LIST_LOCKFREE_MPMC;
+}
+
+/* Locked, unsharded lists support every call. */
+static int stress_isFull(const sStressConfig* c)
+{
+    return !stress_isLockFree(c) && c->shards < 2;
+}
+
+static sList* stress_create(const sStress* s)
+{
+    const sStressConfig* c = s->config;
+    sListAttr attr;
+    list_attrInit(&attr);
+    attr.pool = s->pool;
+    attr.threadAlt = c->threadAlt;
+    attr.storage = c->storage;
+    attr.hashIndex = c->hashIndex;
+    attr.epochReclaim = c->epochReclaim;
+    attr.shards = c->shards;
+    return list_createAttr(NULL, &attr);
+}
+
+/* Pushes one token, or a batch, from the hand of 'w' to 'l'. */
+static void stress_push(sStressWorker* w, sList* l, unsigned kind)
+{
+    sStress* s = w->s;
+    const sStressConfig* c = s->config;
+
+    if (w->held == 0) {
+        return;
+    }
+    if (kind == 0 && w->held >= STRESS_BATCH && !stress_isLockFree(c)) {
+        void** items = (void**) &w->hand[w->held - STRESS_BATCH];
+        for (int i = 0; i < STRESS_BATCH; i++) {
+            stress_toList(s, (sToken*) items[i]);
+        }
+        if (list_pushBackN(l, items, STRESS_BATCH) != 0) {
+            stress_fail(s, "list_pushBackN failed", NULL);
+        }
+        w->held -= STRESS_BATCH;
+        return;
+    }
+    sToken* t = w->hand[--w->held];
+    int ret;
+    stress_toList(s, t);
+    if (kind == 1 && !stress_isLockFree(c)) {
+        ret = list_pushFront(l, t);
+    } else if (kind == 2 && stress_isFull(c)) {
+        ret = list_insertSorted(l, t, stress_cmp);
+    } else {
+        ret = list_pushBack(l, t);
+    }
+    if (ret != 0) {
+        stress_fail(s, "push failed", t);
+    }
+}
+
+/* Takes one token, or a batch, out of 'l' into the hand of 'w'. */
+static void stress_pop(sStressWorker* w, sList* l, unsigned kind)
+{
+    sStress* s = w->s;
+    const sStressConfig* c = s->config;
+    sToken* t = NULL;
+
+    if (kind == 0 && !stress_isLockFree(c)) {
+        void* items[STRESS_BATCH];
+        size_t n = list_popFrontN(l, items, STRESS_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            stress_fromList(w, (sToken*) items[i]);
+        }
+        return;
+    }
+    if (kind == 1 && !stress_isLockFree(c)) {
+        t = (sToken*) list_popBack(l);
+    } else if (kind == 2 && !stress_isLockFree(c)) {
+        /* Any token, possibly in another list or hand. */
+        sToken* any = &s->tokens[stress_rand(w) %
+                (STRESS_THREADS * STRESS_TOKENS)];
+        if (list_remove(l, any) == 0) {
+            t = any;
+        }
+    } else if (kind == 3 && c->threadAlt == LIST_THREADSAFE && !c->shards) {
+        t = (sToken*) list_popFrontWait(l, 0);
+    } else {
+        t = (sToken*) list_popFront(l);
+    }
+    if (t) {
+        stress_fromList(w, t);
+    }
+}
+
+/* Calls which look at or rearrange the lists without moving tokens out. */
+static void stress_other(sStressWorker* w, unsigned kind)
+{
+    sStress* s = w->s;
+    const sStressConfig* c = s->config;
+    sList* l = s->lists[stress_rand(w) & 1];
+    sList* other = s->lists[l == s->lists[0]];
+    long negative = 0;
+
+    if (stress_isLockFree(c)) {
+        /* A pop racing with the push of the same node mustn't wrap it. */
+        if (list_size(l) > STRESS_THREADS * STRESS_TOKENS) {
+            stress_fail(s, "list size out of range", NULL);
+        }
+        return;
+    }
+    switch (kind) {
+    case 0:
+        list_foreach(l, stress_visit, &negative);
+        break;
+    case 1: {
+        sToken* any = &s->tokens[stress_rand(w) %
+                (STRESS_THREADS * STRESS_TOKENS)];
+        (void) list_exists(l, any);
+        sToken* found = (sToken*) list_find(l, any, stress_cmp);
+        if (found && found != any) {
+            stress_fail(s, "list_find returned another token", found);
+        }
+        break;
+    }
+    case 2:
+        if (stress_isFull(c)) {
+            list_sort(l, stress_cmp);
+        }
+        break;
+    case 3:
+        if (stress_isFull(c)) {
+            list_foreachParallel(l, stress_visit, &negative, s->executor, 1);
+        }
+        break;
+    case 4:
+        /* Opposite directions from different threads must not deadlock. */
+        if (stress_isFull(c) && list_drain(l, other) < 0) {
+            stress_fail(s, "list_drain failed", NULL);
+        }
+        break;
+    case 5:
+        /* Hand a few tokens over through a temporary list and list_cat(). */
+        if (stress_isFull(c) && w->held > 0) {
+            sList* tmp = stress_create(s);
+            while (tmp && w->held > 0 && list_size(tmp) < STRESS_BATCH) {
+                sToken* t = w->hand[--w->held];
+                stress_toList(s, t);
+                list_pushBack(tmp, t);
+            }
+            if (!tmp || list_cat(l, tmp) != l) {
+                stress_fail(s, "list_cat failed", NULL);
+            }
+        }
+        break;
+    case 6:
+        /*
+         * Hand a few tokens over with list_splice(), after moving the last
+         * one to the front within the temporary list.
+         */
+        if (stress_isFull(c) && c->storage == LIST_STORAGE_LINKED &&
+                w->held > 0) {
+            sList* tmp = stress_create(s);
+            while (tmp && w->held > 0 && list_size(tmp) < STRESS_BATCH) {
+                sToken* t = w->hand[--w->held];
+                stress_toList(s, t);
+                list_pushBack(tmp, t);
+            }
+            if (!tmp || (list_size(tmp) > 1 &&
+                    list_splice(tmp, tmp->head, tmp, tmp->tail, NULL) != 1)) {
+                stress_fail(s, "list_splice within a list failed", NULL);
+            }
+            ssize_t n = tmp ? (ssize_t) list_size(tmp) : 0;
+            if (tmp && list_splice(l, NULL, tmp, tmp->head, NULL) != n) {
+                stress_fail(s, "list_splice failed", NULL);
+            }
+            list_destroy(tmp);
+        }
+        break;
+    default:
+        (void) list_peekFront(l);
+        (void) list_size(l);
+        break;
+    }
+    if (negative) {
+        stress_fail(s, "corrupt element", NULL);
+    }
+}
+
+static void* stress_worker(void* arg)
+{
+    sStressWorker* w = (sStressWorker*) arg;
+    sStress* s = w->s;
+
+    for (unsigned i = 0; i < s->rounds; i++) {
+        uint64_t r = stress_rand(w);
+        sList* l = s->lists[r & 1];
+        unsigned kind = (unsigned) (r >> 8) % 8;
+        unsigned what = (unsigned) (r >> 4) % 8;
+        if (s->config->threadAlt == LIST_LOCKFREE_MPSC && w->id != 0 &&
+                what >= 3 && what <= 5) {
+            /* Worker 0 is the single consumer, the others only push. */
+            what = 0;
+        }
+        switch (what) {
+        case 0: case 1: case 2:
+            stress_push(w, l, kind);
+            break;
+        case 3: case 4: case 5:
+            stress_pop(w, l, kind);
+            break;
+        default:
+            stress_other(w, kind);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Walks the epoch lists without their locks until the workers are done. */
+static void* stress_reader(void* arg)
+{
+    sStress* s = (sStress*) arg;
+    long negative = 0;
+
+    while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < 2; i++) {
+            sListEpochGuard guard;
+            if (list_epochEnter(s->lists[i], &guard) != 0) {
+                continue;
+            }
+            for (sListNode* cur = list_epochFirst(&guard); cur;
+                    cur = list_epochNext(&guard, cur)) {
+                stress_visit(cur->data, &negative);
+            }
+            list_epochExit(&guard);
+        }
+    }
+    if (negative) {
+        stress_fail(s, "corrupt element seen by an epoch reader", NULL);
+    }
+    return NULL;
+}
+
+/* Runs one configuration. Returns 0 if it passed. */
+static int stress_run(const sStressConfig* c, unsigned seed, unsigned rounds)
+{
+    static sStressWorker workers[STRESS_THREADS];
+    pthread_t threads[STRESS_THREADS];
+    pthread_t readers[STRESS_READERS];
+    size_t total = STRESS_THREADS * STRESS_TOKENS;
+    sStress s;
+
+    memset(&s, 0, sizeof(s));
+    s.config = c;
+    s.rounds = rounds;
+    s.seed = seed;
+    s.tokens = (sToken*) calloc(total, sizeof(sToken));
+    s.pool = c->sharedPool ? list_poolCreate(0) : NULL;
+    s.lists[0] = stress_create(&s);
+    s.lists[1] = stress_create(&s);
+    s.executor = list_executorCreate(2);
+    if (!s.tokens || !s.lists[0] || !s.lists[1] || !s.executor ||
+            (c->sharedPool && !s.pool)) {
+        fprintf(stderr, "%s: setup failed\n", c->name);
+        return -1;
+    }
+    for (size_t i = 0; i < total; i++) {
+        s.tokens[i].value = (long) i;
+    }
+    for (unsigned i = 0; i < STRESS_THREADS; i++) {
+        sStressWorker* w = &workers[i];
+        w->s = &s;
+        w->id = i;
+        w->rng = ((uint64_t) seed << 32 | i) * 0x9E3779B97F4A7C15ULL + 1;
+        w->held = 0;
+        for (size_t j = 0; j < STRESS_TOKENS; j++) {
+            w->hand[w->held++] = &s.tokens[i * STRESS_TOKENS + j];
+        }
+    }
+
+    unsigned nreaders = c->epochReclaim ? STRESS_READERS : 0;
+    for (unsigned i = 0; i < nreaders; i++) {
+        pthread_create(&readers[i], NULL, stress_reader, &s);
+    }
+    for (unsigned i = 0; i < STRESS_THREADS; i++) {
+        pthread_create(&threads[i], NULL, stress_worker, &workers[i]);
+    }
+    for (unsigned i = 0; i < STRESS_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    __atomic_store_n(&s.stop, 1, __ATOMIC_RELEASE);
+    for (unsigned i = 0; i < nreaders; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    /* Every token must be in a hand or in a list, exactly once. */
+    size_t found = 0;
+    for (unsigned i = 0; i < STRESS_THREADS; i++) {
+        found += workers[i].held;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!stress_isLockFree(c) && list_size(s.lists[i]) > total) {
+            stress_fail(&s, "list size out of range", NULL);
+        }
+        sToken* t;
+        while ((t = (sToken*) list_popFront(s.lists[i])) != NULL) {
+            if (__atomic_exchange_n(&t->inList, 0, __ATOMIC_RELAXED) != 1) {
+                stress_fail(&s, "token in a list twice", t);
+            }
+            found++;
+        }
+        if (list_size(s.lists[i]) != 0) {
+            stress_fail(&s, "list not empty after popping everything", NULL);
+        }
+    }
+    for (size_t i = 0; i < total; i++) {
+        if (s.tokens[i].inList) {
+            stress_fail(&s, "token lost", &s.tokens[i]);
+        }
+    }
+    if (found != total) {
+        fprintf(stderr, "%s: %zu tokens accounted for, expected %zu\n",
+                c->name, found, total);
+        s.failed = 1;
+    }
+
+    list_executorDestroy(s.executor);
+    list_destroy(s.lists[0]);
+    list_destroy(s.lists[1]);
+    list_poolDestroy(s.pool);
+    free(s.tokens);
+    printf("%-16s %s\n", c->name, s.failed ? "FAILED" : "ok");
+    return s.failed ? -1 : 0;
+}
+
+/*
+ * Moves nodes within one hash-indexed list holding the same element several
+ * times, checking the index against the list after every step. Single
+ * threaded; returns 0 if it passed.
+ */
+static int stress_spliceDuplicates(void)
+{
+    sToken t[3] = { { 3, 0 }, { 5, 0 }, { 9, 0 } };
+    sToken* order[] = { &t[1], &t[2], &t[0], &t[1] };
+    sListAttr attr;
+    int failed = 0;
+
+    list_attrInit(&attr);
+    attr.hashIndex = 1;
+    sList* l = list_createAttr(NULL, &attr);
+    if (!l || list_pushBackN(l, (void**) order, 4) != 0 ||
+            list_sort(l, stress_cmp) != 0) {
+        fprintf(stderr, "splice_dup: setup failed\n");
+        return -1;
+    }
+
+    /* 3 5 5 9: move the second 5 to the head, then remove the first 5. */
+    sListNode* second = l->head->next->next;
+    if (list_splice(l, l->head, l, second, second->next) != 1 ||
+            list_remove(l, &t[1]) != 0 || l->head->data != &t[0] ||
+            !list_exists(l, &t[1])) {
+        failed = 1;
+    }
+    /* 3 5 9: add a 5 at the head, move it to the back and remove a 5. */
+    if (list_insert(l, &t[1], l->head) != 0 ||
+            list_splice(l, NULL, l, l->head, l->head->next) != 1 ||
+            list_remove(l, &t[1]) != 0 || l->head->next->data != &t[2] ||
+            list_remove(l, &t[1]) != 0 || list_exists(l, &t[1]) ||
+            list_size(l) != 2) {
+        failed = 1;
+    }
+    list_destroy(l);
+    printf("%-16s %s\n", "splice_dup", failed ? "FAILED" : "ok");
+    return failed ? -1 : 0;
+}
+
+/*
+ * Moves nodes within one epoch list, which copies the elements into new
+ * nodes, including a range running to the tail moved to the tail. Single
+ * threaded; returns 0 if it passed.
+ */
+static int stress_spliceEpoch(void)
+{
+    sToken t[5] = { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 }, { 4, 0 } };
+    sToken* order[] = { &t[0], &t[1], &t[2], &t[3], &t[4] };
+    static const int expected[] = { 1, 2, 3, 4, 0 };
+    sListAttr attr;
+    int failed = 0;
+
+    list_attrInit(&attr);
+    attr.epochReclaim = 1;
+    sList* l = list_createAttr(NULL, &attr);
+    if (!l || list_pushBackN(l, (void**) order, 5) != 0) {
+        fprintf(stderr, "splice_epoch: setup failed\n");
+        return -1;
+    }
+
+    /* 0 1 2 3 4: the last three to the tail, then the head to the tail. */
+    if (list_splice(l, NULL, l, l->head->next->next, NULL) != 3 ||
+            list_splice(l, NULL, l, l->head, l->head->next) != 1 ||
+            list_size(l) != 5) {
+        failed = 1;
+    }
+    int i = 0;
+    for (sListNode* cur = l->head; cur && i < 5; cur = cur->next, i++) {
+        if (((sToken*) cur->data)->value != expected[i]) {
+            failed = 1;
+        }
+    }
+    list_destroy(l);
+    printf("%-16s %s\n", "splice_epoch", failed ? "FAILED" : "ok");
+    return failed ? -1 : 0;
+}
+
+/*
+ * list_cat() between hash-indexed lists on two different shared pools, which
+ * moves the elements into new nodes one by one. Single threaded; returns 0
+ * if it passed.
+ */
+static int stress_catPools(void)
+{
+    sToken t[4] = { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 } };
+    sToken* order[] = { &t[0], &t[1], &t[2], &t[3] };
+    sListPool* pools[2] = { list_poolCreate(0), list_poolCreate(0) };
+    sList* lists[2] = { NULL, NULL };
+    sListAttr attr;
+    int failed = 0;
+
+    list_attrInit(&attr);
+    attr.hashIndex = 1;
+    for (int i = 0; i < 2; i++) {
+        attr.pool = pools[i];
+        lists[i] = pools[i] ? list_createAttr(NULL, &attr) : NULL;
+    }
+    if (!lists[0] || !lists[1] ||
+            list_pushBackN(lists[0], (void**) order, 2) != 0 ||
+            list_pushBackN(lists[1], (void**) order + 2, 2) != 0) {
+        fprintf(stderr, "cat_pools: setup failed\n");
+        return -1;
+    }
+    if (list_cat(lists[0], lists[1]) != lists[0] || list_size(lists[0]) != 4) {
+        failed = 1;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (!list_exists(lists[0], &t[i])) {
+            failed = 1;
+        }
+    }
+    if (list_remove(lists[0], &t[3]) != 0 || list_exists(lists[0], &t[3])) {
+        failed = 1;
+    }
+    list_destroy(lists[0]);
+    list_poolDestroy(pools[0]);
+    list_poolDestroy(pools[1]);
+    printf("%-16s %s\n", "cat_pools", failed ? "FAILED" : "ok");
+    return failed ? -1 : 0;
+}
+
+/*
+ * Pushes NULL elements to a sharded list, one at a time and in a batch
+ * whose other items are valid. Both must fail without storing anything,
+ * since popping NULL reads as an empty list. Returns 0 if it passed.
+ */
+static int stress_shardedNull(void)
+{
+    sToken t = { 0, 0 };
+    void* items[] = { &t, NULL, &t };
+    sListAttr attr;
+    int failed = 0;
+
+    list_attrInit(&attr);
+    attr.shards = 2;
+    sList* l = list_createAttr(NULL, &attr);
+    if (!l) {
+        fprintf(stderr, "sharded_null: setup failed\n");
+        return -1;
+    }
+    if (list_pushBack(l, NULL) == 0 || list_pushFront(l, NULL) == 0 ||
+            list_pushBackN(l, items, 3) == 0 || list_size(l) != 0 ||
+            list_pushBackN(l, items, 1) != 0 || list_popFront(l) != &t) {
+        failed = 1;
+    }
+    list_destroy(l);
+    printf("%-16s %s\n", "sharded_null", failed ? "FAILED" : "ok");
+    return failed ? -1 : 0;
+}
+
+static int stress_destroyed;
+
+static void stress_countDestroy(void* data)
+{
+    (void) data;
+    stress_destroyed++;
+}
+
+/*
+ * Pushes NULL elements to lock-free lists, which must fail as for sharded
+ * ones; a stored NULL would end list_clear() and list_destroy() early and
+ * leak the elements behind it. Returns 0 if it passed.
+ */
+static int stress_lockfreeNull(void)
+{
+    static const eListThreadAlt modes[] = { LIST_LOCKFREE_MPSC,
+                                            LIST_LOCKFREE_MPMC };
+    sToken t[3] = { { 0, 0 }, { 1, 0 }, { 2, 0 } };
+    void* items[] = { &t[1], NULL, &t[2] };
+    sListAttr attr;
+    int failed = 0;
+
+    list_attrInit(&attr);
+    for (int i = 0; i < 2; i++) {
+        attr.threadAlt = modes[i];
+        sList* l = list_createAttr(stress_countDestroy, &attr);
+        if (!l) {
+            fprintf(stderr, "lockfree_null: setup failed\n");
+            return -1;
+        }
+        stress_destroyed = 0;
+        if (list_pushBack(l, &t[0]) != 0 || list_pushBack(l, NULL) == 0 ||
+                list_pushBackN(l, items, 3) == 0 || list_size(l) != 1 ||
+                list_pushBack(l, &t[1]) != 0 || list_clear(l) != 0 ||
+                stress_destroyed != 2 || list_size(l) != 0) {
+            failed = 1;
+        }
+        list_pushBackN(l, items + 2, 1);
+        list_destroy(l);
+        if (stress_destroyed != 3) {
+            failed = 1;
+        }
+    }
+    printf("%-16s %s\n", "lockfree_null", failed ? "FAILED" : "ok");
+    return failed ? -1 : 0;
+}
+
+#ifdef LIST_INSTRUMENT
+/*
+ * Minimal JSON syntax check of the instrumentation dump. Each function
+ * skips one value starting at 'p' and returns the position after it, or
+ * NULL if it isn't valid JSON.
+ */
+static const char* json_value(const char* p);
+
+static const char* json_space(const char* p)
+{
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') {
+        p++;
+    }
+    return p;
+}
+
+static const char* json_string(const char* p)
+{
+    if (*p++ != '"') {
+        return NULL;
+    }
+    while (*p != '"') {
+        if ((unsigned char) *p < 0x20) {
+            return NULL;
+        }
+        if (*p == '\\') {
+            p++;
+            if (*p == 'u') {
+                for (int i = 1; i <= 4; i++) {
+                    if (!strchr("0123456789abcdefABCDEF", p[i]) || !p[i]) {
+                        return NULL;
+                    }
+                }
+                p += 4;
+            } else if (!*p || !strchr("\"\\/bfnrt", *p)) {
+                return NULL;
+            }
+        }
+        p++;
+    }
+    return p + 1;
+}
+
+/* Skips the members of an object, or the elements of an array. */
+static const char* json_members(const char* p, char close, int object)
+{
+    p = json_space(p + 1);
+    if (*p == close) {
+        return p + 1;
+    }
+    for (;;) {
+        if (object) {
+            p = json_string(json_space(p));
+            if (!p || *(p = json_space(p)) != ':') {
+                return NULL;
+            }
+            p++;
+        }
+        p = json_value(p);
+        if (!p) {
+            return NULL;
+        }
+        p = json_space(p);
+        if (*p == close) {
+            return p + 1;
+        }
+        if (*p++ != ',') {
+            return NULL;
+        }
+    }
+}
+
+static const char* json_value(const char* p)
+{
+    p = json_space(p);
+    if (*p == '{') {
+        return json_members(p, '}', 1);
+    }
+    if (*p == '[') {
+        return json_members(p, ']', 0);
+    }
+    if (*p == '"') {
+        return json_string(p);
+    }
+    const char* start = p;
+    if (*p == '-') {
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p > start ? p : NULL;
+}
+
+/*
+ * Runs a known single threaded workload on instrumented lists and checks
+ * the operation counts, then checks that the JSON dump of every list,
+ * including one whose name needs escaping, parses. Returns 0 if it passed.
+ */
+static int stress_instrument(void)
+{
+    sToken t[8];
+    sListOpStats stats;
+    sListAttr attr;
+    long negative = 0;
+    int failed = 0;
+
+    for (int i = 0; i < 8; i++) {
+        t[i].value = 7 - i;
+        t[i].inList = 0;
+    }
+    list_attrInit(&attr);
+    sList* l = list_createAttr(NULL, &attr);
+    attr.shards = 4;
+    sList* sharded = list_createAttr(NULL, &attr);
+    if (!l || !sharded || list_setName(l, "quote\" slash\\ tab\t") != 0) {
+        fprintf(stderr, "instrument: setup failed\n");
+        return -1;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        list_pushBack(l, &t[i]);
+        list_pushBack(sharded, &t[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        (void) list_popFront(l);
+    }
+    (void) list_peekFront(l);
+    (void) list_popFrontWait(l, 0);
+    (void) list_exists(l, &t[7]);
+    (void) list_find(l, &t[6], stress_cmp);
+    list_remove(l, &t[7]);
+    list_foreach(l, stress_visit, &negative);
+    list_foreachParallel(l, stress_visit, &negative, NULL, 0);
+    list_sort(l, stress_cmp);
+    list_foreachParallel(sharded, stress_visit, &negative, NULL, 0);
+    list_clear(l);
+
+    /* push pop peek find remove iterate other */
+    static const uint64_t expected[LIST_OP_COUNT] = { 8, 4, 1, 2, 1, 3, 1 };
+    if (list_getStats(l, &stats) != 0 || stats.maxSize != 8 ||
+            stats.lockAcquired < 20 || stats.lockHoldNs == 0) {
+        failed = 1;
+    }
+    for (int op = 0; op < LIST_OP_COUNT; op++) {
+        uint64_t buckets = 0;
+        for (int i = 0; i < LIST_LATENCY_BUCKETS; i++) {
+            buckets += stats.ops[op].latency[i];
+        }
+        if (stats.ops[op].count != expected[op] || buckets != expected[op]) {
+            fprintf(stderr, "instrument: op %d counted %llu times, "
+                    "expected %llu\n", op,
+                    (unsigned long long) stats.ops[op].count,
+                    (unsigned long long) expected[op]);
+            failed = 1;
+        }
+    }
+    if (list_getStats(sharded, &stats) != 0 ||
+            stats.ops[LIST_OP_ITERATE].count != 1) {
+        fprintf(stderr, "instrument: sharded walk not counted once\n");
+        failed = 1;
+    }
+
+    char* json = NULL;
+    size_t jsonSize = 0;
+    FILE* out = open_memstream(&json, &jsonSize);
+    if (!out || list_dumpStatsJson(out) != 0 || fclose(out) != 0) {
+        failed = 1;
+    } else {
+        const char* end = json_value(json);
+        if (!end || *json_space(end) != '\0' ||
+                !strstr(json, "\"quote\\\" slash\\\\ tab\\u0009\"")) {
+            fprintf(stderr, "instrument: bad JSON dump: %s\n", json);
+            failed = 1;
+        }
+    }
+    free(json);
+    list_destroy(sharded);
+    list_destroy(l);
+    printf("%-16s %s\n", "instrument", failed ? "FAILED" : "ok");
+    return failed ? -1 : 0;
+}
+#endif /* LIST_INSTRUMENT */
+
+
+int main(int argc, char** argv)
+{
+    unsigned seed = argc > 1 ? (unsigned) strtoul(argv[1], NULL, 0) :
+            (unsigned) time(NULL);
+    unsigned rounds = argc > 2 ? (unsigned) strtoul(argv[2], NULL, 0) : 20000;
+    int failed = 0;
+
+    printf("seed %u, %u rounds per thread\n", seed, rounds);
+    if (stress_spliceDuplicates() != 0 || stress_spliceEpoch() != 0 ||
+            stress_catPools() != 0 || stress_shardedNull() != 0 ||
+            stress_lockfreeNull() != 0) {
+        failed = 1;
+    }
+#ifdef LIST_INSTRUMENT
+    if (stress_instrument() != 0) {
+        failed = 1;
+    }
+#endif
+    for (size_t i = 0; i < sizeof(stress_configs) / sizeof(stress_configs[0]); i++) {
+        if (stress_run(&stress_configs[i], seed, rounds) != 0) {
+            failed = 1;
+        }
+    }
+    return failed;
+}
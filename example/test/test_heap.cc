@@ -0,0 +1,238 @@
+/*-----------------------------------------------------------------------
+ * Tests of sHeap, built under AddressSanitizer and UBSan and run by ctest.
+ *
+ *   test_heap [seed]
+ *
+ * For every locking mode: random keys, more than one slab of them, must pop
+ * in the order of a sorted copy; keys changed and elements removed through
+ * handles in the middle of the heap must keep it ordered; and a handle
+ * whose node was recycled must be refused, until a new element reuses the
+ * node and the handle becomes valid again for that element.
+ *-----------------------------------------------------------------------*/
+
+#include "u_heap.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TEST_ELEMENTS       1000        /* Over 15 slabs of nodes. */
+#define TEST_KEYS           300         /* So that some keys repeat. */
+
+typedef struct {
+    long key;
+    sHeapNode* handle;
+} sElement;
+
+static uint64_t test_rng;
+
+static uint64_t test_rand(void)
+{
+    test_rng ^= test_rng << 13;
+    test_rng ^= test_rng >> 7;
+    test_rng ^= test_rng << 17;
+    return test_rng;
+}
+
+static int test_cmp(void* a, void* b)
+{
+    long x = ((sElement*) a)->key, y = ((sElement*) b)->key;
+    return x < y ? -1 : x > y;
+}
+
+static int test_cmpLong(const void* a, const void* b)
+{
+    long x = *(const long*) a, y = *(const long*) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Checks the heap property and that every handle knows its position. */
+static int test_valid(sHeap* h)
+{
+    for (size_t i = 0; i < h->size; i++) {
+        if (h->nodes[i]->index != i ||
+                ((sElement*) h->nodes[i]->data)->handle != h->nodes[i]) {
+            return 0;
+        }
+        if (i > 0 && test_cmp(h->nodes[(i - 1) / 2]->data,
+                    h->nodes[i]->data) > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Pops everything from 'h' and compares the keys with the 'n' keys in
+ * 'expected', which are sorted in place. Returns 0 if they match.
+ */
+static int test_drain(sHeap* h, long* expected, size_t n)
+{
+    qsort(expected, n, sizeof(long), test_cmpLong);
+    for (size_t i = 0; i < n; i++) {
+        sElement* e = (sElement*) heap_pop(h);
+        if (!e || e->key != expected[i]) {
+            fprintf(stderr, "pop %zu: got %ld, expected %ld\n", i,
+                    e ? e->key : -1L, expected[i]);
+            return -1;
+        }
+    }
+    return heap_pop(h) == NULL && heap_size(h) == 0 ? 0 : -1;
+}
+
+static int test_push(sHeap* h, sElement* e, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        e[i].key = (long) (test_rand() % TEST_KEYS);
+        e[i].handle = heap_push(h, &e[i]);
+        if (!e[i].handle) {
+            return -1;
+        }
+    }
+    return test_valid(h) ? 0 : -1;
+}
+
+static int test_order(sHeap* h, sElement* e, long* keys)
+{
+    if (test_push(h, e, TEST_ELEMENTS) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < TEST_ELEMENTS; i++) {
+        keys[i] = e[i].key;
+    }
+    return test_drain(h, keys, TEST_ELEMENTS);
+}
+
+/* Returns an element whose node sits in the middle half of the heap. */
+static sElement* test_middle(sHeap* h)
+{
+    size_t index = h->size / 4 + test_rand() % (h->size / 2);
+    return (sElement*) h->nodes[index]->data;
+}
+
+static int test_middleOps(sHeap* h, sElement* e, long* keys)
+{
+    if (test_push(h, e, TEST_ELEMENTS) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < 200; i++) {
+        sElement* m = test_middle(h);
+        long key = (long) (test_rand() % (3 * TEST_KEYS)) - TEST_KEYS;
+        switch (i % 3) {
+        case 0:
+            heap_lock(h);
+            m->key = key;
+            if (heap_updateLocked(h, m->handle) != 0) {
+                heap_unlock(h);
+                return -1;
+            }
+            heap_unlock(h);
+            break;
+        case 1:
+            /* Unlocked key changes are only safe without other threads. */
+            m->key = key;
+            if (heap_update(h, m->handle) != 0) {
+                return -1;
+            }
+            break;
+        default:
+            if (heap_remove(h, m->handle) != m) {
+                return -1;
+            }
+            m->handle = NULL;
+            break;
+        }
+        if (!test_valid(h)) {
+            fprintf(stderr, "heap broken after op %d\n", i);
+            return -1;
+        }
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < TEST_ELEMENTS; i++) {
+        if (e[i].handle) {
+            keys[n++] = e[i].key;
+        }
+    }
+    return n == heap_size(h) ? test_drain(h, keys, n) : -1;
+}
+
+static int test_reuse(sHeap* h, sElement* e)
+{
+    if (test_push(h, e, 100) != 0) {
+        return -1;
+    }
+    /* A handle whose element was removed or popped is refused. */
+    sElement* m = test_middle(h);
+    sHeapNode* stale = m->handle;
+    if (heap_remove(h, stale) != m || heap_remove(h, stale) != NULL ||
+            heap_update(h, stale) != -1 || !test_valid(h)) {
+        return -1;
+    }
+    sElement* front = (sElement*) heap_peek(h);
+    sHeapNode* popped = front->handle;
+    if (heap_pop(h) != front || heap_update(h, popped) != -1) {
+        return -1;
+    }
+
+    /*
+     * Nodes are recycled last in, first out: the next two pushes get the
+     * popped node and then the removed one back, and the old handles now
+     * refer to the new elements.
+     */
+    sElement fresh[2] = { { -1, NULL }, { 1000000, NULL } };
+    fresh[0].handle = heap_push(h, &fresh[0]);
+    fresh[1].handle = heap_push(h, &fresh[1]);
+    if (fresh[0].handle != popped || fresh[1].handle != stale ||
+            heap_peek(h) != &fresh[0] || !test_valid(h)) {
+        return -1;
+    }
+    fresh[0].key = 2000000;
+    if (heap_update(h, popped) != 0 || !test_valid(h)) {
+        return -1;
+    }
+    fresh[1].key = -2;
+    if (heap_update(h, stale) != 0 || heap_peek(h) != &fresh[1] ||
+            !test_valid(h)) {
+        return -1;
+    }
+    if (heap_remove(h, popped) != &fresh[0] ||
+            heap_remove(h, stale) != &fresh[1] || heap_remove(h, stale) ||
+            heap_size(h) != 98 || !test_valid(h)) {
+        return -1;
+    }
+    return heap_clear(h) == 0 && heap_size(h) == 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    static const struct {
+        const char* name;
+        eListThreadAlt threadAlt;
+    } modes[] = {
+        { "not_threadsafe", LIST_NOT_THREADSAFE },
+        { "threadsafe",     LIST_THREADSAFE },
+        { "rw",             LIST_THREADSAFE_RW },
+    };
+    static sElement elements[TEST_ELEMENTS];
+    static long keys[TEST_ELEMENTS];
+    unsigned seed = argc > 1 ? (unsigned) strtoul(argv[1], NULL, 0) :
+            (unsigned) time(NULL);
+    int failed = 0;
+
+    printf("seed %u\n", seed);
+    test_rng = seed * 2654435761u + 1;
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        sHeap* h = heap_create(test_cmp, NULL, modes[i].threadAlt);
+        int order = h ? test_order(h, elements, keys) : -1;
+        int middle = h ? test_middleOps(h, elements, keys) : -1;
+        int reuse = h ? test_reuse(h, elements) : -1;
+        heap_destroy(h);
+        printf("%-16s order %s, middle %s, reuse %s\n", modes[i].name,
+                order ? "FAILED" : "ok", middle ? "FAILED" : "ok",
+                reuse ? "FAILED" : "ok");
+        if (order || middle || reuse) {
+            failed = 1;
+        }
+    }
+    return failed;
+}
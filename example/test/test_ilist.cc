@@ -0,0 +1,144 @@
+/*-----------------------------------------------------------------------
+ * Tests of sIList, built under AddressSanitizer and UBSan and run by ctest.
+ *
+ *   test_ilist
+ *
+ * ilist_remove() and ilist_contains() trust the back-pointer in an
+ * object's link, so for every locking mode they are called with objects
+ * linked into a different list through the same link, with objects which
+ * are in another list through their other link, and with objects moved
+ * from one list to another. Lists must never change through a call naming
+ * the wrong list.
+ *-----------------------------------------------------------------------*/
+
+#include "u_ilist.h"
+#include <stdio.h>
+
+#define TEST_OBJECTS        10
+
+typedef struct {
+    int id;
+    sIListLink a;               /* In the 'a' lists. */
+    sIListLink b;               /* In the 'b' list. */
+} sObject;
+
+/*
+ * Checks that 'l' holds exactly the objects numbered in 'ids', in that
+ * order, with consistent links. Returns 0 if it does.
+ */
+static int test_check(sIList* l, const int* ids, size_t n)
+{
+    sIListLink* prev = NULL;
+    size_t i = 0;
+
+    if (ilist_size(l) != n) {
+        return -1;
+    }
+    for (void* obj = ilist_next(l, NULL); obj; obj = ilist_next(l, obj)) {
+        sIListLink* link = (sIListLink*) ((char*) obj + l->linkOffset);
+        if (i == n || ((sObject*) obj)->id != ids[i++] ||
+                link->list != l || link->prev != prev ||
+                !ilist_contains(l, obj)) {
+            return -1;
+        }
+        prev = link;
+    }
+    return i == n && l->tail == prev ? 0 : -1;
+}
+
+static int test_mode(eListThreadAlt threadAlt)
+{
+    static const int a1Ids[] = { 0, 1, 2, 3, 4 };
+    static const int a2Ids[] = { 5, 6, 7 };
+    static const int bIds[] = { 0, 1, 3, 4 };
+    static const int a1Moved[] = { 0, 1, 3, 4 };
+    static const int a2Moved[] = { 5, 6, 7, 2 };
+    sObject o[TEST_OBJECTS];
+    sIList* a1 = ilist_create(offsetof(sObject, a), NULL, threadAlt);
+    sIList* a2 = ilist_create(offsetof(sObject, a), NULL, threadAlt);
+    sIList* b = ilist_create(offsetof(sObject, b), NULL, threadAlt);
+    int failed = 0;
+
+    for (int i = 0; i < TEST_OBJECTS; i++) {
+        sIListLink init = ILIST_LINK_INIT;
+        o[i].id = i;
+        o[i].a = init;
+        o[i].b = init;
+    }
+    if (!a1 || !a2 || !b) {
+        ilist_destroy(a1);
+        ilist_destroy(a2);
+        ilist_destroy(b);
+        return -1;
+    }
+    for (int i = 0; i < 5; i++) {
+        ilist_pushBack(a1, &o[i]);
+        ilist_pushBack(b, &o[i]);
+    }
+    for (int i = 5; i < 8; i++) {
+        ilist_pushBack(a2, &o[i]);
+    }
+
+    /* Same link, other list: the head, a middle and the tail object. */
+    for (int i = 0; i < 5; i += 2) {
+        if (ilist_contains(a2, &o[i]) || ilist_remove(a2, &o[i]) != -1 ||
+                ilist_pushBack(a2, &o[i]) != -1 ||
+                ilist_insert(a2, &o[i], NULL) != -1) {
+            failed = 1;
+        }
+    }
+    /* Not in any list, or placed before an object of another list. */
+    if (ilist_contains(a1, &o[8]) || ilist_remove(a1, &o[8]) != -1 ||
+            ilist_insert(a2, &o[8], &o[1]) != -1 || o[8].a.list) {
+        failed = 1;
+    }
+    if (test_check(a1, a1Ids, 5) != 0 || test_check(a2, a2Ids, 3) != 0 ||
+            test_check(b, a1Ids, 5) != 0) {
+        failed = 1;
+    }
+
+    /* Other link: removing from 'b' leaves the 'a' list alone. */
+    if (ilist_remove(b, &o[2]) != 0 || ilist_contains(b, &o[2]) ||
+            ilist_remove(b, &o[2]) != -1 || !ilist_contains(a1, &o[2]) ||
+            test_check(a1, a1Ids, 5) != 0 || test_check(b, bIds, 4) != 0) {
+        failed = 1;
+    }
+
+    /* Moved between lists sharing the link, the back-pointer follows. */
+    if (ilist_remove(a1, &o[2]) != 0 || ilist_pushBack(a2, &o[2]) != 0 ||
+            ilist_contains(a1, &o[2]) || ilist_remove(a1, &o[2]) != -1 ||
+            !ilist_contains(a2, &o[2]) || test_check(a1, a1Moved, 4) != 0 ||
+            test_check(a2, a2Moved, 4) != 0 || test_check(b, bIds, 4) != 0) {
+        failed = 1;
+    }
+    if (ilist_remove(a2, &o[2]) != 0 || test_check(a2, a2Ids, 3) != 0) {
+        failed = 1;
+    }
+
+    ilist_destroy(a1);
+    ilist_destroy(a2);
+    ilist_destroy(b);
+    return failed ? -1 : 0;
+}
+
+int main(void)
+{
+    static const struct {
+        const char* name;
+        eListThreadAlt threadAlt;
+    } modes[] = {
+        { "not_threadsafe", LIST_NOT_THREADSAFE },
+        { "threadsafe",     LIST_THREADSAFE },
+        { "rw",             LIST_THREADSAFE_RW },
+    };
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        int ret = test_mode(modes[i].threadAlt);
+        printf("%-16s %s\n", modes[i].name, ret ? "FAILED" : "ok");
+        if (ret) {
+            failed = 1;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,228 @@
+/*-----------------------------------------------------------------------
+ * Tests of vn::List, built under AddressSanitizer and UBSan and run by
+ * ctest.
+ *
+ *   test_list_hpp
+ *
+ * For both thread policies: a list of std::unique_ptr, a move-only type,
+ * is filled, popped, filtered and refilled over several slabs; every
+ * element, stored by value or behind a unique_ptr, must be destroyed
+ * exactly once by clear() and by the list's destructor; and pointers moved
+ * to an sList with moveTo() and back with moveFrom(), more than SLAB_SIZE
+ * of them, must come back complete and in order.
+ *-----------------------------------------------------------------------*/
+
+#include "u_list.hpp"
+#include <memory>
+#include <stdio.h>
+
+#define TEST_ELEMENTS       200         /* Over three slabs. */
+
+/* Move-only element counting its destructions by id; -1 once moved from. */
+struct Tracked {
+    static int destroyed[TEST_ELEMENTS];
+
+    explicit Tracked(int i) : id(i) {}
+    Tracked(Tracked&& other) : id(other.id) { other.id = -1; }
+    Tracked& operator=(Tracked&& other)
+    {
+        release();
+        id = other.id;
+        other.id = -1;
+        return *this;
+    }
+    ~Tracked() { release(); }
+
+    void release()
+    {
+        if (id >= 0) {
+            destroyed[id]++;
+            id = -1;
+        }
+    }
+
+    int id;
+
+private:
+    Tracked(const Tracked&);
+    Tracked& operator=(const Tracked&);
+};
+
+int Tracked::destroyed[TEST_ELEMENTS];
+
+static void test_reset()
+{
+    for (int i = 0; i < TEST_ELEMENTS; i++) {
+        Tracked::destroyed[i] = 0;
+    }
+}
+
+/* Returns 0 if ids from..to-1 were destroyed once and no others at all. */
+static int test_destroyedOnce(int from, int to)
+{
+    for (int i = 0; i < TEST_ELEMENTS; i++) {
+        if (Tracked::destroyed[i] != (i >= from && i < to ? 1 : 0)) {
+            fprintf(stderr, "element %d destroyed %d times\n", i,
+                    Tracked::destroyed[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+template <typename Policy>
+static int test_uniquePtr()
+{
+    vn::List<std::unique_ptr<Tracked>, Policy> list;
+    std::unique_ptr<Tracked> out;
+    int failed = 0;
+
+    test_reset();
+    for (int i = 0; i < TEST_ELEMENTS; i++) {
+        if (list.pushBack(std::unique_ptr<Tracked>(new Tracked(i))) != 0) {
+            return -1;
+        }
+    }
+    /* Popping hands elements over; 'out' frees the first taking the second. */
+    if (!list.popFront(out) || out->id != 0 || !list.popBack(out) ||
+            out->id != TEST_ELEMENTS - 1 || test_destroyedOnce(0, 1) != 0) {
+        failed = 1;
+    }
+    out.reset();
+    if (!list.removeIf([](const std::unique_ptr<Tracked>& p) {
+                return p->id == 100;
+            }) || list.size() != TEST_ELEMENTS - 3) {
+        failed = 1;
+    }
+    int expected = 1;
+    list.foreach([&](std::unique_ptr<Tracked>& p) {
+        if (expected == 100) {
+            expected++;
+        }
+        if (p->id != expected++) {
+            failed = 1;
+        }
+        return true;
+    });
+    /* Reuses the recycled slots of the three elements taken out. */
+    if (list.emplaceFront(new Tracked(0)) != 0 ||
+            list.emplaceBack(new Tracked(100)) != 0 ||
+            list.emplaceBack(new Tracked(TEST_ELEMENTS - 1)) != 0 ||
+            list.size() != TEST_ELEMENTS) {
+        failed = 1;
+    }
+    list.clear();
+    for (int i = 0; i < TEST_ELEMENTS; i++) {
+        if (Tracked::destroyed[i] != (i == 0 || i == 100 ||
+                    i == TEST_ELEMENTS - 1 ? 2 : 1)) {
+            failed = 1;
+        }
+    }
+    return failed || !list.empty() ? -1 : 0;
+}
+
+template <typename Policy>
+static int test_destructors()
+{
+    int failed = 0;
+
+    test_reset();
+    {
+        vn::List<Tracked, Policy> list;
+        for (int i = 0; i < TEST_ELEMENTS; i++) {
+            list.emplaceBack(i);
+        }
+        list.clear();
+        if (test_destroyedOnce(0, TEST_ELEMENTS) != 0 || list.size() != 0) {
+            failed = 1;
+        }
+
+        test_reset();
+        for (int i = 0; i < TEST_ELEMENTS; i++) {
+            list.pushBack(Tracked(i));
+        }
+        Tracked out(-1);
+        if (!list.popFront(out) || out.id != 0) {
+            failed = 1;
+        }
+        if (test_destroyedOnce(0, 0) != 0) {
+            failed = 1;
+        }
+    }
+    /* The list's destructor got the rest, and 'out' the popped one. */
+    if (test_destroyedOnce(0, TEST_ELEMENTS) != 0) {
+        failed = 1;
+    }
+    return failed ? -1 : 0;
+}
+
+template <typename Policy>
+static int test_roundTrip()
+{
+    static long values[TEST_ELEMENTS];
+    vn::List<long*, Policy> list;
+    sList* l = list_create(NULL);
+    int failed = 0;
+    long* p;
+
+    if (!l) {
+        return -1;
+    }
+    for (int i = 0; i < TEST_ELEMENTS; i++) {
+        values[i] = i;
+        list_pushBack(l, &values[i]);
+    }
+    if (list.moveFrom(l) != TEST_ELEMENTS || list_size(l) != 0 ||
+            list.size() != TEST_ELEMENTS) {
+        failed = 1;
+    }
+    /* Append after the moved elements, then send everything back. */
+    list.pushBack(&values[0]);
+    if (list.moveTo(l) != TEST_ELEMENTS + 1 || !list.empty() ||
+            list_size(l) != TEST_ELEMENTS + 1) {
+        failed = 1;
+    }
+    for (int i = 0; i <= TEST_ELEMENTS; i++) {
+        p = (long*) list_popFront(l);
+        if (p != &values[i % TEST_ELEMENTS]) {
+            failed = 1;
+        }
+    }
+    /* And once more through a list which isn't empty. */
+    list.pushBack(&values[1]);
+    for (int i = 2; i < TEST_ELEMENTS; i++) {
+        list_pushBack(l, &values[i]);
+    }
+    if (list.moveFrom(l) != TEST_ELEMENTS - 2 || list.moveTo(l) !=
+            TEST_ELEMENTS - 1 || list_size(l) != TEST_ELEMENTS - 1) {
+        failed = 1;
+    }
+    for (int i = 1; i < TEST_ELEMENTS; i++) {
+        p = (long*) list_popFront(l);
+        if (p != &values[i]) {
+            failed = 1;
+        }
+    }
+    list_destroy(l);
+    return failed ? -1 : 0;
+}
+
+template <typename Policy>
+static int test_policy(const char* name)
+{
+    int uniquePtr = test_uniquePtr<Policy>();
+    int destructors = test_destructors<Policy>();
+    int roundTrip = test_roundTrip<Policy>();
+
+    printf("%-16s unique_ptr %s, destructors %s, round trip %s\n", name,
+            uniquePtr ? "FAILED" : "ok", destructors ? "FAILED" : "ok",
+            roundTrip ? "FAILED" : "ok");
+    return uniquePtr || destructors || roundTrip ? -1 : 0;
+}
+
+int main()
+{
+    int locked = test_policy<vn::ListLocked>("locked");
+    int unlocked = test_policy<vn::ListUnlocked>("unlocked");
+    return locked || unlocked ? 1 : 0;
+}